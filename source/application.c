@@ -10,6 +10,15 @@ __declspec(dllimport) void __stdcall OutputDebugStringA(const char* lpOutputStri
 #endif
 
 #include "game.h"
+#include "benchmark.h"
+#include "replay.h"
+#include "stream.h"
+#include "shared_export.h"
+#include "sprite_stream.h"
+#include "shard.h"
+#include "tuning.h"
+#include <stdlib.h>
+#include <string.h>
 
 extern const char *vs_src, *fs_src;
 
@@ -19,6 +28,64 @@ sg_draw_state draw_state;
 static sprite_data_t* sprite_data;
 static uint64_t time;
 
+/* command line options: record a replay into a file, or play one back starting at given frame */
+static const char* record_replay_path;
+static const char* play_replay_path;
+static int play_replay_frame;
+static bool playing_replay;
+
+/* command line option: instead of simulating, show frames streamed from a server on this port */
+static int stream_port;
+static stream_client_t* stream_client;
+static int stream_sprite_count;
+
+/* command line option: export sprite data of each frame into a named shared memory segment */
+static const char* shared_export_name;
+
+/* command line options: record rendered sprite data into a file, or show it (looping) instead of simulating */
+static const char* record_sprites_path;
+static const char* play_sprites_path;
+static int play_sprites_frame;
+static bool playing_sprites;
+
+/* command line option: simulate the world split into tiles, each in a separate worker process */
+static int shard_tiles_x, shard_tiles_y;
+static shard_world_t* shard_world;
+
+/* command line option: which implementation of the game to run (see game_variant_t) */
+static game_variant_t game_variant = GAME_VARIANT_DOD;
+
+/* parallel settings of game systems are calibrated on first run (or with "--tune"), and cached in this file */
+static const char* tuning_path = "dod-playground-tuning.txt";
+static bool force_tuning;
+
+/* command line option: time budget for avoidance per frame, in milliseconds (0: no budget) */
+static float avoidance_budget;
+
+/* command line option: avoidance broadphase name (null: default; unknown names are ignored) */
+static const char* avoidance_broadphase;
+
+/* command line option: radius within which regular objects push each other apart (0: off) */
+static float separation_radius;
+
+/* command line option: things to avoid bounce off each other */
+static bool avoiders_repel;
+
+/* command line option: regular objects cycle through their sprites */
+static bool animate_sprites;
+
+/* command line option: seconds for colors taken from things to avoid to fade halfway back (0: never fade) */
+static float tint_half_life;
+
+/* command line option: particles per second that things to avoid leave behind (0: none) */
+static float trail_rate;
+
+/* command line option: sprites attached around each thing to avoid (0: none) */
+static int attachment_count;
+
+/* command line option: regular objects flock together */
+static bool flocking;
+
 typedef struct {
     float aspect;
 } vs_params_t;
@@ -111,8 +178,56 @@ void init(void) {
     stm_setup();
     sprite_data = (sprite_data_t*)malloc(kMaxSpriteCount * sizeof(sprite_data_t));
 
+    if (shared_export_name)
+        shared_export_create(shared_export_name, kMaxSpriteCount);
+
+    if (!stream_port && !shard_tiles_x && !play_sprites_path && (force_tuning || !tuning_load(tuning_path)))
+        tuning_calibrate(tuning_path, 1);
+    game_set_avoidance_budget(avoidance_budget);
+    if (avoidance_broadphase)
+        game_set_avoidance_broadphase(avoidance_broadphase);
+
     uint64_t t0 = stm_now();
-    game_initialize();
+    if (stream_port) {
+        stream_client = stream_client_connect("127.0.0.1", stream_port);
+    }
+    else if (shard_tiles_x) {
+        shard_world = shard_world_create(NULL, shard_tiles_x, shard_tiles_y);
+    }
+    else if (play_sprites_path) {
+        playing_sprites = sprite_stream_play_begin(play_sprites_path) > 0 && sprite_stream_seek(play_sprites_frame);
+        if (!playing_sprites)
+            game_initialize(NULL);
+    }
+    else if (play_replay_path) {
+        playing_replay = replay_play_begin(play_replay_path) >= 0 && replay_seek(play_replay_frame, sprite_data);
+        if (!playing_replay)
+            game_initialize(NULL);
+    }
+    else {
+        game_config_t config;
+        game_default_config(&config);
+        config.variant = game_variant;
+        config.separationRadius = separation_radius;
+        config.avoidersRepel = avoiders_repel;
+        config.animateSprites = animate_sprites;
+        config.tintHalfLife = tint_half_life;
+        config.trailRate = trail_rate;
+        config.attachmentCount = attachment_count;
+        config.flocking = flocking;
+        game_initialize(&config);
+        if (record_replay_path && !replay_record_begin(record_replay_path, &config, 60)) {
+            char msg[1000];
+            snprintf(msg, sizeof(msg), "Could not record replay into %s (only the dod variant can be recorded)\n", record_replay_path);
+            #ifdef _MSC_VER
+            OutputDebugStringA(msg);
+            #else
+            fputs(msg, stderr);
+            #endif
+        }
+    }
+    if (record_sprites_path)
+        sprite_stream_record_begin(record_sprites_path);
     uint64_t tdiff = stm_diff(stm_now(), t0);
     char buf[1000];
     snprintf(buf, sizeof(buf), "Initialize time: %.1fms\n", stm_ms(tdiff));
@@ -131,8 +246,58 @@ void frame(void) {
 
     uint64_t dt = stm_laptime(&time);
     
+    /* with shared memory export, frame data is produced directly in the shared buffers */
+    sprite_data_t* data = shared_export_name ? shared_export_begin_frame() : NULL;
+    if (data == NULL)
+        data = sprite_data;
+
     uint64_t t0 = stm_now();
-    int sprite_count = game_update(sprite_data, stm_sec(time), (float)stm_sec(dt));
+    int sprite_count = -1;
+    if (stream_client) {
+        /* keep showing the last frame if server went away */
+        int count = stream_client_receive(stream_client, data, NULL);
+        if (count >= 0)
+            stream_sprite_count = count;
+        else {
+            stream_client_close(stream_client);
+            stream_client = NULL;
+        }
+        sprite_count = stream_sprite_count;
+    }
+    else if (stream_port) {
+        sprite_count = stream_sprite_count;
+    }
+    else if (shard_world) {
+        sprite_count = shard_world_update(shard_world, data, stm_sec(time), (float)stm_sec(dt));
+        if (sprite_count < 0) {
+            shard_world_destroy(shard_world);
+            shard_world = NULL;
+            sprite_count = 0;
+        }
+    }
+    else if (shard_tiles_x) {
+        sprite_count = 0;
+    }
+    else if (playing_sprites) {
+        /* recorded sprite data goes straight to rendering; loop back to the start at the end */
+        sprite_count = sprite_stream_play_frame(data);
+        if (sprite_count < 0 && sprite_stream_seek(0))
+            sprite_count = sprite_stream_play_frame(data);
+        if (sprite_count < 0) {
+            /* broken file; nothing sensible to show */
+            playing_sprites = false;
+            sprite_count = 0;
+        }
+    }
+    else if (playing_replay) {
+        /* when replay ends, just continue simulating from there */
+        sprite_count = replay_play_frame(data);
+        playing_replay = sprite_count >= 0;
+    }
+    if (sprite_count < 0) {
+        replay_record_frame(stm_sec(time), (float)stm_sec(dt));
+        sprite_count = game_update(data, stm_sec(time), (float)stm_sec(dt));
+    }
     uint64_t tdiff = stm_diff(stm_now(), t0);
     // print times that game update took (print only on frames that are powers of two, to not
     // spam the output)
@@ -156,7 +321,10 @@ void frame(void) {
     }
 
     assert(sprite_count >= 0 && sprite_count <= kMaxSpriteCount);
-    sg_update_buffer(draw_state.vertex_buffers[0], sprite_data, sprite_count * sizeof(sprite_data[0]));
+    sprite_stream_record_frame(data, sprite_count);
+    if (shared_export_name)
+        shared_export_end_frame(sprite_count, stm_sec(time));
+    sg_update_buffer(draw_state.vertex_buffers[0], data, sprite_count * sizeof(data[0]));
 
     sg_pass_action pass_action = {
         .colors[0] = { .action = SG_ACTION_CLEAR, .val = { 0.1f, 0.1f, 0.1f, 1.0f } }
@@ -171,11 +339,89 @@ void frame(void) {
 }
 
 void cleanup(void) {
+    shared_export_destroy();
+    stream_client_close(stream_client);
+    replay_record_end();
+    replay_play_end();
+    sprite_stream_record_end();
+    sprite_stream_play_end();
+    shard_world_destroy(shard_world);
     game_destroy();
     sg_shutdown();
 }
 
 sapp_desc sokol_main(int argc, char* argv[]) {
+    /* "--benchmark [name]" runs benchmarks and exits, without creating a window */
+    if (argc > 1 && strcmp(argv[1], "--benchmark") == 0) {
+        exit(benchmark_run(argc > 2 ? argv[2] : NULL));
+    }
+    /* "--server [port]" runs headless simulation, streaming it to clients */
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        tuning_load(tuning_path);
+        exit(stream_server_run(argc > 2 ? atoi(argv[2]) : 27182, 0, 60.0f));
+    }
+    /* "--shard-worker <name> <tile>" is how sharded simulation starts its worker processes on Windows */
+    if (argc > 3 && strcmp(argv[1], "--shard-worker") == 0) {
+        exit(shard_worker_run(argv[2], atoi(argv[3])));
+    }
+    /* "--record <file>" records a replay, "--replay <file> [frame]" plays it back from given frame;
+       "--record-sprites <file>" and "--play-sprites <file> [frame]" do the same with rendered sprite data;
+       "--variant <dod|ecs|oop>" picks the game implementation; "--avoid-budget <ms>" caps avoidance time per frame;
+       "--separation <radius>" makes objects push each other apart; "--avoid-broadphase <auto|brute|grid|bvh|sweep>"
+       picks how avoidance finds nearby things to avoid (brute checks all objects, auto may check only ones near them);
+       "--tint-fade <seconds>" fades colors taken from them back;
+       "--trails <rate>" makes them leave particles behind; "--attach <count>" attaches sprites around them */
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (strcmp(argv[i], "--record") == 0)
+            record_replay_path = argv[i + 1];
+        if (strcmp(argv[i], "--replay") == 0) {
+            play_replay_path = argv[i + 1];
+            play_replay_frame = i + 2 < argc ? atoi(argv[i + 2]) : 0;
+        }
+        if (strcmp(argv[i], "--record-sprites") == 0)
+            record_sprites_path = argv[i + 1];
+        if (strcmp(argv[i], "--play-sprites") == 0) {
+            play_sprites_path = argv[i + 1];
+            play_sprites_frame = i + 2 < argc ? atoi(argv[i + 2]) : 0;
+        }
+        if (strcmp(argv[i], "--variant") == 0 && game_variant_from_name(argv[i + 1]) != GAME_VARIANT_COUNT)
+            game_variant = game_variant_from_name(argv[i + 1]);
+        if (strcmp(argv[i], "--avoid-budget") == 0)
+            avoidance_budget = (float)atof(argv[i + 1]);
+        if (strcmp(argv[i], "--separation") == 0)
+            separation_radius = (float)atof(argv[i + 1]);
+        if (strcmp(argv[i], "--avoid-broadphase") == 0)
+            avoidance_broadphase = argv[i + 1];
+        if (strcmp(argv[i], "--tint-fade") == 0)
+            tint_half_life = (float)atof(argv[i + 1]);
+        if (strcmp(argv[i], "--trails") == 0)
+            trail_rate = (float)atof(argv[i + 1]);
+        if (strcmp(argv[i], "--attach") == 0)
+            attachment_count = atoi(argv[i + 1]);
+    }
+    /* "--connect [port]" shows simulation streamed from a server; "--shm-export [name]" exports
+       sprite data of each frame into shared memory; "--shards [XxY]" splits simulation into tiles;
+       "--tune" re-calibrates parallel settings; "--avoiders-repel" makes things to avoid bounce off each other;
+       "--animate" makes objects cycle through their sprites; "--flock" makes them flock together */
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--tune") == 0)
+            force_tuning = true;
+        if (strcmp(argv[i], "--avoiders-repel") == 0)
+            avoiders_repel = true;
+        if (strcmp(argv[i], "--animate") == 0)
+            animate_sprites = true;
+        if (strcmp(argv[i], "--flock") == 0)
+            flocking = true;
+        if (strcmp(argv[i], "--connect") == 0)
+            stream_port = i + 1 < argc ? atoi(argv[i + 1]) : 27182;
+        if (strcmp(argv[i], "--shm-export") == 0)
+            shared_export_name = i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : "dod-playground";
+        if (strcmp(argv[i], "--shards") == 0) {
+            shard_tiles_x = shard_tiles_y = 2;
+            if (i + 1 < argc && sscanf(argv[i + 1], "%dx%d", &shard_tiles_x, &shard_tiles_y) != 2)
+                shard_tiles_x = shard_tiles_y = 2;
+        }
+    }
     return (sapp_desc){
         .init_cb = init,
         .frame_cb = frame,
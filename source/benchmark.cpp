@@ -0,0 +1,1655 @@
+#include "benchmark.h"
+#include "multiworld.h"
+#include "replay.h"
+#include "stream.h"
+#include "shared_export.h"
+#include "sprite_stream.h"
+#include "shard.h"
+#include "layouts.h"
+#include "systems.h"
+#include "tuning.h"
+#include "numa.h"
+#include "spatial_grid.h"
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+extern "C" __declspec(dllimport) void __stdcall OutputDebugStringA(const char* lpOutputString);
+#endif
+
+
+static void BenchPrintf(const char* format, ...)
+{
+    char buf[1000];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    #ifdef _MSC_VER
+    OutputDebugStringA(buf);
+    #endif
+    fputs(buf, stdout);
+    fflush(stdout);
+}
+
+static double TimeNow()
+{
+    using namespace std::chrono;
+    return duration<double>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Many small worlds: each world simulated on its own (like MoveSystem would), vs all of them
+// batched into SIMD lanes by MultiWorld.
+
+static int BenchMultiWorld()
+{
+    const int kWorldCount = 4096;
+    const int kObjectsPerWorld = 1000;
+    const int kFrames = 20;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    // parameter sweep: worlds of different sizes & speeds
+    std::vector<MultiWorldParams> params(kWorldCount);
+    for (int w = 0; w < kWorldCount; ++w)
+    {
+        float size = 1.0f + (w % 64) * 0.25f;
+        params[w] = { -8.0f * size, 8.0f * size, -5.0f * size, 5.0f * size, 0.5f + (w / 64) * 0.1f, 0.7f + (w / 64) * 0.1f };
+    }
+    srand(1);
+    MultiWorld batched;
+    batched.Initialize(params, kObjectsPerWorld);
+
+    // same initial data, but as separate worlds in the regular "array of components" layout
+    struct Pos { float x, y; };
+    struct Vel { float velx, vely; };
+    struct World { MultiWorldParams params; std::vector<Pos> positions; std::vector<Vel> moves; };
+    std::vector<World> worlds(kWorldCount);
+    for (int w = 0; w < kWorldCount; ++w)
+    {
+        worlds[w].params = params[w];
+        for (int i = 0; i < kObjectsPerWorld; ++i)
+        {
+            size_t idx = batched.DataIndex(w, i);
+            worlds[w].positions.push_back({ batched.posX[idx], batched.posY[idx] });
+            worlds[w].moves.push_back({ batched.velX[idx], batched.velY[idx] });
+        }
+    }
+
+    double t0 = TimeNow();
+    for (int f = 0; f < kFrames; ++f)
+    {
+        for (World& world : worlds)
+        {
+            const MultiWorldParams& bounds = world.params;
+            for (size_t i = 0, n = world.positions.size(); i != n; ++i)
+            {
+                Pos& pos = world.positions[i];
+                Vel& move = world.moves[i];
+                pos.x += move.velx * kDeltaTime;
+                pos.y += move.vely * kDeltaTime;
+                if (pos.x < bounds.xMin) { move.velx = -move.velx; pos.x = bounds.xMin; }
+                if (pos.x > bounds.xMax) { move.velx = -move.velx; pos.x = bounds.xMax; }
+                if (pos.y < bounds.yMin) { move.vely = -move.vely; pos.y = bounds.yMin; }
+                if (pos.y > bounds.yMax) { move.vely = -move.vely; pos.y = bounds.yMax; }
+            }
+        }
+    }
+    double tSeparate = TimeNow() - t0;
+
+    t0 = TimeNow();
+    for (int f = 0; f < kFrames; ++f)
+        batched.UpdateSystem(kDeltaTime);
+    double tBatched = TimeNow() - t0;
+
+    float maxDiff = 0.0f;
+    for (int w = 0; w < kWorldCount; ++w)
+    {
+        for (int i = 0; i < kObjectsPerWorld; ++i)
+        {
+            size_t idx = batched.DataIndex(w, i);
+            maxDiff = fmaxf(maxDiff, fabsf(batched.posX[idx] - worlds[w].positions[i].x));
+            maxDiff = fmaxf(maxDiff, fabsf(batched.posY[idx] - worlds[w].positions[i].y));
+        }
+    }
+
+    double objectFrames = (double)kWorldCount * kObjectsPerWorld * kFrames;
+    BenchPrintf("multiworld: %i worlds x %i objects, %i frames\n", kWorldCount, kObjectsPerWorld, kFrames);
+    BenchPrintf("  separate worlds: %.2f ns/object\n", tSeparate * 1.0e9 / objectFrames);
+    BenchPrintf("  batched lanes:   %.2f ns/object (%.1fx)\n", tBatched * 1.0e9 / objectFrames, tSeparate / tBatched);
+    BenchPrintf("  max position difference: %g\n", maxDiff);
+    return maxDiff == 0.0f ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Replay recording with a keyframe on every frame (cost of keyframe encoding, and size), and then
+// seeking to a frame in it; result should exactly match the frame that was originally simulated.
+// Encoding is meant to run every frame in production, so it fails when it costs more than a share
+// of the update itself.
+
+static int BenchReplay()
+{
+    const char* kPath = "benchmark-replay.tmp";
+    const int kFrames = 100;
+    const int kCheckFrame = 77;
+    const float kDeltaTime = 1.0f / 60.0f;
+    const double kMaxEncodingShare = 1.5;
+
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    std::vector<sprite_data_t> expected;
+    game_config_t config;
+    game_default_config(&config);
+    game_initialize(&config);
+    replay_record_begin(kPath, &config, 1);
+    double tRecord = 0.0, tUpdate = 0.0;
+    for (int f = 0; f < kFrames; ++f)
+    {
+        double t0 = TimeNow();
+        replay_record_frame(f * kDeltaTime, kDeltaTime);
+        double t1 = TimeNow();
+        int count = game_update(sprites.data(), f * kDeltaTime, kDeltaTime);
+        tRecord += t1 - t0;
+        tUpdate += TimeNow() - t1;
+        if (f + 1 == kCheckFrame)
+            expected.assign(sprites.begin(), sprites.begin() + count);
+    }
+    replay_record_end();
+    game_destroy();
+
+    FILE* f = fopen(kPath, "rb");
+    fseek(f, 0, SEEK_END);
+    double fileSize = (double)ftell(f);
+    fclose(f);
+
+    double t0 = TimeNow();
+    replay_play_begin(kPath);
+    double tInit = TimeNow() - t0;
+    t0 = TimeNow();
+    replay_seek(kCheckFrame - 1, sprites.data());
+    int count = replay_play_frame(sprites.data());
+    double tSeek = TimeNow() - t0;
+    replay_play_end();
+    game_destroy();
+    remove(kPath);
+
+    bool match = count == (int)expected.size() && memcmp(sprites.data(), expected.data(), count * sizeof(sprites[0])) == 0;
+    BenchPrintf("replay: %i frames, keyframe every frame\n", kFrames);
+    double share = tRecord / tUpdate;
+    BenchPrintf("  update %.2fms/frame, keyframe encoding %.2fms/frame (%.0f%% of update, limit %.0f%%)%s\n", tUpdate * 1000.0 / kFrames, tRecord * 1000.0 / kFrames,
+        share * 100.0, kMaxEncodingShare * 100.0, share > kMaxEncodingShare ? " TOO SLOW" : "");
+    BenchPrintf("  file size %.1fMB (%.2fMB/frame)\n", fileSize / 1.0e6, fileSize / 1.0e6 / kFrames);
+    BenchPrintf("  seek to frame %i: %.1fms (+%.1fms game init), %s\n", kCheckFrame, tSeek * 1000.0, tInit * 1000.0, match ? "matches original" : "DOES NOT MATCH");
+    return match && share <= kMaxEncodingShare ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Streaming server with loopback clients: bandwidth & latency of streamed frames, for a client
+// that gets everything, and one that only looks at a small part of the world.
+
+struct StreamClientStats
+{
+    int frames = 0;
+    double bytes = 0, sprites = 0, latencySum = 0, latencyMax = 0;
+    bool outsideView = false;
+};
+
+static void RunStreamClient(int port, bool viewport, StreamClientStats& stats)
+{
+    const float kView = 0.5f;
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    stream_client_t* client = NULL;
+    for (int attempt = 0; attempt < 500 && client == NULL; ++attempt)
+    {
+        client = stream_client_connect("127.0.0.1", port);
+        if (client == NULL)
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (client == NULL)
+        return;
+    if (viewport)
+        stream_client_set_viewport(client, -kView, -kView, kView, kView);
+    double latency;
+    int count;
+    while ((count = stream_client_receive(client, sprites.data(), &latency)) >= 0)
+    {
+        stats.frames++;
+        stats.sprites += count;
+        stats.latencySum += latency;
+        stats.latencyMax = std::max(stats.latencyMax, latency);
+        // first frames can arrive before server got the viewport
+        for (int i = 0; viewport && stats.frames > 5 && i < count; ++i)
+        {
+            if (fabsf(sprites[i].posX) > kView + 0.01f || fabsf(sprites[i].posY) > kView + 0.01f)
+                stats.outsideView = true;
+        }
+    }
+    stats.bytes = stream_client_received_bytes(client);
+    stream_client_close(client);
+}
+
+static int BenchStream()
+{
+    const int kPort = 27183;
+    const int kFrames = 60;
+
+    StreamClientStats stats[2];
+    std::thread fullClient([&]() { RunStreamClient(kPort, false, stats[0]); });
+    std::thread viewClient([&]() { RunStreamClient(kPort, true, stats[1]); });
+    int result = stream_server_run(kPort, kFrames, 60.0f);
+    fullClient.join();
+    viewClient.join();
+
+    BenchPrintf("stream: server ran %i frames\n", kFrames);
+    for (int i = 0; i < 2; ++i)
+    {
+        const StreamClientStats& s = stats[i];
+        BenchPrintf("  %s client: received %i frames, %.0f sprites/frame\n", i == 0 ? "full" : "viewport", s.frames, s.frames ? s.sprites / s.frames : 0.0);
+        if (result != 0 || s.frames == 0 || s.outsideView)
+        {
+            BenchPrintf("  FAILED: %s\n", s.outsideView ? "got sprites outside of viewport" : "could not run server or connect to it");
+            return 1;
+        }
+        BenchPrintf("    %.3fMB/frame (%.2f bytes/sprite)\n", s.bytes / s.frames / 1.0e6, s.bytes / s.sprites);
+        BenchPrintf("    latency avg %.1fms, max %.1fms\n", s.latencySum / s.frames * 1000.0, s.latencyMax * 1000.0);
+    }
+    return 0;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Shared memory export: writer produces frames as fast as it can, while a reader looks at them in
+// place. Every sprite of a frame has its frame number written into it, so the reader can tell if it
+// ever accepted a frame that was partially overwritten.
+
+static int BenchSharedExport()
+{
+    const char* kName = "dod-playground-benchmark";
+    const int kFrames = 200;
+    const int kSprites = kMaxSpriteCount;
+
+    if (!shared_export_create(kName, kSprites))
+    {
+        BenchPrintf("shm: FAILED to create shared memory\n");
+        return 1;
+    }
+    std::atomic<bool> done(false);
+    int validFrames = 0, discardedFrames = 0, tornAccepted = 0;
+    std::thread reader([&]()
+    {
+        shared_export_reader_t* r = shared_export_open(kName);
+        if (r == NULL)
+            return;
+        uint64_t lastFrame = (uint64_t)-1;
+        while (!done.load())
+        {
+            int count;
+            uint64_t frame;
+            const sprite_data_t* data = shared_export_acquire(r, &count, &frame, NULL);
+            if (data == NULL || frame == lastFrame)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            bool consistent = true;
+            for (int i = 0; i < count; ++i)
+                consistent &= data[i].posX == (float)frame && data[i].colB == (float)frame;
+            if (shared_export_release(r))
+            {
+                validFrames++;
+                tornAccepted += !consistent;
+                lastFrame = frame;
+            }
+            else
+                discardedFrames++;
+        }
+        shared_export_close(r);
+    });
+
+    double t0 = TimeNow();
+    for (int f = 0; f < kFrames; ++f)
+    {
+        sprite_data_t* data = shared_export_begin_frame();
+        for (int i = 0; i < kSprites; ++i)
+        {
+            sprite_data_t& s = data[i];
+            s.posX = s.posY = s.scale = s.colR = s.colG = s.colB = s.sprite = (float)f;
+        }
+        shared_export_end_frame(kSprites, f);
+    }
+    double tWrite = TimeNow() - t0;
+    done.store(true);
+    reader.join();
+    shared_export_destroy();
+
+    BenchPrintf("shm: %i frames of %i sprites, writer %.2fms/frame\n", kFrames, kSprites, tWrite * 1000.0 / kFrames);
+    BenchPrintf("  reader: %i frames read, %i discarded as overwritten, %i torn frames accepted\n", validFrames, discardedFrames, tornAccepted);
+    return validFrames > 0 && tornAccepted == 0 ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Sprite stream: record simulated frames, then decode them all back as fast as possible, and check
+// that a seeked-to frame is within quantization error of the original.
+
+static int BenchSpriteStream()
+{
+    const char* kPath = "benchmark-sprites.tmp";
+    const int kFrames = 120;
+    const int kCheckFrame = 77;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    std::vector<sprite_data_t> expected;
+    game_initialize(NULL);
+    sprite_stream_record_begin(kPath);
+    double tRecord = 0.0, tUpdate = 0.0;
+    for (int f = 0; f < kFrames; ++f)
+    {
+        double t0 = TimeNow();
+        int count = game_update(sprites.data(), f * kDeltaTime, kDeltaTime);
+        double t1 = TimeNow();
+        sprite_stream_record_frame(sprites.data(), count);
+        tUpdate += t1 - t0;
+        tRecord += TimeNow() - t1;
+        if (f == kCheckFrame)
+            expected.assign(sprites.begin(), sprites.begin() + count);
+    }
+    sprite_stream_record_end();
+    game_destroy();
+
+    FILE* f = fopen(kPath, "rb");
+    fseek(f, 0, SEEK_END);
+    double fileSize = (double)ftell(f);
+    fclose(f);
+
+    int frames = sprite_stream_play_begin(kPath);
+    double t0 = TimeNow();
+    int decoded = 0;
+    while (sprite_stream_play_frame(sprites.data()) >= 0)
+        ++decoded;
+    double tDecode = TimeNow() - t0;
+    t0 = TimeNow();
+    sprite_stream_seek(kCheckFrame);
+    int count = sprite_stream_play_frame(sprites.data());
+    double tSeek = TimeNow() - t0;
+    sprite_stream_play_end();
+    remove(kPath);
+
+    // positions are within half a quantization step (of a range slightly larger than the world),
+    // colors within half of 1/255
+    float maxPosError = 0.0f, maxColError = 0.0f;
+    bool match = count == (int)expected.size() && decoded == kFrames && frames == kFrames;
+    for (int i = 0; match && i < count; ++i)
+    {
+        const sprite_data_t& a = sprites[i];
+        const sprite_data_t& b = expected[i];
+        maxPosError = std::max(maxPosError, std::max(fabsf(a.posX - b.posX), fabsf(a.posY - b.posY)));
+        maxColError = std::max(maxColError, std::max(fabsf(a.colR - b.colR), std::max(fabsf(a.colG - b.colG), fabsf(a.colB - b.colB))));
+        match &= a.sprite == b.sprite && fabsf(a.scale - b.scale) < 1.0e-3f;
+    }
+    match &= maxPosError < 1.0e-4f && maxColError < 0.5f / 255.0f + 1.0e-6f;
+    double decodeMs = tDecode * 1000.0 / std::max(decoded, 1);
+    BenchPrintf("spritestream: %i frames of %i sprites\n", kFrames, count);
+    BenchPrintf("  record %.2fms/frame, file size %.2fMB (%.1fKB/frame, %.2f bytes/sprite)\n", tRecord * 1000.0 / kFrames,
+        fileSize / 1.0e6, fileSize / 1.0e3 / kFrames, fileSize / kFrames / std::max(count, 1));
+    BenchPrintf("  decode %.2fms/frame: %.1fx realtime at 60Hz, %.1fx faster than game_update (%.2fms/frame)\n", decodeMs,
+        1000.0 / 60.0 / decodeMs, tUpdate * 1000.0 / kFrames / decodeMs, tUpdate * 1000.0 / kFrames);
+    BenchPrintf("  seek to frame %i: %.1fms, max error position %.6f color %.4f, %s\n", kCheckFrame, tSeek * 1000.0,
+        maxPosError, maxColError, match ? "matches original" : "DOES NOT MATCH");
+    return match ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Sharded simulation: the same world simulated in one process, and split into 2x2 tiles owned by
+// worker processes; every frame has to match exactly.
+
+static int BenchShard()
+{
+    const int kFrames = 120;
+    const int kTilesX = 2, kTilesY = 2;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    game_config_t config;
+    game_default_config(&config);
+    config.objectCount = 250000;
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    game_initialize(&config);
+    double t0 = TimeNow();
+    shard_world_t* world = shard_world_create(&config, kTilesX, kTilesY);
+    double tCreate = TimeNow() - t0;
+    if (world == NULL)
+    {
+        game_destroy();
+        BenchPrintf("shard: FAILED to start workers\n");
+        return 1;
+    }
+    double tSingle = 0.0, tSharded = 0.0;
+    int matching = 0, ghosts = 0, migrated = 0;
+    bool failed = false;
+    for (int f = 0; f < kFrames && !failed; ++f)
+    {
+        t0 = TimeNow();
+        int count = game_update(expected.data(), f * kDeltaTime, kDeltaTime);
+        double t1 = TimeNow();
+        int shardCount = shard_world_update(world, sprites.data(), f * kDeltaTime, kDeltaTime);
+        tSingle += t1 - t0;
+        tSharded += TimeNow() - t1;
+        failed = shardCount < 0;
+        if (count == shardCount && memcmp(expected.data(), sprites.data(), count * sizeof(sprites[0])) == 0)
+            matching++;
+        for (int t = 0; t < kTilesX * kTilesY; ++t)
+        {
+            int g, m;
+            shard_world_tile_stats(world, t, NULL, &g, &m);
+            ghosts += g;
+            migrated += m;
+        }
+    }
+    BenchPrintf("shard: %i frames of %i objects, %ix%i tiles (%i worker processes, started in %.1fms)\n", kFrames, config.objectCount,
+        kTilesX, kTilesY, kTilesX * kTilesY, tCreate * 1000.0);
+    BenchPrintf("  single process %.2fms/frame, sharded %.2fms/frame\n", tSingle * 1000.0 / kFrames, tSharded * 1000.0 / kFrames);
+    BenchPrintf("  per tile and frame: %.1f ghosts, %.1f objects migrated out\n", (double)ghosts / kFrames / (kTilesX * kTilesY), (double)migrated / kFrames / (kTilesX * kTilesY));
+    for (int t = 0; t < kTilesX * kTilesY; ++t)
+    {
+        int owned;
+        shard_world_tile_stats(world, t, &owned, NULL, NULL);
+        BenchPrintf("  tile %i: %i objects\n", t, owned);
+    }
+    BenchPrintf("  %i/%i frames match single process%s\n", matching, kFrames, failed ? ", WORKERS FAILED" : "");
+    shard_world_destroy(world);
+    game_destroy();
+    return !failed && matching == kFrames ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Copies of the move & avoidance systems with object data in different memory layouts (layouts.h);
+// time per object of each system, and the result should exactly match the regular game.
+
+template<typename Layout>
+static bool BenchLayout(const std::vector<sprite_data_t>& expected, int frames, float deltaTime)
+{
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    LayoutWorld<Layout> world;
+    if (!world.Initialize(GetGameEntities(), GetGameMoveSystem(), GetGameAvoidanceSystem()))
+    {
+        BenchPrintf("  %-10s game state does not fit\n", Layout::Name());
+        return false;
+    }
+    double tMove = 0, tAvoid = 0, tWrite = 0;
+    int count = 0;
+    for (int f = 0; f < frames; ++f)
+    {
+        double t0 = TimeNow();
+        world.UpdateMove(deltaTime);
+        double t1 = TimeNow();
+        world.UpdateAvoidance(deltaTime);
+        double t2 = TimeNow();
+        count = world.WriteSprites(sprites.data());
+        double t3 = TimeNow();
+        tMove += t1 - t0;
+        tAvoid += t2 - t1;
+        tWrite += t3 - t2;
+    }
+    bool match = count == (int)expected.size() && memcmp(sprites.data(), expected.data(), count * sizeof(sprites[0])) == 0;
+    double scale = 1.0e9 / ((double)frames * world.objects.size());
+    BenchPrintf("  %-10s move %5.2f  avoid %6.2f  write %5.2f  total %6.2f ns/object%s\n", Layout::Name(),
+        tMove * scale, tAvoid * scale, tWrite * scale, (tMove + tAvoid + tWrite) * scale,
+        match ? "" : ", MISMATCH");
+    return match;
+}
+
+static int BenchLayouts()
+{
+    const int kFrames = 20;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    // reference result from the regular game; layouts start from the same initial state
+    std::vector<sprite_data_t> expected(kMaxSpriteCount);
+    game_initialize(NULL);
+    Entities initial = GetGameEntities();
+    int count = 0;
+    double t0 = TimeNow();
+    for (int f = 0; f < kFrames; ++f)
+        count = game_update(expected.data(), f * kDeltaTime, kDeltaTime);
+    double tGame = TimeNow() - t0;
+    expected.resize(count);
+    GetGameEntities() = initial;
+
+    BenchPrintf("layouts: %i frames of %i objects\n", kFrames, count);
+    // the whole game update with its own avoidance broadphase; not comparable to the layouts
+    BenchPrintf("  %-10s %.2f ns/object (whole game update, for reference)\n", "game", tGame * 1.0e9 / ((double)kFrames * count));
+    bool ok = true;
+    ok &= BenchLayout<LayoutAoS>(expected, kFrames, kDeltaTime);
+    ok &= BenchLayout<LayoutSoA>(expected, kFrames, kDeltaTime);
+    ok &= BenchLayout<LayoutAoSoA<4>>(expected, kFrames, kDeltaTime);
+    ok &= BenchLayout<LayoutAoSoA<8>>(expected, kFrames, kDeltaTime);
+    ok &= BenchLayout<LayoutAoSoA<16>>(expected, kFrames, kDeltaTime);
+    game_destroy();
+    return ok ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// All the implementation variants of the game (OOP, ECS, DOD) on the same config: initialization
+// and update times. ECS should produce exactly the same result as DOD; OOP updates objects one by
+// one and slightly differs, so its difference is just reported.
+
+static int BenchVariants()
+{
+    const int kFrames = 10;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    std::vector<sprite_data_t> expected;
+    game_config_t config;
+    game_default_config(&config);
+    BenchPrintf("variants: %i frames of %i objects\n", kFrames, config.objectCount + config.avoidCount);
+    bool ok = true;
+    const game_variant_t kOrder[] = { GAME_VARIANT_OOP, GAME_VARIANT_ECS, GAME_VARIANT_DOD };
+    double tFirst = 0;
+    for (game_variant_t variant : kOrder)
+    {
+        config.variant = variant;
+        double t0 = TimeNow();
+        game_initialize(&config);
+        double tInit = TimeNow() - t0;
+        int count = 0;
+        t0 = TimeNow();
+        for (int f = 0; f < kFrames; ++f)
+            count = game_update(sprites.data(), f * kDeltaTime, kDeltaTime);
+        double tUpdate = (TimeNow() - t0) / kFrames;
+        t0 = TimeNow();
+        game_destroy();
+        double tDestroy = TimeNow() - t0;
+        if (tFirst == 0)
+            tFirst = tUpdate;
+        BenchPrintf("  %s: initialize %.1fms, update %.2fms/frame (%.1fx), destroy %.1fms\n", game_variant_name(variant),
+            tInit * 1000.0, tUpdate * 1000.0, tFirst / tUpdate, tDestroy * 1000.0);
+
+        if (variant == GAME_VARIANT_OOP)
+            expected.assign(sprites.begin(), sprites.begin() + count);
+        else
+        {
+            // compare against the OOP result, and the DOD one against ECS
+            float maxDiff = 0.0f;
+            for (int i = 0; i < count && i < (int)expected.size(); ++i)
+            {
+                maxDiff = fmaxf(maxDiff, fabsf(sprites[i].posX - expected[i].posX));
+                maxDiff = fmaxf(maxDiff, fabsf(sprites[i].posY - expected[i].posY));
+            }
+            bool same = count == (int)expected.size() && memcmp(sprites.data(), expected.data(), count * sizeof(sprites[0])) == 0;
+            if (variant == GAME_VARIANT_ECS)
+                BenchPrintf("    max position difference from oop: %g\n", maxDiff);
+            else
+            {
+                BenchPrintf("    %s\n", same ? "matches ecs exactly" : "DOES NOT MATCH ecs");
+                ok &= same;
+            }
+            expected.assign(sprites.begin(), sprites.begin() + count);
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Roofline-style memory bandwidth report: achievable single thread read/write/copy bandwidth of
+// this machine (STREAM-like loops over arrays much larger than caches), then bytes each game
+// system touches per frame, the bandwidth it achieves, and how close that is to the peak. Systems
+// close to the peak can only get faster by touching less data; ones far below it are limited by
+// computation (or latency) instead.
+
+// Best time of a few runs of func.
+template<typename F> static double BestTime(int runs, F func)
+{
+    double best = 1.0e30;
+    for (int r = 0; r < runs; ++r)
+    {
+        double t0 = TimeNow();
+        func();
+        best = std::min(best, TimeNow() - t0);
+    }
+    return best;
+}
+
+static int BenchBandwidth()
+{
+    const size_t kArraySize = 128 * 1024 * 1024;
+    const int kRuns = 5;
+    const int kFrames = 20;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    // loops use 64 bit integers and do a little bit of work per element, so that they are not
+    // turned into memset/memcpy calls (those might use non-temporal stores that regular code does not)
+    size_t n = kArraySize / sizeof(uint64_t);
+    std::vector<uint64_t> a(n, 1), b(n, 2);
+    volatile uint64_t sink = 0;
+    double tRead = BestTime(kRuns, [&]()
+    {
+        uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+        for (size_t i = 0; i < n; i += 4)
+        {
+            s0 += a[i + 0];
+            s1 += a[i + 1];
+            s2 += a[i + 2];
+            s3 += a[i + 3];
+        }
+        sink = s0 + s1 + s2 + s3;
+    });
+    double tWrite = BestTime(kRuns, [&]()
+    {
+        for (size_t i = 0; i < n; ++i)
+            b[i] = i;
+    });
+    double tCopy = BestTime(kRuns, [&]()
+    {
+        for (size_t i = 0; i < n; ++i)
+            b[i] = a[i] ^ i;
+    });
+    (void)sink;
+    std::vector<uint64_t>().swap(a);
+    std::vector<uint64_t>().swap(b);
+    double bwRead = kArraySize / tRead * 1.0e-9;
+    double bwWrite = kArraySize / tWrite * 1.0e-9;
+    double bwCopy = 2 * kArraySize / tCopy * 1.0e-9;
+    BenchPrintf("bandwidth: single thread, %iMB arrays\n", (int)(kArraySize >> 20));
+    BenchPrintf("  peak: read %.1f GB/s, write %.1f GB/s, copy %.1f GB/s (read+written)\n", bwRead, bwWrite, bwCopy);
+
+    // systems of the game, timed one by one
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    game_initialize(NULL);
+    Entities& objects = GetGameEntities();
+    MoveSystem& move = GetGameMoveSystem();
+    AvoidanceSystem& avoidance = GetGameAvoidanceSystem();
+    double tMove = 0, tAvoid = 0, tOutput = 0;
+    int spriteCount = 0;
+    for (int f = 0; f < kFrames; ++f)
+    {
+        double t0 = TimeNow();
+        move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+        double t1 = TimeNow();
+        avoidance.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+        double t2 = TimeNow();
+        spriteCount = WriteAllSpriteData(objects, sprites.data());
+        double t3 = TimeNow();
+        tMove += t1 - t0;
+        tAvoid += t2 - t1;
+        tOutput += t3 - t2;
+    }
+
+    // bytes read & written per frame: movers read position & velocity and write position (velocity
+    // only when bouncing); avoiders read position (things to avoid stay in cache; collisions are
+    // rare); sprite output reads flags of everything, position & sprite of drawn objects, and
+    // writes sprite data
+    struct Row { const char* name; double read, written, time; };
+    const Row rows[] =
+    {
+        { "move", (double)move.entities.size() * (sizeof(PositionComponent) + sizeof(MoveComponent)), (double)move.entities.size() * sizeof(PositionComponent), tMove / kFrames },
+        { "avoidance", (double)avoidance.objectList.size() * sizeof(PositionComponent), 0.0, tAvoid / kFrames },
+        { "sprite output", (double)objects.m_Flags.size() * sizeof(objects.m_Flags[0]) + (double)spriteCount * (sizeof(PositionComponent) + sizeof(SpriteComponent)),
+            (double)spriteCount * sizeof(sprite_data_t), tOutput / kFrames },
+    };
+    game_destroy();
+
+    BenchPrintf("  %-14s %9s %9s %9s %8s %10s\n", "system", "MB read", "MB write", "ms/frame", "GB/s", "% of peak");
+    for (const Row& r : rows)
+    {
+        double bytes = r.read + r.written;
+        double bw = bytes / r.time * 1.0e-9;
+        double peak = r.written == 0.0 ? bwRead : bwCopy;
+        double percent = bw / peak * 100.0;
+        BenchPrintf("  %-14s %9.1f %9.1f %9.2f %8.1f %9.0f%%  %s\n", r.name, r.read / 1.0e6, r.written / 1.0e6, r.time * 1000.0, bw, percent,
+            percent >= 50.0 ? "(bandwidth bound)" : "(compute/latency bound)");
+    }
+    return 0;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Calibration of parallel settings for the game systems (without saving them), and a check that
+// running systems in parallel gives exactly the same result as running them serially.
+
+static int BenchTune()
+{
+    const int kFrames = 10;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    BenchPrintf("tune: ");
+    tuning_calibrate(NULL, 1);
+    ParallelSettings tunedMove = GetGameMoveParallel(), tunedAvoidance = GetGameAvoidanceParallel();
+
+    // serial, then on several threads with small chunks
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    ParallelSettings serial, threaded;
+    threaded.chunkSize = 1000;
+    threaded.threadCount = 4;
+    int counts[2] = {};
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        GetGameMoveParallel() = GetGameAvoidanceParallel() = pass == 0 ? serial : threaded;
+        game_initialize(NULL);
+        for (int f = 0; f < kFrames; ++f)
+            counts[pass] = game_update(pass == 0 ? expected.data() : sprites.data(), f * kDeltaTime, kDeltaTime);
+        game_destroy();
+    }
+    GetGameMoveParallel() = tunedMove;
+    GetGameAvoidanceParallel() = tunedAvoidance;
+    bool match = counts[0] == counts[1] && memcmp(expected.data(), sprites.data(), counts[0] * sizeof(sprites[0])) == 0;
+    BenchPrintf("  %i threads result %s serial one\n", threaded.threadCount, match ? "matches" : "DOES NOT MATCH");
+    return match ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// NUMA topology, and the game with systems running in NUMA mode (pinned threads, data placed on
+// the node that processes it) vs serially; results should be the same.
+
+static int BenchNuma()
+{
+    const int kFrames = 10;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    const std::vector<std::vector<int>>& nodes = NumaNodeCpus();
+    BenchPrintf("numa: %i node(s):", (int)nodes.size());
+    for (const std::vector<int>& cpus : nodes)
+        BenchPrintf(" %i", (int)cpus.size());
+    BenchPrintf(" CPUs\n");
+
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    ParallelSettings savedMove = GetGameMoveParallel(), savedAvoidance = GetGameAvoidanceParallel();
+    ParallelSettings numa;
+    numa.threadCount = std::max(ParallelMaxThreads(), 2);
+    numa.numa = true;
+    int counts[2] = {};
+    double times[2] = {};
+    bool placed = false;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        GetGameMoveParallel() = GetGameAvoidanceParallel() = pass == 0 ? ParallelSettings() : numa;
+        game_initialize(NULL);
+        if (pass == 1)
+            placed = NumaPlaceComponents(GetGameEntities(), GetGameMoveSystem().entities, numa);
+        double t0 = TimeNow();
+        for (int f = 0; f < kFrames; ++f)
+            counts[pass] = game_update(pass == 0 ? expected.data() : sprites.data(), f * kDeltaTime, kDeltaTime);
+        times[pass] = (TimeNow() - t0) / kFrames;
+        game_destroy();
+    }
+    GetGameMoveParallel() = savedMove;
+    GetGameAvoidanceParallel() = savedAvoidance;
+    bool match = counts[0] == counts[1] && memcmp(expected.data(), sprites.data(), counts[0] * sizeof(sprites[0])) == 0;
+    BenchPrintf("  memory placement on nodes: %s\n", placed ? "ok" : "not supported");
+    BenchPrintf("  serial %.2fms/frame, numa mode with %i threads %.2fms/frame\n", times[0] * 1000.0, numa.threadCount, times[1] * 1000.0);
+    BenchPrintf("  result %s serial one\n", match ? "matches" : "DOES NOT MATCH");
+    return match ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Time budgeted avoidance: cost of avoidance per frame with a few budgets, how stale the checked
+// slices are, and the result should match checking everything every frame. Also with things to
+// avoid that bounce off each other (which pushes them, on top of their moves), and with trails of
+// particles (entity count changes every frame, which must not restart checking everything).
+
+static int BenchAvoidanceBudget()
+{
+    const int kFrames = 120;
+    const float kDeltaTime = 1.0f / 60.0f;
+    const float kBudgets[] = { 0.0f, 8.0f, 2.0f, 0.5f };
+    struct Scene
+    {
+        const char* name;
+        int objectCount, avoidCount, avoidersRepel; // (zero counts: default ones)
+        float trailRate;
+    };
+    const Scene kScenes[] = {
+        { "default", 0, 0, 0, 0.0f },
+        { "100K objects, 200 things to avoid bouncing off each other", 100000, 200, 1, 0.0f },
+        { "trails of particles", 0, 0, 0, 500.0f },
+    };
+
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    int expectedCount = 0;
+    BenchPrintf("avoidbudget: %i frames\n", kFrames);
+    bool ok = true;
+    for (const Scene& scene : kScenes)
+    {
+        game_config_t config;
+        game_default_config(&config);
+        if (scene.objectCount > 0)
+            config.objectCount = scene.objectCount;
+        if (scene.avoidCount > 0)
+            config.avoidCount = scene.avoidCount;
+        config.avoidersRepel = scene.avoidersRepel;
+        config.trailRate = scene.trailRate;
+        BenchPrintf("  %s:\n", scene.name);
+        for (float budget : kBudgets)
+        {
+            game_initialize(&config);
+            Entities& objects = GetGameEntities();
+            MoveSystem& move = GetGameMoveSystem();
+            AvoiderRepulsionSystem& repulsion = GetGameAvoiderRepulsionSystem();
+            AvoidanceSystem& avoidance = GetGameAvoidanceSystem();
+            avoidance.timeBudget = budget * 0.001;
+            double tAvoid = 0, tMax = 0;
+            size_t dueCount = 0, sliceCount = 0, late = 0;
+            int maxStale = 0, rotationFrames = 0, restarts = 0;
+            int count = 0;
+            for (int f = 0; f < kFrames; ++f)
+            {
+                move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                repulsion.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                avoidance.extraTravel = repulsion.MaxPush();
+                double t0 = TimeNow();
+                avoidance.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                double t = TimeNow() - t0;
+                GetGameLifetimeSystem().UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                GetGameSpawnerSystem().UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                count = WriteAllSpriteData(objects, budget == 0.0f ? expected.data() : sprites.data());
+                if (budget == 0.0f)
+                    expectedCount = count;
+                // the first frame checks everything to get started
+                if (f == 0)
+                    continue;
+                tAvoid += t;
+                tMax = std::max(tMax, t);
+                const AvoidanceBudgetStats& stats = avoidance.budgetStats;
+                dueCount += stats.dueCount;
+                sliceCount += stats.sliceCount;
+                restarts += stats.dueCount == avoidance.objectList.size();
+                late += stats.lateCount;
+                maxStale = std::max(maxStale, stats.sliceMaxStale);
+                rotationFrames = stats.rotationFrames;
+            }
+            game_destroy();
+            if (budget == 0.0f)
+            {
+                BenchPrintf("    no budget: avoidance %.2fms/frame (max %.2fms)\n", tAvoid * 1000.0 / (kFrames - 1), tMax * 1000.0);
+                continue;
+            }
+            bool match = count == expectedCount && memcmp(expected.data(), sprites.data(), count * sizeof(sprites[0])) == 0;
+            BenchPrintf("    budget %.1fms: avoidance %.2fms/frame (max %.2fms), %i due + %i slice objects/frame\n", budget,
+                tAvoid * 1000.0 / (kFrames - 1), tMax * 1000.0, (int)(dueCount / (kFrames - 1)), (int)(sliceCount / (kFrames - 1)));
+            if (rotationFrames > 0)
+                BenchPrintf("      full rotation in %i frames, ", rotationFrames);
+            else
+                BenchPrintf("      no full rotation, ");
+            BenchPrintf("slices up to %i frames stale, %i late checks, %i restarts, %s\n", maxStale, (int)late, restarts, match ? "result matches" : "RESULT DIFFERS");
+            ok &= (match || late != 0) && restarts == 0;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Spatial grid kept up to date by the move system (only relinking objects that crossed into
+// another cell), vs rebuilding it from scratch every frame, vs building a cell index with a
+// parallel counting sort; checks that all of them end up the same.
+static int BenchSpatialGrid()
+{
+    const int kFrames = 120;
+    const float kDeltaTime = 1.0f / 60.0f;
+    const float kCellSizes[] = { 1.0f, 4.0f };
+
+    BenchPrintf("grid: %i frames\n", kFrames);
+    bool ok = true;
+    double tMoveOnly = 0;
+    {
+        game_initialize(NULL);
+        Entities& objects = GetGameEntities();
+        MoveSystem& move = GetGameMoveSystem();
+        move.grid = SpatialGrid();
+        for (int f = 0; f < kFrames; ++f)
+        {
+            double t0 = TimeNow();
+            move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+            tMoveOnly += TimeNow() - t0;
+        }
+        game_destroy();
+        BenchPrintf("  move without grid: %.2fms/frame\n", tMoveOnly * 1000.0 / kFrames);
+    }
+    for (float cellSize : kCellSizes)
+    {
+        game_initialize(NULL);
+        Entities& objects = GetGameEntities();
+        MoveSystem& move = GetGameMoveSystem();
+        move.grid.Initialize(objects.m_WorldBounds[move.boundsID], cellSize);
+        SpatialGrid rebuilt = move.grid;
+        double tMove = 0, tRebuild = 0;
+        size_t moveCount = 0;
+        for (int f = 0; f < kFrames; ++f)
+        {
+            double t0 = TimeNow();
+            move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+            double t1 = TimeNow();
+            rebuilt.Rebuild(objects.m_Positions, move.entities);
+            double t2 = TimeNow();
+            // the first frame adds everything to the grid
+            if (f == 0)
+            {
+                moveCount = move.grid.MoveCount();
+                continue;
+            }
+            tMove += t1 - t0;
+            tRebuild += t2 - t1;
+        }
+        moveCount = move.grid.MoveCount() - moveCount;
+
+        // same cell for every object, and the same objects in every cell
+        bool match = true;
+        move.entities.ForEach([&](EntityID id)
+        {
+            const PositionComponent& pos = objects.m_Positions[id];
+            match &= move.grid.EntityCell(id) == move.grid.CellOf(pos.x, pos.y) && rebuilt.EntityCell(id) == move.grid.EntityCell(id);
+        });
+        std::vector<EntityID> a, b;
+        for (int cell = 0; cell < move.grid.CellCount() && match; ++cell)
+        {
+            move.grid.ForEachInCell(cell, [&](const EntityID* ids, size_t count) { a.assign(ids, ids + count); });
+            rebuilt.ForEachInCell(cell, [&](const EntityID* ids, size_t count) { b.assign(ids, ids + count); });
+            std::sort(a.begin(), a.end());
+            match &= a == b;
+        }
+        int frames = kFrames - 1;
+        BenchPrintf("  cell size %.1f (%ix%i cells, %.0f objects/cell):\n", cellSize, move.grid.Width(), move.grid.Height(),
+            (double)move.grid.size() / move.grid.CellCount());
+        BenchPrintf("    incremental: %.2fms/frame on top of move, %i objects relinked/frame, %i repacks\n",
+            (tMove - tMoveOnly * frames / kFrames) * 1000.0 / frames, (int)(moveCount / frames), (int)move.grid.RepackCount() - 1);
+        BenchPrintf("    full rebuild: %.2fms/frame; %s\n", tRebuild * 1000.0 / frames, match ? "grids match" : "GRIDS DIFFER");
+        ok &= match;
+
+        // counting sort index of the final positions
+        const int kThreadCounts[] = { 1, std::max(4, ParallelMaxThreads()) };
+        for (int threads : kThreadCounts)
+        {
+            ParallelSettings parallel;
+            parallel.threadCount = threads;
+            CellIndex index;
+            index.Build(move.grid.GetCellMap(), objects.m_Positions, move.entities, parallel); // warm up
+            double tBuild = BestTime(10, [&]() { index.Build(move.grid.GetCellMap(), objects.m_Positions, move.entities, parallel); });
+            bool indexMatch = index.size() == move.grid.size();
+            for (int cell = 0; cell < index.CellCount() && indexMatch; ++cell)
+            {
+                move.grid.ForEachInCell(cell, [&](const EntityID* ids, size_t count) { a.assign(ids, ids + count); });
+                index.ForEachInCell(cell, [&](const EntityID* ids, size_t count) { b.assign(ids, ids + count); });
+                std::sort(a.begin(), a.end());
+                indexMatch &= a == b;
+            }
+            BenchPrintf("    counting sort index, %i threads: %.2fms; %s\n", threads, tBuild * 1000.0, indexMatch ? "matches grid" : "DIFFERS FROM GRID");
+            ok &= indexMatch;
+        }
+        game_destroy();
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Separation between all regular objects: time per frame with one and several threads; results
+// have to be the same.
+static int BenchSeparation()
+{
+    const int kFrames = 30;
+    const float kDeltaTime = 1.0f / 60.0f;
+    const float kRadius = 0.2f;
+    const int kThreadCounts[] = { 1, std::max(4, ParallelMaxThreads()) };
+
+    game_config_t config;
+    game_default_config(&config);
+    config.separationRadius = kRadius;
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    BenchPrintf("separation: %i objects, radius %.2f, %i frames\n", config.objectCount, kRadius, kFrames);
+    ParallelSettings prevSettings = GetGameNeighbourParallel();
+    bool ok = true;
+    for (int threads : kThreadCounts)
+    {
+        game_initialize(&config);
+        Entities& objects = GetGameEntities();
+        SeparationSystem& separation = GetGameSeparationSystem();
+        ParallelSettings settings = prevSettings;
+        settings.threadCount = threads;
+        double tSeparation = 0;
+        int count = 0;
+        for (int f = 0; f < kFrames; ++f)
+        {
+            GetGameMoveSystem().UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+            double t0 = TimeNow();
+            separation.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, settings);
+            tSeparation += TimeNow() - t0;
+            GetGameAvoidanceSystem().UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameAvoidanceParallel());
+            count = WriteAllSpriteData(objects, threads == 1 ? expected.data() : sprites.data());
+        }
+        game_destroy();
+        bool match = threads == 1 || memcmp(expected.data(), sprites.data(), count * sizeof(sprites[0])) == 0;
+        BenchPrintf("  %i threads: %.2fms/frame%s\n", threads, tSeparation * 1000.0 / kFrames,
+            threads == 1 ? "" : match ? ", result matches 1 thread" : ", RESULT DIFFERS FROM 1 THREAD");
+        ok &= match;
+    }
+    GetGameNeighbourParallel() = prevSettings;
+    return ok ? 0 : 1;
+}
+
+
+// Things to avoid bouncing off each other, at increasing counts (in a world that grows with them,
+// so that density stays the same): time per frame with the cell index, vs checking all pairs
+// (up to a point); results of one update have to be the same with both, and bouncing must not
+// make anything faster than it was at the start.
+static void InitAvoiderWorld(int count, Entities& objects, MoveSystem& move, AvoiderRepulsionSystem& repulsion)
+{
+    const float kDensity = 0.2f; // per unit of area
+    srand(1);
+    float width = sqrtf(count / kDensity * 1.6f), height = width / 1.6f;
+    EntityID bounds = objects.AddEntity("bounds");
+    objects.m_WorldBounds[bounds] = WorldBoundsComponent{ -width * 0.5f, width * 0.5f, -height * 0.5f, height * 0.5f };
+    move.SetBounds(bounds);
+    repulsion.SetBounds(bounds);
+    for (int i = 0; i < count; ++i)
+    {
+        EntityID go = objects.AddEntity("toavoid");
+        objects.m_Positions[go].x = RandomFloat(-width * 0.5f, width * 0.5f);
+        objects.m_Positions[go].y = RandomFloat(-height * 0.5f, height * 0.5f);
+        objects.m_Moves[go].Initialize(0.1f, 0.2f);
+        move.AddObjectToSystem(go);
+        repulsion.AddObjectToSystem(go, 1.3f);
+    }
+}
+
+static int BenchAvoiders()
+{
+    const int kCounts[] = { 20, 1000, 10000, 100000, 300000 };
+    const int kBruteForceMaxCount = 10000;
+    const int kFrames = 200;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    BenchPrintf("avoiders: %i frames\n", kFrames);
+    bool ok = true;
+    for (int count : kCounts)
+    {
+        Entities objects;
+        MoveSystem move;
+        AvoiderRepulsionSystem repulsion;
+        InitAvoiderWorld(count, objects, move, repulsion);
+        const ParallelSettings& parallel = GetGameNeighbourParallel();
+        auto maxSpeed = [&]()
+        {
+            float maxSq = 0.0f;
+            for (const MoveComponent& m : objects.m_Moves)
+                maxSq = std::max(maxSq, m.velx * m.velx + m.vely * m.vely);
+            return sqrtf(maxSq);
+        };
+        const float startSpeed = maxSpeed();
+        float endSpeed = 0.0f;
+
+        // same update on the same state with both methods
+        bool match = true;
+        if (count <= kBruteForceMaxCount)
+        {
+            Entities copy = objects;
+            AvoiderRepulsionSystem bruteForce = repulsion;
+            bruteForce.bruteForceMaxCount = count;
+            repulsion.bruteForceMaxCount = 0;
+            bruteForce.UpdateSystem(copy, 0.0, kDeltaTime, parallel);
+            repulsion.UpdateSystem(objects, 0.0, kDeltaTime, parallel);
+            match = bruteForce.ContactCount() == repulsion.ContactCount();
+            for (size_t i = 0; i < objects.m_Positions.size(); ++i)
+            {
+                match &= fabsf(objects.m_Positions[i].x - copy.m_Positions[i].x) < 1.0e-4f && fabsf(objects.m_Positions[i].y - copy.m_Positions[i].y) < 1.0e-4f;
+                match &= fabsf(objects.m_Moves[i].velx - copy.m_Moves[i].velx) < 1.0e-4f && fabsf(objects.m_Moves[i].vely - copy.m_Moves[i].vely) < 1.0e-4f;
+            }
+        }
+
+        double tIndex = 0, tBruteForce = 0;
+        size_t contacts = 0;
+        for (int mode = 0; mode < 2; ++mode)
+        {
+            if (mode == 1 && count > kBruteForceMaxCount)
+                break;
+            repulsion.bruteForceMaxCount = mode == 0 ? 0 : count;
+            double& t = mode == 0 ? tIndex : tBruteForce;
+            int frames = mode == 0 ? kFrames : std::min(kFrames, 3);
+            for (int f = 0; f < frames; ++f)
+            {
+                move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime);
+                double t0 = TimeNow();
+                repulsion.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, parallel);
+                t += TimeNow() - t0;
+                if (mode == 0)
+                    contacts += repulsion.ContactCount();
+            }
+            t /= frames;
+            if (mode == 0)
+                endSpeed = maxSpeed();
+        }
+        bool bounded = endSpeed <= startSpeed * 1.001f;
+        BenchPrintf("  %6i avoiders: index %.3fms/frame, %.1f contacts/frame, max speed %.3f (%.3f at start)%s", count, tIndex * 1000.0,
+            (double)contacts / kFrames, endSpeed, startSpeed, bounded ? "" : " GAINED SPEED");
+        if (count <= kBruteForceMaxCount)
+            BenchPrintf("; all pairs %.3fms/frame, %s\n", tBruteForce * 1000.0, match ? "results match" : "RESULTS DIFFER");
+        else
+            BenchPrintf("\n");
+        ok &= match && bounded;
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Avoidance with many things to avoid, with each broadphase: in a scene where they all have the
+// same distance, one with a few huge ones and many small ones, and one where objects & things to
+// avoid are bunched up into a few clusters. Results have to be the same as with brute force.
+struct AvoidanceScene
+{
+    const char* name;
+    int objectCount;
+    int smallCount, largeCount;
+    float smallDistance, largeDistance;
+    int clusterCount; // zero: spread uniformly over world bounds
+};
+
+static PositionComponent RandomScenePosition(const std::vector<PositionComponent>& clusters)
+{
+    if (clusters.empty())
+        return PositionComponent{ RandomFloat(-80.0f, 80.0f), RandomFloat(-50.0f, 50.0f) };
+    // roughly normal distribution (sum of uniform ones) around a random cluster center
+    const PositionComponent& c = clusters[rand() % clusters.size()];
+    float dx = RandomFloat(-1.0f, 1.0f) + RandomFloat(-1.0f, 1.0f) + RandomFloat(-1.0f, 1.0f);
+    float dy = RandomFloat(-1.0f, 1.0f) + RandomFloat(-1.0f, 1.0f) + RandomFloat(-1.0f, 1.0f);
+    return PositionComponent{ std::min(std::max(c.x + dx * 3.0f, -80.0f), 80.0f), std::min(std::max(c.y + dy * 3.0f, -50.0f), 50.0f) };
+}
+
+static void InitAvoidanceScene(const AvoidanceScene& scene, Entities& objects, MoveSystem& move, AvoidanceSystem& avoidance)
+{
+    srand(1);
+    EntityID bounds = objects.AddEntity("bounds");
+    objects.m_WorldBounds[bounds] = WorldBoundsComponent{ -80.0f, 80.0f, -50.0f, 50.0f };
+    move.SetBounds(bounds);
+    avoidance.SetBounds(bounds);
+    std::vector<PositionComponent> clusters;
+    for (int i = 0; i < scene.clusterCount; ++i)
+        clusters.push_back(PositionComponent{ RandomFloat(-70.0f, 70.0f), RandomFloat(-40.0f, 40.0f) });
+    for (int i = 0; i < scene.objectCount; ++i)
+    {
+        EntityID go = objects.AddEntity("object");
+        objects.m_Positions[go] = RandomScenePosition(clusters);
+        objects.m_Sprites[go] = SpriteComponent{ 1.0f, 1.0f, 1.0f, 0, 1.0f };
+        objects.m_Moves[go].Initialize(0.5f, 0.7f);
+        move.AddObjectToSystem(go);
+        avoidance.AddObjectToSystem(go);
+    }
+    for (int i = 0; i < scene.smallCount + scene.largeCount; ++i)
+    {
+        EntityID go = objects.AddEntity("toavoid");
+        objects.m_Positions[go] = RandomScenePosition(clusters);
+        objects.m_Sprites[go] = SpriteComponent{ RandomFloat(0.5f, 1.0f), RandomFloat(0.5f, 1.0f), RandomFloat(0.5f, 1.0f), 5, 2.0f };
+        objects.m_Moves[go].Initialize(0.1f, 0.2f);
+        move.AddObjectToSystem(go);
+        avoidance.AddAvoidThisObjectToSystem(go, i < scene.largeCount ? scene.largeDistance : scene.smallDistance);
+    }
+    for (size_t i = 0; i < objects.m_Flags.size(); ++i)
+        objects.m_Flags[i] = i == bounds ? Entities::kFlagWorldBounds : Entities::kFlagPosition | Entities::kFlagSprite | Entities::kFlagMove;
+}
+
+static int BenchAvoidanceBroadphase()
+{
+    const AvoidanceScene kScenes[] =
+    {
+        { "uniform", 200000, 2000, 0, 1.3f, 0.0f, 0 },
+        { "varied radii", 200000, 2000, 10, 0.3f, 15.0f, 0 },
+        { "clustered", 200000, 2000, 0, 0.3f, 0.0f, 8 },
+    };
+    const AvoidanceSystem::Broadphase kBroadphases[] =
+    {
+        AvoidanceSystem::kBroadphaseBruteForce, AvoidanceSystem::kBroadphaseGrid, AvoidanceSystem::kBroadphaseBVH, AvoidanceSystem::kBroadphaseSweep
+    };
+    const int kFrames = 5;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    std::vector<sprite_data_t> expected(kMaxSpriteCount), sprites(kMaxSpriteCount);
+    BenchPrintf("broadphase: %i frames\n", kFrames);
+    bool ok = true;
+    for (const AvoidanceScene& scene : kScenes)
+    {
+        for (AvoidanceSystem::Broadphase broadphase : kBroadphases)
+        {
+            Entities objects;
+            MoveSystem move;
+            AvoidanceSystem avoidance;
+            InitAvoidanceScene(scene, objects, move, avoidance);
+            if (broadphase == kBroadphases[0])
+            {
+                BenchPrintf("  %s: %i objects, %i things to avoid (auto picks %s)\n", scene.name, scene.objectCount, scene.smallCount + scene.largeCount,
+                    AvoidanceSystem::BroadphaseName(avoidance.ChooseBroadphase()));
+            }
+            avoidance.broadphase = broadphase;
+            double t = 0;
+            int count = 0;
+            for (int f = 0; f < kFrames; ++f)
+            {
+                move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+                double t0 = TimeNow();
+                avoidance.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameAvoidanceParallel());
+                t += TimeNow() - t0;
+                count = WriteAllSpriteData(objects, broadphase == AvoidanceSystem::kBroadphaseBruteForce ? expected.data() : sprites.data());
+            }
+            bool match = broadphase == AvoidanceSystem::kBroadphaseBruteForce || memcmp(expected.data(), sprites.data(), count * sizeof(sprites[0])) == 0;
+            BenchPrintf("    %-6s %8.2fms/frame", AvoidanceSystem::BroadphaseName(broadphase), t * 1000.0 / kFrames);
+            if (broadphase == AvoidanceSystem::kBroadphaseBVH)
+                BenchPrintf(", %i rebuilds", (int)avoidance.BVHRebuildCount());
+            BenchPrintf("%s\n", broadphase == AvoidanceSystem::kBroadphaseBruteForce ? "" : match ? ", result matches brute force" : ", RESULT DIFFERS FROM BRUTE FORCE");
+            ok &= match;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Sprite animation of millions of objects, four at a time with SIMD vs one at a time; sprite
+// indices have to end up the same.
+static int BenchAnimation()
+{
+    const int kObjectCounts[] = { 1000000, 4000000 };
+    const int kFrames = 60;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    BenchPrintf("animation: %i frames\n", kFrames);
+    bool ok = true;
+    for (int objectCount : kObjectCounts)
+    {
+        Entities objects;
+        objects.reserve(objectCount);
+        AnimationSystem animation;
+        srand(1);
+        for (int i = 0; i < objectCount; ++i)
+        {
+            EntityID go = objects.AddEntity("object");
+            objects.m_Sprites[go] = SpriteComponent{ 1.0f, 1.0f, 1.0f, 0, 1.0f };
+            objects.m_Animations[go] = AnimationComponent{ RandomFloat(2.0f, 6.0f), RandomFloat(0.0f, 5.0f), 0, 5 };
+            objects.m_Flags[go] = Entities::kFlagPosition | Entities::kFlagSprite | Entities::kFlagAnimation;
+            animation.AddObjectToSystem(go);
+        }
+        BenchPrintf("  %i objects\n", objectCount);
+        std::vector<int> expected(objectCount);
+        for (bool vectorized : { false, true })
+        {
+            AnimationSystem system = animation;
+            system.vectorized = vectorized;
+            double t = 0;
+            size_t changed = 0;
+            for (int f = 0; f < kFrames; ++f)
+            {
+                double t0 = TimeNow();
+                system.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+                t += TimeNow() - t0;
+                if (f > 0)
+                    changed += system.ChangedCount();
+            }
+            bool match = true;
+            for (int i = 0; i < objectCount; ++i)
+            {
+                if (!vectorized)
+                    expected[i] = objects.m_Sprites[i].spriteIndex;
+                match &= expected[i] == objects.m_Sprites[i].spriteIndex;
+            }
+            BenchPrintf("    %-6s %6.2fms/frame, %4.1f%% of sprites changed per frame%s\n", vectorized ? "simd" : "scalar", t * 1000.0 / kFrames,
+                changed * 100.0 / ((kFrames - 1) * (double)objectCount), !vectorized ? "" : match ? ", result matches scalar" : ", RESULT DIFFERS FROM SCALAR");
+            ok &= match;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Fading tints back to base color in a world of a million objects, with more and more of them
+// tinted every frame: time per frame with SIMD & one at a time (results have to be the same), vs
+// fading the colors of all objects.
+static int BenchColorDecay()
+{
+    const int kObjectCount = 1000000;
+    const int kTintedPerFrame[] = { 1000, 10000, 100000 };
+    const int kFrames = 60;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    Entities objects;
+    objects.reserve(kObjectCount);
+    for (int i = 0; i < kObjectCount; ++i)
+    {
+        EntityID go = objects.AddEntity("object");
+        objects.m_Sprites[go] = SpriteComponent{ 1.0f, 1.0f, 1.0f, 0, 1.0f };
+        objects.m_Flags[go] = Entities::kFlagSprite;
+    }
+    const std::vector<SpriteComponent> initialSprites = objects.m_Sprites;
+
+    // fading all of them, without keeping track of which ones are tinted
+    double tAll = BestTime(5, [&]()
+    {
+        const float keep = exp2f(-kDeltaTime / 0.5f);
+        for (SpriteComponent& s : objects.m_Sprites)
+        {
+            s.colorR = 1.0f + (s.colorR - 1.0f) * keep;
+            s.colorG = 1.0f + (s.colorG - 1.0f) * keep;
+            s.colorB = 1.0f + (s.colorB - 1.0f) * keep;
+        }
+    });
+    BenchPrintf("colordecay: %i objects, %i frames; fading all of them takes %.2fms/frame\n", kObjectCount, kFrames, tAll * 1000.0);
+
+    bool ok = true;
+    std::vector<SpriteComponent> expected;
+    for (int tintedPerFrame : kTintedPerFrame)
+    {
+        BenchPrintf("  %i tinted per frame\n", tintedPerFrame);
+        for (bool vectorized : { false, true })
+        {
+            objects.m_Sprites = initialSprites;
+            ColorDecaySystem decay;
+            decay.vectorized = vectorized;
+            for (int i = 0; i < kObjectCount; ++i)
+                decay.AddObjectToSystem(objects, i);
+            srand(1);
+            double t = 0;
+            size_t active = 0;
+            for (int f = 0; f < kFrames; ++f)
+            {
+                for (int i = 0; i < tintedPerFrame; ++i)
+                {
+                    EntityID go = (EntityID)(((unsigned)rand() * (RAND_MAX + 1u) + (unsigned)rand()) % kObjectCount);
+                    objects.m_Sprites[go].colorR = RandomFloat(0.5f, 1.0f);
+                    objects.m_Sprites[go].colorG = RandomFloat(0.5f, 1.0f);
+                    objects.m_Sprites[go].colorB = RandomFloat(0.5f, 1.0f);
+                    decay.tintedObjects.Set(go);
+                }
+                double t0 = TimeNow();
+                decay.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+                t += TimeNow() - t0;
+                active += decay.ActiveCount();
+            }
+            bool match = true;
+            if (!vectorized)
+                expected = objects.m_Sprites;
+            else
+                match = memcmp(expected.data(), objects.m_Sprites.data(), expected.size() * sizeof(expected[0])) == 0;
+            BenchPrintf("    %-6s %6.2fms/frame, %zu fading on average%s\n", vectorized ? "simd" : "scalar", t * 1000.0 / kFrames, active / kFrames,
+                !vectorized ? "" : match ? ", result matches scalar" : ", RESULT DIFFERS FROM SCALAR");
+            ok &= match;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Particles: emitters spawning hundreds of thousands of them per second, each living for a second;
+// time per frame of spawning & despawning. Once the pool is warmed up, component arrays must not
+// get reallocated (the pool never grows past what was reserved).
+static int BenchSpawn()
+{
+    const int kEmitterCount = 1000;
+    const float kRates[] = { 100.0f, 500.0f };
+    const int kFrames = 180; // first 60 frames fill up the pool, rest are steady state
+    const int kWarmupFrames = 60;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    BenchPrintf("spawn: %i emitters, particles live 1 second, %i frames\n", kEmitterCount, kFrames);
+    bool ok = true;
+    for (float rate : kRates)
+    {
+        Entities objects;
+        SpawnerSystem spawner;
+        LifetimeSystem lifetime;
+        srand(1);
+        for (int i = 0; i < kEmitterCount; ++i)
+        {
+            EntityID go = objects.AddEntity("emitter");
+            objects.m_Positions[go] = PositionComponent{ RandomFloat(-80.0f, 80.0f), RandomFloat(-50.0f, 50.0f) };
+            objects.m_Sprites[go] = SpriteComponent{ RandomFloat(0.5f, 1.0f), RandomFloat(0.5f, 1.0f), RandomFloat(0.5f, 1.0f), 5, 2.0f };
+            objects.m_Emitters[go] = EmitterComponent{ rate, 0.3f, 1.0f, 0.0f, 2463534242u + (uint32_t)go };
+            objects.m_Flags[go] = Entities::kFlagPosition | Entities::kFlagSprite | Entities::kFlagEmitter;
+            spawner.AddObjectToSystem(go);
+        }
+        objects.ReservePool((size_t)(kEmitterCount * rate * 1.1f));
+
+        double tSpawn = 0, tLifetime = 0;
+        size_t spawned = 0, despawned = 0, dropped = 0;
+        const void* data = nullptr;
+        bool reallocated = false;
+        for (int f = 0; f < kFrames; ++f)
+        {
+            double t0 = TimeNow();
+            lifetime.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+            double t1 = TimeNow();
+            spawner.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+            double t2 = TimeNow();
+            if (f < kWarmupFrames)
+            {
+                data = objects.m_Positions.data();
+                continue;
+            }
+            tLifetime += t1 - t0;
+            tSpawn += t2 - t1;
+            spawned += spawner.SpawnCount();
+            despawned += lifetime.DespawnCount();
+            dropped += spawner.DropCount();
+            reallocated |= objects.m_Positions.data() != data;
+        }
+        const int steadyFrames = kFrames - kWarmupFrames;
+        BenchPrintf("  %.0f/s each: %zu particles; %.0fK spawned & %.0fK despawned per second, %zu dropped\n", rate, objects.PoolSize(),
+            spawned / (steadyFrames * kDeltaTime) / 1000.0, despawned / (steadyFrames * kDeltaTime) / 1000.0, dropped);
+        BenchPrintf("    spawn %.2fms/frame, lifetime & despawn %.2fms/frame%s\n", tSpawn * 1000.0 / steadyFrames, tLifetime * 1000.0 / steadyFrames,
+            reallocated ? ", COMPONENT ARRAYS GOT REALLOCATED" : ", no reallocations");
+        ok &= !reallocated && dropped == 0;
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Transform hierarchy of a million objects (random trees up to 6 levels deep under a hundred
+// thousand moving roots): level by level propagation on 1 and all threads, vs recursing from each
+// root through lists of children. Positions have to end up the same.
+static int BenchHierarchy()
+{
+    const int kObjectCount = 1000000;
+    const int kRootEvery = 10;
+    const size_t kMaxDepth = 6;
+    const int kFrames = 30;
+    const float kDeltaTime = 1.0f / 60.0f;
+
+    Entities objects;
+    objects.reserve(kObjectCount + 1);
+    MoveSystem move;
+    HierarchySystem hierarchy;
+    std::vector<EntityID> roots;
+    std::vector<PositionComponent> offsets(kObjectCount + 1);
+    std::vector<std::vector<EntityID>> children(kObjectCount + 1);
+    srand(1);
+    EntityID bounds = objects.AddEntity("bounds");
+    objects.m_WorldBounds[bounds] = WorldBoundsComponent{ -80.0f, 80.0f, -50.0f, 50.0f };
+    move.SetBounds(bounds);
+    for (int i = 0; i < kObjectCount; ++i)
+    {
+        EntityID go = objects.AddEntity("object");
+        objects.m_Flags[go] = Entities::kFlagPosition | Entities::kFlagSprite;
+        // children attach to a random earlier object, so objects of all levels are mixed in memory
+        EntityID parent = 1 + (EntityID)(((unsigned)rand() * (RAND_MAX + 1u) + (unsigned)rand()) % go);
+        if (go < 100 || parent == go || rand() % kRootEvery == 0 || hierarchy.DepthOf(parent) + 1 >= kMaxDepth)
+        {
+            objects.m_Positions[go] = PositionComponent{ RandomFloat(-80.0f, 80.0f), RandomFloat(-50.0f, 50.0f) };
+            objects.m_Moves[go].Initialize(0.5f, 0.7f);
+            objects.m_Flags[go] |= Entities::kFlagMove;
+            move.AddObjectToSystem(go);
+            roots.push_back(go);
+            continue;
+        }
+        offsets[go] = PositionComponent{ RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f) };
+        children[parent].push_back(go);
+        hierarchy.AddObjectToSystem(go, parent, offsets[go].x, offsets[go].y);
+    }
+    BenchPrintf("hierarchy: %i objects, %zu roots, %zu levels, %i frames\n", kObjectCount, roots.size(), hierarchy.LevelCount(), kFrames);
+
+    const std::vector<PositionComponent> initialPositions = objects.m_Positions;
+    const std::vector<MoveComponent> initialMoves = objects.m_Moves;
+    std::vector<PositionComponent> expected;
+    bool ok = true;
+    const int kThreadCounts[] = { 0, 1, std::max(4, ParallelMaxThreads()) }; // (0: recursive)
+    for (int threads : kThreadCounts)
+    {
+        objects.m_Positions = initialPositions;
+        objects.m_Moves = initialMoves;
+        ParallelSettings settings;
+        settings.threadCount = std::max(threads, 1);
+        double t = 0;
+        for (int f = 0; f < kFrames; ++f)
+        {
+            move.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+            double t0 = TimeNow();
+            if (threads == 0)
+            {
+                std::vector<EntityID> stack;
+                for (EntityID root : roots)
+                {
+                    stack.push_back(root);
+                    while (!stack.empty())
+                    {
+                        EntityID parent = stack.back();
+                        stack.pop_back();
+                        for (EntityID child : children[parent])
+                        {
+                            objects.m_Positions[child] = PositionComponent{ objects.m_Positions[parent].x + offsets[child].x, objects.m_Positions[parent].y + offsets[child].y };
+                            stack.push_back(child);
+                        }
+                    }
+                }
+            }
+            else
+                hierarchy.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, settings);
+            t += TimeNow() - t0;
+        }
+        bool match = true;
+        if (threads == 0)
+            expected = objects.m_Positions;
+        else
+            match = memcmp(expected.data(), objects.m_Positions.data(), expected.size() * sizeof(expected[0])) == 0;
+        if (threads == 0)
+            BenchPrintf("  recursive        %6.2fms/frame\n", t * 1000.0 / kFrames);
+        else
+            BenchPrintf("  levels, %i thread%s %6.2fms/frame%s\n", threads, threads == 1 ? " " : "s", t * 1000.0 / kFrames,
+                match ? ", result matches recursive" : ", RESULT DIFFERS FROM RECURSIVE");
+        ok &= match;
+    }
+    return ok ? 0 : 1;
+}
+
+
+// Flocking of a million objects: time per frame on 1 and all threads, with SIMD & one neighbour at a
+// time; velocities have to end up the same in all cases.
+static int BenchFlocking()
+{
+    const int kFrames = 10;
+    const float kDeltaTime = 1.0f / 60.0f;
+    const int kThreadCounts[] = { 1, std::max(4, ParallelMaxThreads()) };
+
+    game_config_t config;
+    game_default_config(&config);
+    config.flocking = 1;
+    FlockingSystem defaults;
+    BenchPrintf("flocking: %i objects, radius %.2f, up to %i neighbours, %i frames\n", config.objectCount, defaults.radius, defaults.maxNeighbours, kFrames);
+    std::vector<MoveComponent> expected;
+    bool ok = true;
+    for (int threads : kThreadCounts)
+    {
+        for (bool vectorized : { false, true })
+        {
+            game_initialize(&config);
+            Entities& objects = GetGameEntities();
+            FlockingSystem& flocking = GetGameFlockingSystem();
+            flocking.vectorized = vectorized;
+            ParallelSettings settings = GetGameNeighbourParallel();
+            settings.threadCount = threads;
+            double tFlocking = 0;
+            float neighbours = 0;
+            for (int f = 0; f < kFrames; ++f)
+            {
+                double t0 = TimeNow();
+                flocking.UpdateSystem(objects, f * kDeltaTime, kDeltaTime, settings);
+                tFlocking += TimeNow() - t0;
+                neighbours += flocking.AverageNeighbourCount();
+                GetGameMoveSystem().UpdateSystem(objects, f * kDeltaTime, kDeltaTime, GetGameMoveParallel());
+            }
+            bool first = expected.empty();
+            if (first)
+                expected = objects.m_Moves;
+            bool match = memcmp(expected.data(), objects.m_Moves.data(), expected.size() * sizeof(expected[0])) == 0;
+            game_destroy();
+            BenchPrintf("  %i threads, %-6s %7.2fms/frame, %.1f neighbours per object%s\n", threads, vectorized ? "simd" : "scalar",
+                tFlocking * 1000.0 / kFrames, neighbours / kFrames, first ? "" : match ? ", result matches" : ", RESULT DIFFERS");
+            ok &= match;
+        }
+    }
+    return ok ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+
+struct Benchmark
+{
+    const char* name;
+    int (*func)();
+};
+
+static const Benchmark kBenchmarks[] =
+{
+    { "multiworld", BenchMultiWorld },
+    { "replay", BenchReplay },
+    { "stream", BenchStream },
+    { "shm", BenchSharedExport },
+    { "spritestream", BenchSpriteStream },
+    { "shard", BenchShard },
+    { "layouts", BenchLayouts },
+    { "variants", BenchVariants },
+    { "bandwidth", BenchBandwidth },
+    { "tune", BenchTune },
+    { "numa", BenchNuma },
+    { "avoidbudget", BenchAvoidanceBudget },
+    { "grid", BenchSpatialGrid },
+    { "separation", BenchSeparation },
+    { "avoiders", BenchAvoiders },
+    { "broadphase", BenchAvoidanceBroadphase },
+    { "animation", BenchAnimation },
+    { "colordecay", BenchColorDecay },
+    { "spawn", BenchSpawn },
+    { "hierarchy", BenchHierarchy },
+    { "flock", BenchFlocking },
+};
+
+
+extern "C" int benchmark_run(const char* name)
+{
+    int result = 0;
+    bool found = false;
+    for (const Benchmark& b : kBenchmarks)
+    {
+        if (name != NULL && strcmp(name, b.name) != 0)
+            continue;
+        found = true;
+        result |= b.func();
+    }
+    if (!found)
+    {
+        BenchPrintf("Unknown benchmark '%s', available:", name);
+        for (const Benchmark& b : kBenchmarks)
+            BenchPrintf(" %s", b.name);
+        BenchPrintf("\n");
+        return 1;
+    }
+    return result;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Runs a benchmark by name (or all of them if name is null), printing results.
+// Returns zero on success, to be used as process exit code.
+int benchmark_run(const char* name);
+
+
+#ifdef __cplusplus
+}
+#endif
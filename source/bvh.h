@@ -0,0 +1,160 @@
+#pragma once
+
+// Bounding volume hierarchy (binary tree of axis aligned boxes) over a set of items, e.g. things
+// to avoid of very different sizes, where a uniform grid does not work well.
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+
+struct AABB
+{
+    float xMin, yMin, xMax, yMax;
+
+    bool Overlaps(const AABB& b) const { return xMin <= b.xMax && b.xMin <= xMax && yMin <= b.yMax && b.yMin <= yMax; }
+    bool Contains(float x, float y) const { return xMin <= x && x <= xMax && yMin <= y && y <= yMax; }
+    float Perimeter() const { return 2.0f * ((xMax - xMin) + (yMax - yMin)); }
+    void Add(const AABB& b)
+    {
+        xMin = std::min(xMin, b.xMin);
+        yMin = std::min(yMin, b.yMin);
+        xMax = std::max(xMax, b.xMax);
+        yMax = std::max(yMax, b.yMax);
+    }
+};
+
+
+// Items are indices into the array of boxes given to Build & Refit. The tree is meant to be kept
+// for items that move: each frame it is refit to their new boxes (keeping the structure, so cost
+// is linear and tiny), and only rebuilt when that made it much worse than it was when built (as
+// measured by the total perimeter of node boxes, which is proportional to how likely a random
+// query is to visit them).
+class BVH
+{
+public:
+    void Build(const std::vector<AABB>& boxes)
+    {
+        m_Nodes.clear();
+        m_Items.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); ++i)
+            m_Items[i] = (int)i;
+        if (!boxes.empty())
+            BuildNode(boxes, 0, (int)boxes.size());
+        m_BuildCost = m_Cost = ComputeCost();
+    }
+
+    // Updates node boxes to the new item boxes; returns true if the tree should be rebuilt.
+    bool Refit(const std::vector<AABB>& boxes)
+    {
+        // children always come after their parent, so going backwards updates them first
+        for (size_t n = m_Nodes.size(); n-- > 0; )
+        {
+            Node& node = m_Nodes[n];
+            if (node.count > 0)
+            {
+                node.box = boxes[m_Items[node.first]];
+                for (int i = 1; i < node.count; ++i)
+                    node.box.Add(boxes[m_Items[node.first + i]]);
+            }
+            else
+            {
+                node.box = m_Nodes[n + 1].box;
+                node.box.Add(m_Nodes[node.first].box);
+            }
+        }
+        m_Cost = ComputeCost();
+        return m_Cost > m_BuildCost * kRebuildCostRatio;
+    }
+
+    bool empty() const { return m_Nodes.empty(); }
+    size_t NodeCount() const { return m_Nodes.size(); }
+    // total perimeter of node boxes now, relative to when the tree was built
+    float CostRatio() const { return m_BuildCost > 0.0f ? m_Cost / m_BuildCost : 1.0f; }
+
+    // Calls func(item) for all items whose boxes overlap the box.
+    template<typename F> void Query(const AABB& box, F func) const
+    {
+        if (m_Nodes.empty())
+            return;
+        int stack[64];
+        int depth = 0;
+        stack[depth++] = 0;
+        while (depth > 0)
+        {
+            const Node& node = m_Nodes[stack[--depth]];
+            if (!node.box.Overlaps(box))
+                continue;
+            if (node.count > 0)
+            {
+                for (int i = 0; i < node.count; ++i)
+                    func(m_Items[node.first + i]);
+            }
+            else
+            {
+                stack[depth++] = node.first;
+                stack[depth++] = (int)(&node - m_Nodes.data()) + 1;
+            }
+        }
+    }
+
+private:
+    enum { kMaxLeafItems = 4 };
+    static constexpr float kRebuildCostRatio = 1.5f;
+
+    // Nodes are stored depth first; left child of an internal node is right after it.
+    struct Node
+    {
+        AABB box;
+        int first; // leaf: index of first item in m_Items; internal: index of right child
+        int count; // leaf: number of items; internal: zero
+    };
+
+    // Splits items [begin,end) at the median of box centers along the longer axis of their extent.
+    int BuildNode(const std::vector<AABB>& boxes, int begin, int end)
+    {
+        int index = (int)m_Nodes.size();
+        m_Nodes.push_back(Node());
+        AABB box = boxes[m_Items[begin]];
+        AABB centers = { 1.0e30f, 1.0e30f, -1.0e30f, -1.0e30f };
+        for (int i = begin; i < end; ++i)
+        {
+            const AABB& b = boxes[m_Items[i]];
+            box.Add(b);
+            float cx = (b.xMin + b.xMax) * 0.5f, cy = (b.yMin + b.yMax) * 0.5f;
+            centers.Add(AABB{ cx, cy, cx, cy });
+        }
+        m_Nodes[index].box = box;
+        if (end - begin <= kMaxLeafItems)
+        {
+            m_Nodes[index].first = begin;
+            m_Nodes[index].count = end - begin;
+            return index;
+        }
+        bool splitX = centers.xMax - centers.xMin >= centers.yMax - centers.yMin;
+        int mid = begin + (end - begin) / 2;
+        std::nth_element(m_Items.begin() + begin, m_Items.begin() + mid, m_Items.begin() + end, [&](int a, int b)
+        {
+            const AABB& ba = boxes[a];
+            const AABB& bb = boxes[b];
+            return splitX ? ba.xMin + ba.xMax < bb.xMin + bb.xMax : ba.yMin + ba.yMax < bb.yMin + bb.yMax;
+        });
+        BuildNode(boxes, begin, mid);
+        int right = BuildNode(boxes, mid, end);
+        m_Nodes[index].first = right;
+        m_Nodes[index].count = 0;
+        return index;
+    }
+
+    float ComputeCost() const
+    {
+        float cost = 0.0f;
+        for (const Node& node : m_Nodes)
+            cost += node.box.Perimeter();
+        return cost;
+    }
+
+    std::vector<Node> m_Nodes;
+    std::vector<int> m_Items;
+    float m_BuildCost = 0.0f, m_Cost = 0.0f;
+};
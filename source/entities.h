@@ -0,0 +1,376 @@
+#pragma once
+
+// Components & entity storage of the "game"; shared by game.cpp and tools that need to look at or
+// save/restore the game state (e.g. replay recording).
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+
+static float RandomFloat01() { return (float)rand() / (float)RAND_MAX; }
+static float RandomFloat(float from, float to) { return RandomFloat01() * (to - from) + from; }
+
+
+// -------------------------------------------------------------------------------------------------
+// components we use in our "game". these are all just simple structs with some data.
+
+
+// 2D position: just x,y coordinates
+struct PositionComponent
+{
+    float x, y;
+};
+
+
+// Sprite: color, sprite index (in the sprite atlas), and scale for rendering it
+struct SpriteComponent
+{
+    float colorR, colorG, colorB;
+    int spriteIndex;
+    float scale;
+};
+
+
+// World bounds for our "game" logic: x,y minimum & maximum values
+struct WorldBoundsComponent
+{
+    float xMin, xMax, yMin, yMax;
+};
+
+
+// Move around with constant velocity. When reached world bounds, reflect back from them.
+struct MoveComponent
+{
+    float velx, vely;
+
+    void Initialize(float minSpeed, float maxSpeed)
+    {
+        // random angle
+        float angle = RandomFloat01() * 3.1415926f * 2;
+        // random movement speed between given min & max
+        float speed = RandomFloat(minSpeed, maxSpeed);
+        // velocity x & y components
+        velx = cosf(angle) * speed;
+        vely = sinf(angle) * speed;
+    }
+};
+
+
+// Cycles the sprite index through a range of sprites in the atlas. Frame at a given time is
+// firstFrame + (time * rate + phase) modulo frameCount, so it does not depend on how the game was
+// updated until then.
+struct AnimationComponent
+{
+    float rate; // frames per second; not negative
+    float phase; // frame at time zero; not negative
+    int firstFrame;
+    int frameCount; // at least one
+};
+
+
+// Spawns particles around the object at a given rate; they fly off in random directions and
+// live for a given time.
+struct EmitterComponent
+{
+    float rate; // particles per second
+    float speed;
+    float lifetime; // seconds
+    float accumulator; // fraction of a particle not spawned yet
+    uint32_t random; // state of the random generator for directions of its particles (non-zero)
+};
+
+
+// Entity gets despawned once the remaining time runs out.
+struct LifetimeComponent
+{
+    float remaining; // seconds
+};
+
+
+// -------------------------------------------------------------------------------------------------
+// super simple "game entities system", using struct-of-arrays data layout.
+// we just have an array for each possible component, and a flags array bit bits indicating
+// which components are "present".
+
+// "ID" of a game object is just an index into the scene array.
+typedef size_t EntityID;
+
+struct Entities
+{
+    enum
+    {
+        kFlagPosition = 1<<0,
+        kFlagSprite = 1<<1,
+        kFlagWorldBounds = 1<<2,
+        kFlagMove = 1<<3,
+        kFlagAnimation = 1<<4,
+        kFlagEmitter = 1<<5,
+        kFlagLifetime = 1<<6,
+    };
+
+    // arrays of data; the sizes of all of them are the same. EntityID (just an index)
+    // is used to access data for any "object/entity". The "object" itself is nothing
+    // more than just an index into these arrays.
+    
+    // names of each object
+    std::vector<std::string> m_Names;
+    // data for all components
+    std::vector<PositionComponent> m_Positions;
+    std::vector<SpriteComponent> m_Sprites;
+    std::vector<WorldBoundsComponent> m_WorldBounds;
+    std::vector<MoveComponent> m_Moves;
+    std::vector<AnimationComponent> m_Animations;
+    std::vector<EmitterComponent> m_Emitters;
+    std::vector<LifetimeComponent> m_Lifetimes;
+    // bit flags for every component, indicating whether this object "has it"
+    std::vector<int> m_Flags;
+    
+    void reserve(size_t n)
+    {
+        m_Names.reserve(n);
+        m_Positions.reserve(n);
+        m_Sprites.reserve(n);
+        m_WorldBounds.reserve(n);
+        m_Moves.reserve(n);
+        m_Animations.reserve(n);
+        m_Emitters.reserve(n);
+        m_Lifetimes.reserve(n);
+        m_Flags.reserve(n);
+    }
+    
+    EntityID AddEntity(const std::string&& name)
+    {
+        EntityID id = m_Names.size();
+        m_Names.emplace_back(name);
+        m_Positions.push_back(PositionComponent());
+        m_Sprites.push_back(SpriteComponent());
+        m_WorldBounds.push_back(WorldBoundsComponent());
+        m_Moves.push_back(MoveComponent());
+        m_Animations.push_back(AnimationComponent());
+        m_Emitters.push_back(EmitterComponent());
+        m_Lifetimes.push_back(LifetimeComponent());
+        m_Flags.push_back(0);
+        m_PoolBegin = id + 1;
+        return id;
+    }
+
+    // Moves all data of an entity into another one's place (overwriting it).
+    void MoveEntity(EntityID from, EntityID to)
+    {
+        m_Names[to] = std::move(m_Names[from]);
+        m_Positions[to] = m_Positions[from];
+        m_Sprites[to] = m_Sprites[from];
+        m_WorldBounds[to] = m_WorldBounds[from];
+        m_Moves[to] = m_Moves[from];
+        m_Animations[to] = m_Animations[from];
+        m_Emitters[to] = m_Emitters[from];
+        m_Lifetimes[to] = m_Lifetimes[from];
+        m_Flags[to] = m_Flags[from];
+    }
+
+    // Removes an entity, by moving the last one into its place (so only the last one changes its ID).
+    void RemoveEntitySwapLast(EntityID id)
+    {
+        EntityID last = m_Names.size() - 1;
+        if (id != last)
+            MoveEntity(last, id);
+        resize(last);
+    }
+
+    // Pool of transient entities (e.g. particles) at the end of the arrays: IDs [m_PoolBegin, size).
+    // Room for all of them is reserved up front, so spawning & despawning them never allocates
+    // memory. Pooled entities change their IDs when others despawn (the last ones move into freed
+    // places), so systems go over the whole pool instead of keeping sets of their IDs. No regular
+    // entities can be added after the pool; until it is reserved, it is empty and starts after the
+    // last regular entity.
+    size_t m_PoolBegin = 0, m_PoolCapacity = 0;
+
+    void ReservePool(size_t capacity)
+    {
+        m_PoolBegin = m_Names.size();
+        m_PoolCapacity = capacity;
+        reserve(m_PoolBegin + capacity);
+    }
+    size_t PoolSize() const { return m_Names.size() - m_PoolBegin; }
+
+    // Adds up to count pooled entities (fewer if the pool would not fit them), with zeroed data;
+    // returns how many got added, starting at ID first.
+    size_t SpawnPooled(size_t count, EntityID& first)
+    {
+        first = m_Names.size();
+        count = std::min(count, m_PoolCapacity - PoolSize());
+        resize(first + count);
+        return count;
+    }
+
+    // Removes entities past the given count.
+    void resize(size_t n)
+    {
+        m_Names.resize(n);
+        m_Positions.resize(n);
+        m_Sprites.resize(n);
+        m_WorldBounds.resize(n);
+        m_Moves.resize(n);
+        m_Animations.resize(n);
+        m_Emitters.resize(n);
+        m_Lifetimes.resize(n);
+        m_Flags.resize(n);
+        if (m_PoolCapacity == 0)
+            m_PoolBegin = n;
+    }
+
+    // Calls func(data, size, flag) for raw data of each component array (everything except names),
+    // with the flag of entities that have the component; flags themselves come first, with a zero
+    // flag. Used to save & restore the whole simulation state.
+    template<typename F> void ForEachComponentArray(F func)
+    {
+        func((void*)m_Flags.data(), m_Flags.size() * sizeof(m_Flags[0]), 0);
+        func((void*)m_Positions.data(), m_Positions.size() * sizeof(m_Positions[0]), (int)kFlagPosition);
+        func((void*)m_Sprites.data(), m_Sprites.size() * sizeof(m_Sprites[0]), (int)kFlagSprite);
+        func((void*)m_WorldBounds.data(), m_WorldBounds.size() * sizeof(m_WorldBounds[0]), (int)kFlagWorldBounds);
+        func((void*)m_Moves.data(), m_Moves.size() * sizeof(m_Moves[0]), (int)kFlagMove);
+        func((void*)m_Animations.data(), m_Animations.size() * sizeof(m_Animations[0]), (int)kFlagAnimation);
+        func((void*)m_Emitters.data(), m_Emitters.size() * sizeof(m_Emitters[0]), (int)kFlagEmitter);
+        func((void*)m_Lifetimes.data(), m_Lifetimes.size() * sizeof(m_Lifetimes[0]), (int)kFlagLifetime);
+    }
+};
+
+
+// Sorted set of entity IDs, e.g. objects that a system operates on. Members are almost always
+// contiguous ranges of IDs, so they are stored as runs of consecutive IDs; that takes much less
+// memory than a list of IDs, and lets systems access component arrays directly with unit stride.
+// When the set gets fragmented (average run shorter than two IDs), it switches to storing plain
+// sorted IDs instead, and back once the average run is four IDs or longer.
+class EntitySet
+{
+public:
+    // Adds an ID; cheapest when adding them in increasing order.
+    void Add(EntityID id)
+    {
+        bool joinsPrev, joinsNext;
+        if (m_Sparse)
+        {
+            auto it = std::lower_bound(m_IDs.begin(), m_IDs.end(), id);
+            if (it != m_IDs.end() && *it == id)
+                return;
+            joinsPrev = it != m_IDs.begin() && it[-1] == id - 1;
+            joinsNext = it != m_IDs.end() && *it == id + 1;
+            m_IDs.insert(it, id);
+        }
+        else
+        {
+            // find first run that ends at or after the ID
+            auto it = m_Runs.end();
+            if (!m_Runs.empty() && m_Runs.back().end == id)
+                it = m_Runs.end() - 1;
+            else if (!m_Runs.empty() && m_Runs.back().end > id)
+                it = std::lower_bound(m_Runs.begin(), m_Runs.end(), id, [](const Run& r, EntityID v) { return r.end < v; });
+            if (it != m_Runs.end() && it->begin <= id && id < it->end)
+                return;
+            joinsPrev = it != m_Runs.end() && it->end == id;
+            joinsNext = it != m_Runs.end() && (joinsPrev ? it + 1 != m_Runs.end() && it[1].begin == id + 1 : it->begin == id + 1);
+            if (joinsPrev && joinsNext)
+            {
+                it->end = it[1].end;
+                m_Runs.erase(it + 1);
+            }
+            else if (joinsPrev)
+                it->end = id + 1;
+            else if (joinsNext)
+                it->begin = id;
+            else
+                m_Runs.insert(it, Run{ id, id + 1 });
+        }
+        ++m_Count;
+        m_RunCount = m_RunCount + 1 - joinsPrev - joinsNext;
+        if (m_RunCount > 16 && (m_Sparse ? m_RunCount * 4 <= m_Count : m_RunCount * 2 > m_Count))
+            SetSparse(!m_Sparse);
+    }
+
+    void clear()
+    {
+        m_Runs.clear();
+        m_IDs.clear();
+        m_Count = m_RunCount = 0;
+        m_Sparse = false;
+    }
+
+    size_t size() const { return m_Count; }
+    bool empty() const { return m_Count == 0; }
+
+    bool Contains(EntityID id) const
+    {
+        if (m_Sparse)
+            return std::binary_search(m_IDs.begin(), m_IDs.end(), id);
+        auto it = std::upper_bound(m_Runs.begin(), m_Runs.end(), id, [](EntityID v, const Run& r) { return v < r.end; });
+        return it != m_Runs.end() && it->begin <= id;
+    }
+
+    // number of runs of consecutive IDs
+    size_t RunCount() const { return m_RunCount; }
+
+    // Calls func(begin, end) for each run of consecutive IDs [begin,end), in increasing order.
+    template<typename F> void ForEachRun(F func) const
+    {
+        if (!m_Sparse)
+        {
+            for (const Run& r : m_Runs)
+                func(r.begin, r.end);
+            return;
+        }
+        for (size_t i = 0, n = m_IDs.size(); i != n; )
+        {
+            size_t j = i + 1;
+            while (j != n && m_IDs[j] == m_IDs[j - 1] + 1)
+                ++j;
+            func(m_IDs[i], m_IDs[j - 1] + 1);
+            i = j;
+        }
+    }
+
+    // Calls func(id) for each ID, in increasing order.
+    template<typename F> void ForEach(F func) const
+    {
+        ForEachRun([&](EntityID begin, EntityID end)
+        {
+            for (EntityID id = begin; id != end; ++id)
+                func(id);
+        });
+    }
+
+private:
+    void SetSparse(bool sparse)
+    {
+        if (sparse)
+        {
+            m_IDs.reserve(m_Count);
+            ForEach([&](EntityID id) { m_IDs.push_back(id); });
+            std::vector<Run>().swap(m_Runs);
+        }
+        else
+        {
+            m_Runs.reserve(m_RunCount);
+            ForEachRun([&](EntityID begin, EntityID end) { m_Runs.push_back(Run{ begin, end }); });
+            std::vector<EntityID>().swap(m_IDs);
+        }
+        m_Sparse = sparse;
+    }
+
+    struct Run
+    {
+        EntityID begin, end;
+    };
+    std::vector<Run> m_Runs; // when not sparse
+    std::vector<EntityID> m_IDs; // when sparse
+    size_t m_Count = 0;
+    size_t m_RunCount = 0;
+    bool m_Sparse = false;
+};
+
+
+// The "scene" of the game (lives in game.cpp)
+Entities& GetGameEntities();
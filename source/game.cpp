@@ -1,272 +1,125 @@
 #include "game.h"
-#include <vector>
-#include <string>
-#include <math.h>
+#include "systems.h"
+#include "game_variants.h"
+#include <string.h>
 #include <assert.h>
 
 const int kObjectCount = 1000000;
 const int kAvoidCount = 20;
+const unsigned kRandomSeed = 1;
 
 
+// The "scene"
+static Entities s_Objects;
 
-static float RandomFloat01() { return (float)rand() / (float)RAND_MAX; }
-static float RandomFloat(float from, float to) { return RandomFloat01() * (to - from) + from; }
-
+Entities& GetGameEntities() { return s_Objects; }
 
-// -------------------------------------------------------------------------------------------------
-// components we use in our "game". these are all just simple structs with some data.
 
+// "systems" that we have; they operate on components of game objects (see systems.h)
+static MoveSystem s_MoveSystem;
+static AvoidanceSystem s_AvoidanceSystem;
+static SeparationSystem s_SeparationSystem;
+static AvoiderRepulsionSystem s_AvoiderRepulsionSystem;
+static AnimationSystem s_AnimationSystem;
+static ColorDecaySystem s_ColorDecaySystem;
+static SpawnerSystem s_SpawnerSystem;
+static LifetimeSystem s_LifetimeSystem;
+static HierarchySystem s_HierarchySystem;
+static FlockingSystem s_FlockingSystem;
+
+MoveSystem& GetGameMoveSystem() { return s_MoveSystem; }
+AvoidanceSystem& GetGameAvoidanceSystem() { return s_AvoidanceSystem; }
+SeparationSystem& GetGameSeparationSystem() { return s_SeparationSystem; }
+AvoiderRepulsionSystem& GetGameAvoiderRepulsionSystem() { return s_AvoiderRepulsionSystem; }
+AnimationSystem& GetGameAnimationSystem() { return s_AnimationSystem; }
+ColorDecaySystem& GetGameColorDecaySystem() { return s_ColorDecaySystem; }
+SpawnerSystem& GetGameSpawnerSystem() { return s_SpawnerSystem; }
+LifetimeSystem& GetGameLifetimeSystem() { return s_LifetimeSystem; }
+HierarchySystem& GetGameHierarchySystem() { return s_HierarchySystem; }
+FlockingSystem& GetGameFlockingSystem() { return s_FlockingSystem; }
+
+// parallel execution settings of the systems; these persist across game re-initialization
+static ParallelSettings s_MoveParallel;
+static ParallelSettings s_AvoidanceParallel;
+// (systems doing neighbour queries, i.e. flocking, separation & avoider repulsion, do not run with the
+// default config that calibration uses; they are expensive per object like avoidance, so just use all
+// threads)
+static ParallelSettings s_NeighbourParallel = { 1024, ParallelMaxThreads(), false };
+
+ParallelSettings& GetGameMoveParallel() { return s_MoveParallel; }
+ParallelSettings& GetGameAvoidanceParallel() { return s_AvoidanceParallel; }
+ParallelSettings& GetGameNeighbourParallel() { return s_NeighbourParallel; }
+
+// avoidance time budget (seconds); persists across game re-initialization too
+static double s_AvoidanceBudget;
+// avoidance broadphase; persists across game re-initialization too
+static AvoidanceSystem::Broadphase s_AvoidanceBroadphase = AvoidanceSystem::kBroadphaseAuto;
 
-// 2D position: just x,y coordinates
-struct PositionComponent
-{
-    float x, y;
-};
 
+// -------------------------------------------------------------------------------------------------
+// "the game"
 
-// Sprite: color, sprite index (in the sprite atlas), and scale for rendering it
-struct SpriteComponent
-{
-    float colorR, colorG, colorB;
-    int spriteIndex;
-    float scale;
-};
 
+// Variant the game was initialized with
+static game_variant_t s_Variant = GAME_VARIANT_DOD;
 
-// World bounds for our "game" logic: x,y minimum & maximum values
-struct WorldBoundsComponent
-{
-    float xMin, xMax, yMin, yMax;
-};
+static const char* kVariantNames[GAME_VARIANT_COUNT] = { "dod", "ecs", "oop" };
 
 
-// Move around with constant velocity. When reached world bounds, reflect back from them.
-struct MoveComponent
+extern "C" void game_default_config(game_config_t* config)
 {
-    float velx, vely;
-
-    void Initialize(float minSpeed, float maxSpeed)
-    {
-        // random angle
-        float angle = RandomFloat01() * 3.1415926f * 2;
-        // random movement speed between given min & max
-        float speed = RandomFloat(minSpeed, maxSpeed);
-        // velocity x & y components
-        velx = cosf(angle) * speed;
-        vely = sinf(angle) * speed;
-    }
-};
-
-
-// -------------------------------------------------------------------------------------------------
-// super simple "game entities system", using struct-of-arrays data layout.
-// we just have an array for each possible component, and a flags array bit bits indicating
-// which components are "present".
+    config->objectCount = kObjectCount;
+    config->avoidCount = kAvoidCount;
+    config->seed = kRandomSeed;
+    config->variant = GAME_VARIANT_DOD;
+    config->separationRadius = 0.0f;
+    config->avoidersRepel = 0;
+    config->animateSprites = 0;
+    config->tintHalfLife = 0.0f;
+    config->trailRate = 0.0f;
+    config->attachmentCount = 0;
+    config->flocking = 0;
+}
 
-// "ID" of a game object is just an index into the scene array.
-typedef size_t EntityID;
 
-struct Entities
+extern "C" const char* game_variant_name(game_variant_t variant)
 {
-    enum
-    {
-        kFlagPosition = 1<<0,
-        kFlagSprite = 1<<1,
-        kFlagWorldBounds = 1<<2,
-        kFlagMove = 1<<3,
-    };
-
-    // arrays of data; the sizes of all of them are the same. EntityID (just an index)
-    // is used to access data for any "object/entity". The "object" itself is nothing
-    // more than just an index into these arrays.
-    
-    // names of each object
-    std::vector<std::string> m_Names;
-    // data for all components
-    std::vector<PositionComponent> m_Positions;
-    std::vector<SpriteComponent> m_Sprites;
-    std::vector<WorldBoundsComponent> m_WorldBounds;
-    std::vector<MoveComponent> m_Moves;
-    // bit flags for every component, indicating whether this object "has it"
-    std::vector<int> m_Flags;
-    
-    void reserve(size_t n)
-    {
-        m_Names.reserve(n);
-        m_Positions.reserve(n);
-        m_Sprites.reserve(n);
-        m_WorldBounds.reserve(n);
-        m_Moves.reserve(n);
-        m_Flags.reserve(n);
-    }
-    
-    EntityID AddEntity(const std::string&& name)
-    {
-        EntityID id = m_Names.size();
-        m_Names.emplace_back(name);
-        m_Positions.push_back(PositionComponent());
-        m_Sprites.push_back(SpriteComponent());
-        m_WorldBounds.push_back(WorldBoundsComponent());
-        m_Moves.push_back(MoveComponent());
-        m_Flags.push_back(0);
-        return id;
-    }
-};
-
-
-// The "scene"
-static Entities s_Objects;
-
-
-// -------------------------------------------------------------------------------------------------
-// "systems" that we have; they operate on components of game objects
+    return variant >= 0 && variant < GAME_VARIANT_COUNT ? kVariantNames[variant] : "unknown";
+}
 
 
-struct MoveSystem
+extern "C" game_variant_t game_variant_from_name(const char* name)
 {
-    EntityID boundsID; // ID if object with world bounds
-    std::vector<EntityID> entities; // IDs of objects that should be moved
-
-    void AddObjectToSystem(EntityID id)
-    {
-        entities.emplace_back(id);
-    }
-
-    void SetBounds(EntityID id)
-    {
-        boundsID = id;
-    }
-    
-    void UpdateSystem(double time, float deltaTime)
-    {
-        const WorldBoundsComponent& bounds = s_Objects.m_WorldBounds[boundsID];
-
-        // go through all the objects
-        for (size_t io = 0, no = entities.size(); io != no; ++io)
-        {
-            PositionComponent& pos = s_Objects.m_Positions[io];
-            MoveComponent& move = s_Objects.m_Moves[io];
-            
-            // update position based on movement velocity & delta time
-            pos.x += move.velx * deltaTime;
-            pos.y += move.vely * deltaTime;
-            
-            // check against world bounds; put back onto bounds and mirror the velocity component to "bounce" back
-            if (pos.x < bounds.xMin)
-            {
-                move.velx = -move.velx;
-                pos.x = bounds.xMin;
-            }
-            if (pos.x > bounds.xMax)
-            {
-                move.velx = -move.velx;
-                pos.x = bounds.xMax;
-            }
-            if (pos.y < bounds.yMin)
-            {
-                move.vely = -move.vely;
-                pos.y = bounds.yMin;
-            }
-            if (pos.y > bounds.yMax)
-            {
-                move.vely = -move.vely;
-                pos.y = bounds.yMax;
-            }
-        }
-    }
-};
-
-static MoveSystem s_MoveSystem;
-
+    int variant = 0;
+    while (variant < GAME_VARIANT_COUNT && strcmp(name, kVariantNames[variant]) != 0)
+        ++variant;
+    return (game_variant_t)variant;
+}
 
 
-// "Avoidance system" works out interactions between objects that "avoid" and "should be avoided".
-// Objects that avoid:
-// - when they get closer to things that should be avoided than the given distance, they bounce back,
-// - also they take sprite color from the object they just bumped into
-struct AvoidanceSystem
+extern "C" void game_initialize(const game_config_t* config)
 {
-    // things to be avoided: distances to them, and their IDs
-    std::vector<float> avoidDistanceList;
-    std::vector<EntityID> avoidList;
-    
-    // objects that avoid: their IDs
-    std::vector<EntityID> objectList;
-
-    void AddAvoidThisObjectToSystem(EntityID id, float distance)
+    game_config_t defaultConfig;
+    if (config == NULL)
     {
-        avoidList.emplace_back(id);
-        avoidDistanceList.emplace_back(distance * distance);
+        game_default_config(&defaultConfig);
+        config = &defaultConfig;
     }
-    
-    void AddObjectToSystem(EntityID id)
+    assert(1 + config->objectCount + config->avoidCount * (1 + 2 * config->attachmentCount) <= kMaxSpriteCount);
+    s_Variant = config->variant;
+    if (s_Variant == GAME_VARIANT_ECS)
     {
-        objectList.emplace_back(id);
+        ECSGameInitialize(*config);
+        return;
     }
-    
-    static float DistanceSq(const PositionComponent& a, const PositionComponent& b)
+    if (s_Variant == GAME_VARIANT_OOP)
     {
-        float dx = a.x - b.x;
-        float dy = a.y - b.y;
-        return dx * dx + dy * dy;
+        OOPGameInitialize(*config);
+        return;
     }
-    
-    void ResolveCollision(EntityID id, float deltaTime)
-    {
-        PositionComponent& pos = s_Objects.m_Positions[id];
-        MoveComponent& move = s_Objects.m_Moves[id];
+    srand(config->seed);
 
-        // flip velocity
-        move.velx = -move.velx;
-        move.vely = -move.vely;
-        
-        // move us out of collision, by moving just a tiny bit more than we'd normally move during a frame
-        pos.x += move.velx * deltaTime * 1.1f;
-        pos.y += move.vely * deltaTime * 1.1f;
-    }
-    
-    void UpdateSystem(double time, float deltaTime)
-    {
-        // go through all the objects
-        for (size_t io = 0, no = objectList.size(); io != no; ++io)
-        {
-            EntityID go = objectList[io];
-            const PositionComponent& myposition = s_Objects.m_Positions[go];
-
-            // check each thing in avoid list
-            for (size_t ia = 0, na = avoidList.size(); ia != na; ++ia)
-            {
-                float avDistance = avoidDistanceList[ia];
-                EntityID avoid = avoidList[ia];
-                const PositionComponent& avoidposition = s_Objects.m_Positions[avoid];
-                
-                // is our position closer to "thing to avoid" position than the avoid distance?
-                if (DistanceSq(myposition, avoidposition) < avDistance)
-                {
-                    ResolveCollision(go, deltaTime);
-                    
-                    // also make our sprite take the color of the thing we just bumped into
-                    SpriteComponent& avoidSprite = s_Objects.m_Sprites[avoid];
-                    SpriteComponent& mySprite = s_Objects.m_Sprites[go];
-                    mySprite.colorR = avoidSprite.colorR;
-                    mySprite.colorG = avoidSprite.colorG;
-                    mySprite.colorB = avoidSprite.colorB;
-                }
-            }
-        }
-    }
-};
-
-static AvoidanceSystem s_AvoidanceSystem;
-
-
-// -------------------------------------------------------------------------------------------------
-// "the game"
-
-
-extern "C" void game_initialize(void)
-{
-    s_Objects.reserve(1 + kObjectCount + kAvoidCount);
+    s_Objects.reserve(1 + config->objectCount + config->avoidCount);
     
     // create "world bounds" object
     WorldBoundsComponent bounds;
@@ -279,10 +132,20 @@ extern "C" void game_initialize(void)
         bounds = s_Objects.m_WorldBounds[go];
         s_Objects.m_Flags[go] |= Entities::kFlagWorldBounds;
         s_MoveSystem.SetBounds(go);
+        s_SeparationSystem.SetBounds(go);
+        s_FlockingSystem.SetBounds(go);
+        s_AvoiderRepulsionSystem.SetBounds(go);
+        s_AvoidanceSystem.SetBounds(go);
+
+        // grid of where moving objects are, kept up to date by the move system; avoidance finds
+        // objects near things to avoid through it, unless separation pushes them after moving
+        s_MoveSystem.grid.Initialize(bounds, 2.0f);
+        if (config->separationRadius <= 0.0f)
+            s_AvoidanceSystem.objectGrid = &s_MoveSystem.grid;
     }
     
     // create regular objects that move
-    for (auto i = 0; i < kObjectCount; ++i)
+    for (auto i = 0; i < config->objectCount; ++i)
     {
         EntityID go = s_Objects.AddEntity("object");
 
@@ -299,6 +162,14 @@ extern "C" void game_initialize(void)
         s_Objects.m_Sprites[go].scale = 1.0f;
         s_Objects.m_Flags[go] |= Entities::kFlagSprite;
 
+        // cycle through the first 5 sprites, starting from that one, if enabled
+        if (config->animateSprites)
+        {
+            s_Objects.m_Animations[go] = AnimationComponent{ RandomFloat(2.0f, 6.0f), (float)s_Objects.m_Sprites[go].spriteIndex, 0, 5 };
+            s_Objects.m_Flags[go] |= Entities::kFlagAnimation;
+            s_AnimationSystem.AddObjectToSystem(go);
+        }
+
         // make it move
         s_Objects.m_Moves[go].Initialize(0.5f, 0.7f);
         s_Objects.m_Flags[go] |= Entities::kFlagMove;
@@ -306,10 +177,29 @@ extern "C" void game_initialize(void)
 
         // make it avoid the bubble things, by adding to the avoidance system
         s_AvoidanceSystem.AddObjectToSystem(go);
+
+        // and keep away from other objects, if enabled
+        if (config->separationRadius > 0.0f)
+            s_SeparationSystem.AddObjectToSystem(go);
+
+        // and steer along with objects around it, if enabled
+        if (config->flocking)
+            s_FlockingSystem.AddObjectToSystem(go);
+
+        // fade colors taken from things to avoid back to white, if enabled
+        if (config->tintHalfLife > 0.0f)
+            s_ColorDecaySystem.AddObjectToSystem(s_Objects, go);
     }
+    s_ColorDecaySystem.halfLife = config->tintHalfLife;
+    if (config->tintHalfLife > 0.0f)
+        s_AvoidanceSystem.bumpedObjects = &s_ColorDecaySystem.tintedObjects;
+    s_SeparationSystem.radius = config->separationRadius;
+    // (flocking changes speeds of objects, within its limit)
+    if (config->flocking)
+        s_AvoidanceSystem.maxObjectSpeed = s_FlockingSystem.maxSpeed;
 
     // create objects that should be avoided
-    for (auto i = 0; i < kAvoidCount; ++i)
+    for (auto i = 0; i < config->avoidCount; ++i)
     {
         EntityID go = s_Objects.AddEntity("toavoid");
         
@@ -333,45 +223,112 @@ extern "C" void game_initialize(void)
 
         // add to avoidance this as "Avoid This" object
         s_AvoidanceSystem.AddAvoidThisObjectToSystem(go, 1.3f);
+
+        // and make it bounce off other such objects, if enabled
+        if (config->avoidersRepel)
+            s_AvoiderRepulsionSystem.AddObjectToSystem(go, 1.3f);
+
+        // and leave a trail of particles behind, if enabled
+        if (config->trailRate > 0.0f)
+        {
+            s_Objects.m_Emitters[go] = EmitterComponent{ config->trailRate, 0.3f, 1.0f, 0.0f, 2463534242u + (uint32_t)go };
+            s_Objects.m_Flags[go] |= Entities::kFlagEmitter;
+            s_SpawnerSystem.AddObjectToSystem(go);
+        }
     }
+
+    // attach sprites around things to avoid, each with a smaller one further out, if enabled
+    size_t avoidEnd = s_Objects.m_Flags.size();
+    for (EntityID avoid = avoidEnd - config->avoidCount; avoid < avoidEnd && config->attachmentCount > 0; ++avoid)
+    {
+        for (int i = 0; i < config->attachmentCount; ++i)
+        {
+            float angle = 3.1415926f * 2 * i / config->attachmentCount;
+            float dx = cosf(angle), dy = sinf(angle);
+            EntityID child = s_Objects.AddEntity("attachment");
+            s_Objects.m_Positions[child] = s_Objects.m_Positions[avoid];
+            s_Objects.m_Sprites[child] = s_Objects.m_Sprites[avoid];
+            s_Objects.m_Sprites[child].scale = 0.6f;
+            s_Objects.m_Flags[child] |= Entities::kFlagPosition | Entities::kFlagSprite;
+            s_HierarchySystem.AddObjectToSystem(child, avoid, dx * 1.6f, dy * 1.6f);
+
+            EntityID grandchild = s_Objects.AddEntity("attachment");
+            s_Objects.m_Positions[grandchild] = s_Objects.m_Positions[avoid];
+            s_Objects.m_Sprites[grandchild] = s_Objects.m_Sprites[child];
+            s_Objects.m_Sprites[grandchild].scale = 0.3f;
+            s_Objects.m_Flags[grandchild] |= Entities::kFlagPosition | Entities::kFlagSprite;
+            s_HierarchySystem.AddObjectToSystem(grandchild, child, dx * 0.5f, dy * 0.5f);
+        }
+    }
+
+    // particles go into a pool after everything else; as many as fit into sprite data
+    if (config->trailRate > 0.0f)
+        s_Objects.ReservePool(kMaxSpriteCount - s_Objects.m_Flags.size());
+
+    // everything above was written (and so placed into memory) by this thread; on NUMA machines move
+    // it to where parallel systems will process it. Moving system touches most data, and it is the
+    // one limited by memory bandwidth; so its settings decide the placement.
+    NumaPlaceComponents(s_Objects, s_MoveSystem.entities, s_MoveParallel);
 }
 
 
 extern "C" void game_destroy(void)
 {
+    s_Objects = Entities();
+    s_MoveSystem = MoveSystem();
+    s_AvoidanceSystem = AvoidanceSystem();
+    s_SeparationSystem = SeparationSystem();
+    s_AvoiderRepulsionSystem = AvoiderRepulsionSystem();
+    s_AnimationSystem = AnimationSystem();
+    s_ColorDecaySystem = ColorDecaySystem();
+    s_SpawnerSystem = SpawnerSystem();
+    s_LifetimeSystem = LifetimeSystem();
+    s_HierarchySystem = HierarchySystem();
+    s_FlockingSystem = FlockingSystem();
+    ECSGameDestroy();
+    OOPGameDestroy();
+    s_Variant = GAME_VARIANT_DOD;
 }
 
 
 extern "C" int game_update(sprite_data_t* data, double time, float deltaTime)
 {
-    int objectCount = 0;
-    
+    if (s_Variant == GAME_VARIANT_ECS)
+        return ECSGameUpdate(data, time, deltaTime);
+    if (s_Variant == GAME_VARIANT_OOP)
+        return OOPGameUpdate(data, time, deltaTime);
+
     // update object systems
-    s_MoveSystem.UpdateSystem(time, deltaTime);
-    s_AvoidanceSystem.UpdateSystem(time, deltaTime);
+    s_FlockingSystem.UpdateSystem(s_Objects, time, deltaTime, s_NeighbourParallel);
+    s_MoveSystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+    s_SeparationSystem.UpdateSystem(s_Objects, time, deltaTime, s_NeighbourParallel);
+    s_AvoiderRepulsionSystem.UpdateSystem(s_Objects, time, deltaTime, s_NeighbourParallel);
+    s_AvoidanceSystem.timeBudget = s_AvoidanceBudget;
+    s_AvoidanceSystem.extraTravel = s_SeparationSystem.MaxPush() + s_AvoiderRepulsionSystem.MaxPush();
+    s_AvoidanceSystem.broadphase = s_AvoidanceBroadphase;
+    s_AvoidanceSystem.UpdateSystem(s_Objects, time, deltaTime, s_AvoidanceParallel);
+    s_HierarchySystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+    s_LifetimeSystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+    s_SpawnerSystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+    s_AnimationSystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+    s_ColorDecaySystem.UpdateSystem(s_Objects, time, deltaTime, s_MoveParallel);
+
+    // write out data of objects that have a Position & Sprite on them into destination buffer
+    // that will be rendered later on
+    return WriteAllSpriteData(s_Objects, data);
+}
 
-    // go through all objects
-    for (size_t i = 0, n = s_Objects.m_Flags.size(); i != n; ++i)
-    {
-        // For objects that have a Position & Sprite on them: write out
-        // their data into destination buffer that will be rendered later on.
-        //
-        // Using a smaller global scale "zooms out" the rendering, so to speak.
-        float globalScale = 0.05f;
-        if ((s_Objects.m_Flags[i] & Entities::kFlagPosition) && (s_Objects.m_Flags[i] & Entities::kFlagSprite))
-        {
-            sprite_data_t& spr = data[objectCount++];
-            const PositionComponent& pos = s_Objects.m_Positions[i];
-            spr.posX = pos.x * globalScale;
-            spr.posY = pos.y * globalScale;
-            const SpriteComponent& sprite = s_Objects.m_Sprites[i];
-            spr.scale = sprite.scale * globalScale;
-            spr.colR = sprite.colorR;
-            spr.colG = sprite.colorG;
-            spr.colB = sprite.colorB;
-            spr.sprite = (float)sprite.spriteIndex;
-        }
-    }
-    return objectCount;
+
+extern "C" void game_set_avoidance_budget(float milliseconds)
+{
+    s_AvoidanceBudget = milliseconds * 0.001;
 }
 
+extern "C" int game_set_avoidance_broadphase(const char* name)
+{
+    AvoidanceSystem::Broadphase b = AvoidanceSystem::BroadphaseFromName(name);
+    if (b == AvoidanceSystem::kBroadphaseCount)
+        return 0;
+    s_AvoidanceBroadphase = b;
+    return 1;
+}
@@ -15,11 +15,52 @@ typedef struct
     float sprite;
 } sprite_data_t;
 
-void game_initialize(void);
+// Implementations of the same game, following the progression from the talk. Given the same
+// config they create the same objects; only the "dod" one works with replays, sharding etc.
+typedef enum
+{
+    GAME_VARIANT_DOD = 0, // entity data in component arrays, updated by systems (game.cpp)
+    GAME_VARIANT_ECS, // entities with handles to components in per-type pools, updated by systems (game_ecs.cpp)
+    GAME_VARIANT_OOP, // GameObjects owning separately allocated, virtual-dispatch Components (game_oop.cpp)
+    GAME_VARIANT_COUNT
+} game_variant_t;
+
+// Settings the game is initialized with
+typedef struct
+{
+    int objectCount; // regular moving objects
+    int avoidCount; // objects that should be avoided
+    unsigned seed; // random seed for initial placement of everything
+    game_variant_t variant; // implementation to use
+    float separationRadius; // regular objects closer than this push each other apart; zero (default) lets them pass through each other (dod variant only)
+    int avoidersRepel; // if non-zero, objects that should be avoided bounce off each other (dod variant only)
+    int animateSprites; // if non-zero, regular objects cycle through their sprites (dod variant only)
+    float tintHalfLife; // seconds for colors taken from things to avoid to fade halfway back; zero (default) keeps them (dod variant only)
+    float trailRate; // particles per second each thing to avoid leaves behind; zero (default) leaves none (dod variant only)
+    int attachmentCount; // sprites attached around each thing to avoid (each with one more attached to it); zero by default (dod variant only)
+    int flocking; // if non-zero, regular objects flock together instead of moving in straight lines (dod variant only)
+} game_config_t;
+
+void game_default_config(game_config_t* config);
+
+const char* game_variant_name(game_variant_t variant);
+// Returns GAME_VARIANT_COUNT if there's no variant with that name.
+game_variant_t game_variant_from_name(const char* name);
+
+// config can be null to use defaults. game_destroy releases everything, after that
+// game can be initialized again.
+void game_initialize(const game_config_t* config);
 void game_destroy(void);
 // returns amount of sprites
 int game_update(sprite_data_t* data, double time, float deltaTime);
 
+// Caps time spent on avoidance each frame: objects far from things to avoid are then checked a
+// rotating slice at a time (see AvoidanceSystem). Zero (default) checks everything every frame.
+void game_set_avoidance_budget(float milliseconds);
+// Picks how avoidance finds nearby things to avoid: "auto" (default), "brute", "grid", "bvh" or
+// "sweep"; results are the same with all of them. Returns zero if there's no such broadphase.
+int game_set_avoidance_broadphase(const char* name);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,295 @@
+// The game halfway between OOP and the final data oriented version: components are plain structs
+// stored in one array per type, and logic lives in systems instead of virtual functions. But each
+// entity is still an object of its own, holding a name and handles (indices) of its components,
+// and systems reach component data through these handles.
+//
+// Systems run in the same order as in game.cpp, so results are identical to it.
+
+#include "game_variants.h"
+#include <vector>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+
+
+namespace ecs
+{
+
+static float RandomFloat01() { return (float)rand() / (float)RAND_MAX; }
+static float RandomFloat(float from, float to) { return RandomFloat01() * (to - from) + from; }
+
+
+struct PositionComponent
+{
+    float x, y;
+};
+
+struct SpriteComponent
+{
+    float colorR, colorG, colorB;
+    int spriteIndex;
+    float scale;
+};
+
+struct WorldBoundsComponent
+{
+    float xMin, xMax, yMin, yMax;
+};
+
+struct MoveComponent
+{
+    float velx, vely;
+
+    void Initialize(float minSpeed, float maxSpeed)
+    {
+        float angle = RandomFloat01() * 3.1415926f * 2;
+        float speed = RandomFloat(minSpeed, maxSpeed);
+        velx = cosf(angle) * speed;
+        vely = sinf(angle) * speed;
+    }
+};
+
+
+// Component handle: index into the array of that component type, or -1 when entity does not have it.
+typedef int ComponentHandle;
+
+struct Entity
+{
+    std::string name;
+    ComponentHandle position = -1;
+    ComponentHandle sprite = -1;
+    ComponentHandle worldBounds = -1;
+    ComponentHandle move = -1;
+};
+
+// "ID" of an entity is its index in the entity array.
+typedef size_t EntityID;
+
+
+struct World
+{
+    std::vector<Entity> entities;
+    std::vector<PositionComponent> positions;
+    std::vector<SpriteComponent> sprites;
+    std::vector<WorldBoundsComponent> worldBounds;
+    std::vector<MoveComponent> moves;
+
+    EntityID AddEntity(const std::string&& name)
+    {
+        entities.emplace_back();
+        entities.back().name = name;
+        return entities.size() - 1;
+    }
+
+    template<typename T> static ComponentHandle AddComponent(std::vector<T>& array, ComponentHandle& handle)
+    {
+        handle = (ComponentHandle)array.size();
+        array.emplace_back(T());
+        return handle;
+    }
+
+    PositionComponent& AddPosition(EntityID id) { return positions[AddComponent(positions, entities[id].position)]; }
+    SpriteComponent& AddSprite(EntityID id) { return sprites[AddComponent(sprites, entities[id].sprite)]; }
+    WorldBoundsComponent& AddWorldBounds(EntityID id) { return worldBounds[AddComponent(worldBounds, entities[id].worldBounds)]; }
+    MoveComponent& AddMove(EntityID id) { return moves[AddComponent(moves, entities[id].move)]; }
+};
+
+static World s_World;
+
+
+// Move all the objects with velocity, and bounce them off world bounds.
+struct MoveSystem
+{
+    EntityID boundsID;
+    std::vector<EntityID> entities;
+
+    void UpdateSystem(World& world, double time, float deltaTime)
+    {
+        const WorldBoundsComponent& bounds = world.worldBounds[world.entities[boundsID].worldBounds];
+
+        for (EntityID go : entities)
+        {
+            const Entity& e = world.entities[go];
+            PositionComponent& pos = world.positions[e.position];
+            MoveComponent& move = world.moves[e.move];
+
+            pos.x += move.velx * deltaTime;
+            pos.y += move.vely * deltaTime;
+
+            if (pos.x < bounds.xMin)
+            {
+                move.velx = -move.velx;
+                pos.x = bounds.xMin;
+            }
+            if (pos.x > bounds.xMax)
+            {
+                move.velx = -move.velx;
+                pos.x = bounds.xMax;
+            }
+            if (pos.y < bounds.yMin)
+            {
+                move.vely = -move.vely;
+                pos.y = bounds.yMin;
+            }
+            if (pos.y > bounds.yMax)
+            {
+                move.vely = -move.vely;
+                pos.y = bounds.yMax;
+            }
+        }
+    }
+};
+
+
+// Objects that avoid bounce back from things to be avoided, and take their sprite color.
+struct AvoidanceSystem
+{
+    std::vector<float> avoidDistanceList; // squared
+    std::vector<EntityID> avoidList;
+    std::vector<EntityID> objectList;
+
+    static float DistanceSq(const PositionComponent& a, const PositionComponent& b)
+    {
+        float dx = a.x - b.x;
+        float dy = a.y - b.y;
+        return dx * dx + dy * dy;
+    }
+
+    void UpdateSystem(World& world, double time, float deltaTime)
+    {
+        for (EntityID go : objectList)
+        {
+            const Entity& e = world.entities[go];
+            PositionComponent& pos = world.positions[e.position];
+
+            for (size_t ia = 0, na = avoidList.size(); ia != na; ++ia)
+            {
+                const Entity& avoid = world.entities[avoidList[ia]];
+                const PositionComponent& avoidpos = world.positions[avoid.position];
+                if (DistanceSq(pos, avoidpos) < avoidDistanceList[ia])
+                {
+                    // flip velocity, and move us out of collision
+                    MoveComponent& move = world.moves[e.move];
+                    move.velx = -move.velx;
+                    move.vely = -move.vely;
+                    pos.x += move.velx * deltaTime * 1.1f;
+                    pos.y += move.vely * deltaTime * 1.1f;
+
+                    // take the color of the thing we just bumped into
+                    const SpriteComponent& avoidSprite = world.sprites[avoid.sprite];
+                    SpriteComponent& mySprite = world.sprites[e.sprite];
+                    mySprite.colorR = avoidSprite.colorR;
+                    mySprite.colorG = avoidSprite.colorG;
+                    mySprite.colorB = avoidSprite.colorB;
+                }
+            }
+        }
+    }
+};
+
+static MoveSystem s_MoveSystem;
+static AvoidanceSystem s_AvoidanceSystem;
+
+} // namespace ecs
+
+
+using namespace ecs;
+
+void ECSGameInitialize(const game_config_t& config)
+{
+    srand(config.seed);
+
+    // create "world bounds" object
+    WorldBoundsComponent bounds;
+    {
+        EntityID go = s_World.AddEntity("bounds");
+        WorldBoundsComponent& b = s_World.AddWorldBounds(go);
+        b.xMin = -80.0f;
+        b.xMax =  80.0f;
+        b.yMin = -50.0f;
+        b.yMax =  50.0f;
+        bounds = b;
+        s_MoveSystem.boundsID = go;
+    }
+
+    // create regular objects that move
+    for (auto i = 0; i < config.objectCount; ++i)
+    {
+        EntityID go = s_World.AddEntity("object");
+
+        PositionComponent& pos = s_World.AddPosition(go);
+        pos.x = RandomFloat(bounds.xMin, bounds.xMax);
+        pos.y = RandomFloat(bounds.yMin, bounds.yMax);
+
+        SpriteComponent& sprite = s_World.AddSprite(go);
+        sprite.colorR = 1.0f;
+        sprite.colorG = 1.0f;
+        sprite.colorB = 1.0f;
+        sprite.spriteIndex = rand() % 5;
+        sprite.scale = 1.0f;
+
+        s_World.AddMove(go).Initialize(0.5f, 0.7f);
+        s_MoveSystem.entities.emplace_back(go);
+
+        s_AvoidanceSystem.objectList.emplace_back(go);
+    }
+
+    // create objects that should be avoided
+    for (auto i = 0; i < config.avoidCount; ++i)
+    {
+        EntityID go = s_World.AddEntity("toavoid");
+
+        PositionComponent& pos = s_World.AddPosition(go);
+        pos.x = RandomFloat(bounds.xMin, bounds.xMax) * 0.2f;
+        pos.y = RandomFloat(bounds.yMin, bounds.yMax) * 0.2f;
+
+        SpriteComponent& sprite = s_World.AddSprite(go);
+        sprite.colorR = RandomFloat(0.5f, 1.0f);
+        sprite.colorG = RandomFloat(0.5f, 1.0f);
+        sprite.colorB = RandomFloat(0.5f, 1.0f);
+        sprite.spriteIndex = 5;
+        sprite.scale = 2.0f;
+
+        s_World.AddMove(go).Initialize(0.1f, 0.2f);
+        s_MoveSystem.entities.emplace_back(go);
+
+        s_AvoidanceSystem.avoidList.emplace_back(go);
+        s_AvoidanceSystem.avoidDistanceList.emplace_back(1.3f * 1.3f);
+    }
+}
+
+
+void ECSGameDestroy()
+{
+    s_World = World();
+    s_MoveSystem = MoveSystem();
+    s_AvoidanceSystem = AvoidanceSystem();
+}
+
+
+int ECSGameUpdate(sprite_data_t* data, double time, float deltaTime)
+{
+    int objectCount = 0;
+
+    s_MoveSystem.UpdateSystem(s_World, time, deltaTime);
+    s_AvoidanceSystem.UpdateSystem(s_World, time, deltaTime);
+
+    // write out sprite data of entities that have a Position & Sprite
+    const float globalScale = 0.05f;
+    for (const Entity& e : s_World.entities)
+    {
+        if (e.position < 0 || e.sprite < 0)
+            continue;
+        const PositionComponent& pos = s_World.positions[e.position];
+        const SpriteComponent& sprite = s_World.sprites[e.sprite];
+        sprite_data_t& spr = data[objectCount++];
+        spr.posX = pos.x * globalScale;
+        spr.posY = pos.y * globalScale;
+        spr.scale = sprite.scale * globalScale;
+        spr.colR = sprite.colorR;
+        spr.colG = sprite.colorG;
+        spr.colB = sprite.colorB;
+        spr.sprite = (float)sprite.spriteIndex;
+    }
+    return objectCount;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// Other implementations of the game than the default one (see game_variant_t); game.cpp
+// forwards to these when the game is initialized with their variant.
+
+#include "game.h"
+
+// game_ecs.cpp
+void ECSGameInitialize(const game_config_t& config);
+int ECSGameUpdate(sprite_data_t* data, double time, float deltaTime);
+void ECSGameDestroy();
+
+// game_oop.cpp
+void OOPGameInitialize(const game_config_t& config);
+int OOPGameUpdate(sprite_data_t* data, double time, float deltaTime);
+void OOPGameDestroy();
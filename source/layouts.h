@@ -0,0 +1,350 @@
+#pragma once
+
+// Game systems written once, against several memory layouts of the object data, so that the
+// layout can be picked per platform by measuring instead of by rewriting systems:
+// - LayoutAoS: array of structs, all data of one object next to each other;
+// - LayoutSoA: struct of arrays, one array per data field;
+// - LayoutAoSoA<N>: array of blocks, each block holding one array per field for N objects.
+//
+// Each layout gives out "chunks" of consecutive objects, with accessors to their fields; the
+// systems in LayoutWorld loop over chunks, so the compiler sees plain unit-stride loops for
+// each layout.
+//
+// This is only a measuring ground: the game itself still runs MoveSystem & AvoidanceSystem
+// (systems.h) on its Entities storage, and there is no switch to run it on these layouts.
+// LayoutWorld is a separate copy of just the movement, avoidance and sprite output; avoidance
+// here checks every object against every thing to avoid, unlike the game's grid broadphase, so
+// timings are only comparable between layouts, not with the game. Starting from the game's
+// default state the results match it exactly (the layouts benchmark checks that).
+
+#include "systems.h"
+#include <stdint.h>
+#include <stdio.h>
+
+
+// All the data of an object that systems use.
+struct LayoutObject
+{
+    float x, y;
+    float velx, vely;
+    float colorR, colorG, colorB;
+    int spriteIndex;
+    float scale;
+};
+
+
+// Array of structs.
+struct LayoutAoS
+{
+    struct Chunk
+    {
+        LayoutObject* p;
+        float& X(size_t i) const { return p[i].x; }
+        float& Y(size_t i) const { return p[i].y; }
+        float& VelX(size_t i) const { return p[i].velx; }
+        float& VelY(size_t i) const { return p[i].vely; }
+        float& ColorR(size_t i) const { return p[i].colorR; }
+        float& ColorG(size_t i) const { return p[i].colorG; }
+        float& ColorB(size_t i) const { return p[i].colorB; }
+        int& SpriteIndex(size_t i) const { return p[i].spriteIndex; }
+        float& Scale(size_t i) const { return p[i].scale; }
+    };
+
+    static const char* Name() { return "AoS"; }
+
+    size_t size() const { return m_Objects.size(); }
+    void resize(size_t n) { m_Objects.resize(n); }
+    LayoutObject Get(size_t i) const { return m_Objects[i]; }
+    void Set(size_t i, const LayoutObject& o) { m_Objects[i] = o; }
+
+    // Calls func(chunk, count) for objects [begin,end).
+    template<typename F> void ForEachChunk(size_t begin, size_t end, F func)
+    {
+        if (begin != end)
+            func(Chunk{ m_Objects.data() + begin }, end - begin);
+    }
+
+private:
+    std::vector<LayoutObject> m_Objects;
+};
+
+
+// Struct of arrays.
+struct LayoutSoA
+{
+    struct Chunk
+    {
+        float *x, *y, *velx, *vely, *colorR, *colorG, *colorB;
+        int* spriteIndex;
+        float* scale;
+        float& X(size_t i) const { return x[i]; }
+        float& Y(size_t i) const { return y[i]; }
+        float& VelX(size_t i) const { return velx[i]; }
+        float& VelY(size_t i) const { return vely[i]; }
+        float& ColorR(size_t i) const { return colorR[i]; }
+        float& ColorG(size_t i) const { return colorG[i]; }
+        float& ColorB(size_t i) const { return colorB[i]; }
+        int& SpriteIndex(size_t i) const { return spriteIndex[i]; }
+        float& Scale(size_t i) const { return scale[i]; }
+    };
+
+    static const char* Name() { return "SoA"; }
+
+    size_t size() const { return m_X.size(); }
+    void resize(size_t n)
+    {
+        m_X.resize(n); m_Y.resize(n);
+        m_VelX.resize(n); m_VelY.resize(n);
+        m_ColorR.resize(n); m_ColorG.resize(n); m_ColorB.resize(n);
+        m_SpriteIndex.resize(n);
+        m_Scale.resize(n);
+    }
+    LayoutObject Get(size_t i) const
+    {
+        return LayoutObject{ m_X[i], m_Y[i], m_VelX[i], m_VelY[i], m_ColorR[i], m_ColorG[i], m_ColorB[i], m_SpriteIndex[i], m_Scale[i] };
+    }
+    void Set(size_t i, const LayoutObject& o)
+    {
+        m_X[i] = o.x; m_Y[i] = o.y;
+        m_VelX[i] = o.velx; m_VelY[i] = o.vely;
+        m_ColorR[i] = o.colorR; m_ColorG[i] = o.colorG; m_ColorB[i] = o.colorB;
+        m_SpriteIndex[i] = o.spriteIndex;
+        m_Scale[i] = o.scale;
+    }
+
+    template<typename F> void ForEachChunk(size_t begin, size_t end, F func)
+    {
+        if (begin != end)
+        {
+            func(Chunk{ m_X.data() + begin, m_Y.data() + begin, m_VelX.data() + begin, m_VelY.data() + begin,
+                m_ColorR.data() + begin, m_ColorG.data() + begin, m_ColorB.data() + begin,
+                m_SpriteIndex.data() + begin, m_Scale.data() + begin }, end - begin);
+        }
+    }
+
+private:
+    std::vector<float> m_X, m_Y, m_VelX, m_VelY, m_ColorR, m_ColorG, m_ColorB;
+    std::vector<int> m_SpriteIndex;
+    std::vector<float> m_Scale;
+};
+
+
+// Array of structs of arrays, N objects per block.
+template<int N>
+struct LayoutAoSoA
+{
+    struct Block
+    {
+        float x[N], y[N], velx[N], vely[N], colorR[N], colorG[N], colorB[N];
+        int spriteIndex[N];
+        float scale[N];
+    };
+
+    // objects [first, first+count) of one block
+    struct Chunk
+    {
+        Block* b;
+        size_t first;
+        float& X(size_t i) const { return b->x[first + i]; }
+        float& Y(size_t i) const { return b->y[first + i]; }
+        float& VelX(size_t i) const { return b->velx[first + i]; }
+        float& VelY(size_t i) const { return b->vely[first + i]; }
+        float& ColorR(size_t i) const { return b->colorR[first + i]; }
+        float& ColorG(size_t i) const { return b->colorG[first + i]; }
+        float& ColorB(size_t i) const { return b->colorB[first + i]; }
+        int& SpriteIndex(size_t i) const { return b->spriteIndex[first + i]; }
+        float& Scale(size_t i) const { return b->scale[first + i]; }
+    };
+
+    static const char* Name()
+    {
+        static char name[32];
+        snprintf(name, sizeof(name), "AoSoA<%i>", N);
+        return name;
+    }
+
+    size_t size() const { return m_Count; }
+    void resize(size_t n)
+    {
+        m_Blocks.resize((n + N - 1) / N);
+        m_Count = n;
+    }
+    LayoutObject Get(size_t i) const
+    {
+        const Block& b = m_Blocks[i / N];
+        size_t l = i % N;
+        return LayoutObject{ b.x[l], b.y[l], b.velx[l], b.vely[l], b.colorR[l], b.colorG[l], b.colorB[l], b.spriteIndex[l], b.scale[l] };
+    }
+    void Set(size_t i, const LayoutObject& o)
+    {
+        Block& b = m_Blocks[i / N];
+        size_t l = i % N;
+        b.x[l] = o.x; b.y[l] = o.y;
+        b.velx[l] = o.velx; b.vely[l] = o.vely;
+        b.colorR[l] = o.colorR; b.colorG[l] = o.colorG; b.colorB[l] = o.colorB;
+        b.spriteIndex[l] = o.spriteIndex;
+        b.scale[l] = o.scale;
+    }
+
+    template<typename F> void ForEachChunk(size_t begin, size_t end, F func)
+    {
+        while (begin != end)
+        {
+            size_t first = begin % N;
+            size_t count = std::min<size_t>(N - first, end - begin);
+            func(Chunk{ &m_Blocks[begin / N], first }, count);
+            begin += count;
+        }
+    }
+
+private:
+    std::vector<Block> m_Blocks;
+    size_t m_Count = 0;
+};
+
+
+// The game world (everything the regular game systems do, see game.cpp), with object data in the
+// given layout. Objects are indexed in the order of their entity IDs; the world bounds entity is
+// not stored as an object.
+template<typename Layout>
+struct LayoutWorld
+{
+    Layout objects;
+    WorldBoundsComponent bounds;
+    EntitySet movers; // indices of objects that move
+    EntitySet avoiders; // indices of objects that avoid
+    std::vector<size_t> avoidList; // indices of things to avoid
+    std::vector<float> avoidDistanceList; // squared distances to them
+
+    // Copies the state of the game; returns false if it does not fit into this structure (all
+    // entities except the world bounds one need to have a position & sprite, and things to avoid
+    // should not avoid anything themselves).
+    bool Initialize(const Entities& e, const MoveSystem& move, const AvoidanceSystem& avoidance)
+    {
+        *this = LayoutWorld();
+        std::vector<size_t> index(e.m_Flags.size(), SIZE_MAX);
+        size_t count = 0;
+        for (EntityID id = 0; id != e.m_Flags.size(); ++id)
+        {
+            if (id == move.boundsID)
+                continue;
+            if ((e.m_Flags[id] & (Entities::kFlagPosition | Entities::kFlagSprite)) != (Entities::kFlagPosition | Entities::kFlagSprite))
+                return false;
+            index[id] = count++;
+        }
+        objects.resize(count);
+        for (EntityID id = 0; id != e.m_Flags.size(); ++id)
+        {
+            if (index[id] == SIZE_MAX)
+                continue;
+            const PositionComponent& pos = e.m_Positions[id];
+            const MoveComponent& mv = e.m_Moves[id];
+            const SpriteComponent& spr = e.m_Sprites[id];
+            objects.Set(index[id], LayoutObject{ pos.x, pos.y, mv.velx, mv.vely, spr.colorR, spr.colorG, spr.colorB, spr.spriteIndex, spr.scale });
+        }
+        bounds = e.m_WorldBounds[move.boundsID];
+
+        bool ok = true;
+        move.entities.ForEach([&](EntityID id) { ok &= index[id] != SIZE_MAX; movers.Add(index[id]); });
+        avoidance.objectList.ForEach([&](EntityID id) { ok &= index[id] != SIZE_MAX; avoiders.Add(index[id]); });
+        for (size_t ia = 0; ia != avoidance.avoidList.size(); ++ia)
+        {
+            EntityID id = avoidance.avoidList[ia];
+            ok &= index[id] != SIZE_MAX;
+            avoidance.objectList.ForEachRun([&](EntityID begin, EntityID end) { ok &= id < begin || id >= end; });
+            avoidList.push_back(index[id]);
+            avoidDistanceList.push_back(avoidance.avoidDistanceList[ia]);
+        }
+        return ok;
+    }
+
+    // Same as MoveSystem.
+    void UpdateMove(float deltaTime)
+    {
+        const WorldBoundsComponent b = bounds;
+        movers.ForEachRun([&](size_t begin, size_t end)
+        {
+            objects.ForEachChunk(begin, end, [&](const typename Layout::Chunk& c, size_t count)
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    float& x = c.X(i);
+                    float& y = c.Y(i);
+                    float& velx = c.VelX(i);
+                    float& vely = c.VelY(i);
+                    x += velx * deltaTime;
+                    y += vely * deltaTime;
+                    if (x < b.xMin) { velx = -velx; x = b.xMin; }
+                    if (x > b.xMax) { velx = -velx; x = b.xMax; }
+                    if (y < b.yMin) { vely = -vely; y = b.yMin; }
+                    if (y > b.yMax) { vely = -vely; y = b.yMax; }
+                }
+            });
+        });
+    }
+
+    // Same as AvoidanceSystem. Things to avoid are never avoiders, so their data does not change
+    // while the system runs; it gets copied out upfront.
+    void UpdateAvoidance(float deltaTime)
+    {
+        size_t na = avoidList.size();
+        std::vector<LayoutObject> avoid(na);
+        for (size_t ia = 0; ia != na; ++ia)
+            avoid[ia] = objects.Get(avoidList[ia]);
+        const float* avDistance = avoidDistanceList.data();
+
+        avoiders.ForEachRun([&](size_t begin, size_t end)
+        {
+            objects.ForEachChunk(begin, end, [&](const typename Layout::Chunk& c, size_t count)
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    for (size_t ia = 0; ia != na; ++ia)
+                    {
+                        float dx = c.X(i) - avoid[ia].x;
+                        float dy = c.Y(i) - avoid[ia].y;
+                        if (dx * dx + dy * dy < avDistance[ia])
+                        {
+                            c.VelX(i) = -c.VelX(i);
+                            c.VelY(i) = -c.VelY(i);
+                            c.X(i) += c.VelX(i) * deltaTime * 1.1f;
+                            c.Y(i) += c.VelY(i) * deltaTime * 1.1f;
+                            c.ColorR(i) = avoid[ia].colorR;
+                            c.ColorG(i) = avoid[ia].colorG;
+                            c.ColorB(i) = avoid[ia].colorB;
+                        }
+                    }
+                }
+            });
+        });
+    }
+
+    // Same as the sprite data output of game_update; returns amount of sprites.
+    int WriteSprites(sprite_data_t* data)
+    {
+        const float globalScale = 0.05f;
+        objects.ForEachChunk(0, objects.size(), [&](const typename Layout::Chunk& c, size_t count)
+        {
+            for (size_t i = 0; i != count; ++i)
+            {
+                sprite_data_t& spr = data[i];
+                spr.posX = c.X(i) * globalScale;
+                spr.posY = c.Y(i) * globalScale;
+                spr.scale = c.Scale(i) * globalScale;
+                spr.colR = c.ColorR(i);
+                spr.colG = c.ColorG(i);
+                spr.colB = c.ColorB(i);
+                spr.sprite = (float)c.SpriteIndex(i);
+            }
+            data += count;
+        });
+        return (int)objects.size();
+    }
+
+    int Update(sprite_data_t* data, double time, float deltaTime)
+    {
+        UpdateMove(deltaTime);
+        UpdateAvoidance(deltaTime);
+        return WriteSprites(data);
+    }
+};
@@ -0,0 +1,122 @@
+#include "multiworld.h"
+#include <math.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define MULTIWORLD_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define MULTIWORLD_USE_SSE 0
+#endif
+
+
+static float RandomFloat01() { return (float)rand() / (float)RAND_MAX; }
+static float RandomFloat(float from, float to) { return RandomFloat01() * (to - from) + from; }
+
+
+void MultiWorld::Initialize(const std::vector<MultiWorldParams>& params, int objectsPerWorld)
+{
+    worldCount = (int)params.size();
+    groupCount = (worldCount + kLanes - 1) / kLanes;
+    objectCount = objectsPerWorld;
+
+    size_t laneCount = (size_t)groupCount * kLanes;
+    size_t dataCount = laneCount * objectCount;
+    posX.assign(dataCount, 0.0f);
+    posY.assign(dataCount, 0.0f);
+    velX.assign(dataCount, 0.0f);
+    velY.assign(dataCount, 0.0f);
+
+    // bounds of padding lanes in the last group are copied from the last world; they have objects
+    // that never move, so these lanes just do useless (but harmless) work
+    xMin.resize(laneCount);
+    xMax.resize(laneCount);
+    yMin.resize(laneCount);
+    yMax.resize(laneCount);
+    for (size_t lane = 0; lane < laneCount; ++lane)
+    {
+        const MultiWorldParams& p = params[lane < (size_t)worldCount ? lane : worldCount - 1];
+        xMin[lane] = p.xMin;
+        xMax[lane] = p.xMax;
+        yMin[lane] = p.yMin;
+        yMax[lane] = p.yMax;
+    }
+
+    // objects are created world by world, same as game_initialize would do for each of them
+    for (int w = 0; w < worldCount; ++w)
+    {
+        const MultiWorldParams& p = params[w];
+        for (int i = 0; i < objectCount; ++i)
+        {
+            size_t idx = DataIndex(w, i);
+            posX[idx] = RandomFloat(p.xMin, p.xMax);
+            posY[idx] = RandomFloat(p.yMin, p.yMax);
+            float angle = RandomFloat01() * 3.1415926f * 2;
+            float speed = RandomFloat(p.minSpeed, p.maxSpeed);
+            velX[idx] = cosf(angle) * speed;
+            velY[idx] = sinf(angle) * speed;
+        }
+    }
+}
+
+
+void MultiWorld::UpdateSystem(float deltaTime)
+{
+    for (int g = 0; g < groupCount; ++g)
+    {
+        float* px = posX.data() + (size_t)g * objectCount * kLanes;
+        float* py = posY.data() + (size_t)g * objectCount * kLanes;
+        float* vx = velX.data() + (size_t)g * objectCount * kLanes;
+        float* vy = velY.data() + (size_t)g * objectCount * kLanes;
+        const float* bxMin = xMin.data() + g * kLanes;
+        const float* bxMax = xMax.data() + g * kLanes;
+        const float* byMin = yMin.data() + g * kLanes;
+        const float* byMax = yMax.data() + g * kLanes;
+
+#if MULTIWORLD_USE_SSE
+        const __m128 dt = _mm_set1_ps(deltaTime);
+        const __m128 signBit = _mm_set1_ps(-0.0f);
+        const __m128 xmin = _mm_loadu_ps(bxMin), xmax = _mm_loadu_ps(bxMax);
+        const __m128 ymin = _mm_loadu_ps(byMin), ymax = _mm_loadu_ps(byMax);
+        for (int i = 0; i < objectCount * kLanes; i += kLanes)
+        {
+            // update position based on movement velocity & delta time
+            __m128 x = _mm_add_ps(_mm_loadu_ps(px + i), _mm_mul_ps(_mm_loadu_ps(vx + i), dt));
+            __m128 y = _mm_add_ps(_mm_loadu_ps(py + i), _mm_mul_ps(_mm_loadu_ps(vy + i), dt));
+            __m128 velx = _mm_loadu_ps(vx + i);
+            __m128 vely = _mm_loadu_ps(vy + i);
+
+            // check against world bounds of each lane; mirror the velocity (flip sign bit) where
+            // out of bounds, and clamp position back onto bounds
+            velx = _mm_xor_ps(velx, _mm_and_ps(_mm_cmplt_ps(x, xmin), signBit));
+            x = _mm_max_ps(x, xmin);
+            velx = _mm_xor_ps(velx, _mm_and_ps(_mm_cmpgt_ps(x, xmax), signBit));
+            x = _mm_min_ps(x, xmax);
+            vely = _mm_xor_ps(vely, _mm_and_ps(_mm_cmplt_ps(y, ymin), signBit));
+            y = _mm_max_ps(y, ymin);
+            vely = _mm_xor_ps(vely, _mm_and_ps(_mm_cmpgt_ps(y, ymax), signBit));
+            y = _mm_min_ps(y, ymax);
+
+            _mm_storeu_ps(px + i, x);
+            _mm_storeu_ps(py + i, y);
+            _mm_storeu_ps(vx + i, velx);
+            _mm_storeu_ps(vy + i, vely);
+        }
+#else
+        for (int i = 0; i < objectCount * kLanes; i += kLanes)
+        {
+            for (int l = 0; l < kLanes; ++l)
+            {
+                float& x = px[i + l];
+                float& y = py[i + l];
+                x += vx[i + l] * deltaTime;
+                y += vy[i + l] * deltaTime;
+                if (x < bxMin[l]) { vx[i + l] = -vx[i + l]; x = bxMin[l]; }
+                if (x > bxMax[l]) { vx[i + l] = -vx[i + l]; x = bxMax[l]; }
+                if (y < byMin[l]) { vy[i + l] = -vy[i + l]; y = byMin[l]; }
+                if (y > byMax[l]) { vy[i + l] = -vy[i + l]; y = byMax[l]; }
+            }
+        }
+#endif
+    }
+}
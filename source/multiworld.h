@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+
+// -------------------------------------------------------------------------------------------------
+// Batched simulation of many small, independent "worlds" (e.g. for parameter sweeps).
+//
+// Running thousands of tiny worlds one by one is dominated by per-world overhead, and a loop over
+// ~1000 entities does not use SIMD well either. Here instead the data of kLanes worlds is
+// interleaved: entity i of worlds w0..w3 sits next to each other in memory, so one SIMD register
+// holds "the same entity" of four different worlds. The move & bounce logic (same as MoveSystem
+// in game.cpp) then runs one world per SIMD lane, each lane with its own world bounds.
+
+
+// Per-world parameters: world bounds, and movement speed range for its objects
+struct MultiWorldParams
+{
+    float xMin, xMax, yMin, yMax;
+    float minSpeed, maxSpeed;
+};
+
+
+struct MultiWorld
+{
+    enum { kLanes = 4 };
+
+    // number of worlds, number of world groups (worlds rounded up to kLanes), objects in each world
+    int worldCount = 0;
+    int groupCount = 0;
+    int objectCount = 0;
+
+    // object data, laid out as [group][object][lane]
+    std::vector<float> posX, posY;
+    std::vector<float> velX, velY;
+
+    // per-world bounds, laid out as [group][lane]
+    std::vector<float> xMin, xMax, yMin, yMax;
+
+    // Creates worlds (one for each params entry), each with objectCount randomly placed & moving objects.
+    void Initialize(const std::vector<MultiWorldParams>& params, int objectsPerWorld);
+
+    // Moves objects of all worlds, bouncing off their world bounds.
+    void UpdateSystem(float deltaTime);
+
+    size_t DataIndex(int world, int object) const
+    {
+        return ((size_t)(world / kLanes) * objectCount + object) * kLanes + world % kLanes;
+    }
+};
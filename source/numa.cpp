@@ -0,0 +1,116 @@
+#include "numa.h"
+#include <thread>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+
+static std::vector<std::vector<int>> FindNodeCpus()
+{
+    std::vector<std::vector<int>> nodes;
+    #ifdef _WIN32
+    ULONG highest = 0;
+    if (GetNumaHighestNodeNumber(&highest))
+    {
+        for (ULONG node = 0; node <= highest; ++node)
+        {
+            ULONGLONG mask = 0;
+            if (!GetNumaNodeProcessorMask((UCHAR)node, &mask) || mask == 0)
+                continue;
+            nodes.emplace_back();
+            for (int cpu = 0; cpu < 64; ++cpu)
+                if (mask & (1ull << cpu))
+                    nodes.back().push_back(cpu);
+        }
+    }
+    #elif defined(__linux__)
+    // /sys/devices/system/node/nodeN/cpulist has CPU lists like "0-3,8-11"
+    for (int node = 0; node < 1024; ++node)
+    {
+        char path[100];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%i/cpulist", node);
+        FILE* f = fopen(path, "r");
+        if (f == NULL)
+        {
+            if (node == 0)
+                continue; // node numbers might not start at zero
+            break;
+        }
+        std::vector<int> cpus;
+        int from, to;
+        while (fscanf(f, "%i", &from) == 1)
+        {
+            to = from;
+            int c = fgetc(f);
+            if (c == '-' && fscanf(f, "%i", &to) == 1)
+                c = fgetc(f);
+            for (int cpu = from; cpu <= to; ++cpu)
+                cpus.push_back(cpu);
+            if (c != ',')
+                break;
+        }
+        fclose(f);
+        if (!cpus.empty())
+            nodes.push_back(cpus);
+    }
+    #endif
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        for (int cpu = 0, n = std::max(1, (int)std::thread::hardware_concurrency()); cpu < n; ++cpu)
+            nodes.back().push_back(cpu);
+    }
+    return nodes;
+}
+
+const std::vector<std::vector<int>>& NumaNodeCpus()
+{
+    static std::vector<std::vector<int>> s_Nodes = FindNodeCpus();
+    return s_Nodes;
+}
+
+
+bool NumaMoveToNode(void* ptr, size_t size, int node)
+{
+    #if defined(__linux__) && defined(SYS_mbind)
+    if (node < 0 || node >= 64)
+        return false;
+    const int kBind = 2; // MPOL_BIND
+    const unsigned kMove = 1 << 1; // MPOL_MF_MOVE: move pages that are already there
+    uintptr_t pageSize = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t begin = ((uintptr_t)ptr + pageSize - 1) & ~(pageSize - 1);
+    uintptr_t end = ((uintptr_t)ptr + size) & ~(pageSize - 1);
+    if (begin >= end)
+        return true;
+    unsigned long mask = 1ul << node;
+    return syscall(SYS_mbind, begin, end - begin, kBind, &mask, sizeof(mask) * 8, kMove) == 0;
+    #else
+    return false;
+    #endif
+}
+
+
+bool NumaPinThread(int cpu)
+{
+    #ifdef _WIN32
+    return cpu < (int)sizeof(DWORD_PTR) * 8 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+    #elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    #else
+    return false; // macOS only has affinity hints
+    #endif
+}
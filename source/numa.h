@@ -0,0 +1,19 @@
+#pragma once
+
+// NUMA (non-uniform memory access) support. On machines with several memory nodes (typically one
+// per CPU socket), memory is much faster to access from CPUs of the node that holds it, so threads
+// should be kept on one node and work on data placed on that same node.
+
+#include <stddef.h>
+#include <vector>
+
+// CPUs of each NUMA node. When the machine is not NUMA (or that can't be found out), it is one node
+// with all CPUs.
+const std::vector<std::vector<int>>& NumaNodeCpus();
+
+// Moves pages of the memory range onto the given node. Only whole pages within the range are moved.
+// Supported on Linux only (without needing libnuma); elsewhere does nothing and returns false.
+bool NumaMoveToNode(void* ptr, size_t size, int node);
+
+// Pins the calling thread to a CPU; returns false if not supported or failed.
+bool NumaPinThread(int cpu);
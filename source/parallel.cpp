@@ -0,0 +1,182 @@
+#include "parallel.h"
+#include "numa.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
+
+
+// Worker threads are started on first use, and wait for jobs. A job is given to the first
+// threadCount-1 workers ("helpers"), and the calling thread works on it too; NUMA jobs go to the
+// first threadCount workers, and the calling thread just waits for them.
+struct ThreadPool
+{
+    enum { kMaxParts = 64 };
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned generation = 0; // incremented for each new job
+    bool quit = false;
+
+    // current job: items of each part are handed out in chunks
+    const std::function<void(size_t, size_t)>* func = nullptr;
+    size_t chunkSize = 1;
+    std::vector<ParallelNodePart> parts;
+    std::atomic<size_t> nextChunk[kMaxParts];
+    bool numa = false;
+    int helpers = 0; // workers that take part in it
+    int busy = 0; // helpers that did not finish yet
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread& t : threads)
+            t.join();
+    }
+
+    void RunChunks(size_t part)
+    {
+        size_t begin = parts[part].begin, end = parts[part].end;
+        size_t chunk;
+        while ((chunk = nextChunk[part].fetch_add(1)) * chunkSize < end - begin)
+        {
+            size_t first = begin + chunk * chunkSize;
+            (*func)(first, std::min(first + chunkSize, end));
+        }
+    }
+
+    void WorkerLoop(int index)
+    {
+        unsigned seen = 0;
+        bool pinned = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]() { return quit || generation != seen; });
+            if (quit)
+                return;
+            seen = generation;
+            if (index >= helpers)
+                continue;
+            size_t part = 0;
+            if (numa)
+            {
+                int node = WorkerNode(index);
+                while (part < parts.size() && parts[part].node != node)
+                    ++part;
+            }
+            lock.unlock();
+            if (numa && !pinned)
+                pinned = NumaPinThread(WorkerCpu(index));
+            if (part < parts.size())
+                RunChunks(part);
+            lock.lock();
+            if (--busy == 0)
+                done.notify_one();
+        }
+    }
+
+    // Workers are assigned to CPUs alternating between nodes: first CPU of each node, then second
+    // CPU of each node, etc.; so any number of first workers is spread evenly over nodes.
+    static const std::vector<std::pair<int, int>>& WorkerOrder()
+    {
+        static std::vector<std::pair<int, int>> s_Order = []()
+        {
+            const std::vector<std::vector<int>>& nodes = NumaNodeCpus();
+            std::vector<std::pair<int, int>> order;
+            for (size_t i = 0; order.size() < (size_t)std::max(1, (int)std::thread::hardware_concurrency()) && i < 4096; ++i)
+            {
+                for (size_t node = 0; node < nodes.size(); ++node)
+                    if (i < nodes[node].size())
+                        order.emplace_back((int)node, nodes[node][i]);
+            }
+            if (order.empty())
+                order.emplace_back(0, 0);
+            return order;
+        }();
+        return s_Order;
+    }
+    static int WorkerNode(int index) { return WorkerOrder()[index % WorkerOrder().size()].first; }
+    static int WorkerCpu(int index) { return WorkerOrder()[index % WorkerOrder().size()].second; }
+};
+
+static ThreadPool s_Pool;
+
+
+std::vector<ParallelNodePart> ParallelNumaSplit(size_t count, int threadCount)
+{
+    threadCount = std::max(threadCount, 1);
+    std::vector<int> workersOnNode;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        int node = ThreadPool::WorkerNode(i);
+        if ((int)workersOnNode.size() <= node)
+            workersOnNode.resize(node + 1, 0);
+        workersOnNode[node]++;
+    }
+    std::vector<ParallelNodePart> parts;
+    int workersBefore = 0;
+    for (int node = 0; node < (int)workersOnNode.size() && (int)parts.size() < ThreadPool::kMaxParts; ++node)
+    {
+        if (workersOnNode[node] == 0)
+            continue;
+        size_t begin = count * workersBefore / threadCount;
+        workersBefore += workersOnNode[node];
+        parts.push_back({ node, begin, count * workersBefore / threadCount });
+    }
+    parts.back().end = count;
+    return parts;
+}
+
+
+void ParallelFor(size_t count, const ParallelSettings& settings, const std::function<void(size_t begin, size_t end)>& func)
+{
+    size_t chunkSize = std::max<size_t>(settings.chunkSize, 1);
+    int helpers = settings.numa ? settings.threadCount : (int)std::min<size_t>(settings.threadCount, (count + chunkSize - 1) / chunkSize) - 1;
+    if (helpers <= 0 || count == 0)
+    {
+        if (count != 0)
+            func(0, count);
+        return;
+    }
+
+    ThreadPool& pool = s_Pool;
+    std::unique_lock<std::mutex> lock(pool.mutex);
+    while ((int)pool.threads.size() < helpers)
+    {
+        int index = (int)pool.threads.size();
+        pool.threads.emplace_back([index]() { s_Pool.WorkerLoop(index); });
+    }
+    pool.func = &func;
+    pool.chunkSize = chunkSize;
+    pool.numa = settings.numa;
+    if (settings.numa)
+        pool.parts = ParallelNumaSplit(count, settings.threadCount);
+    else
+        pool.parts.assign(1, ParallelNodePart{ 0, 0, count });
+    for (size_t i = 0; i < pool.parts.size(); ++i)
+        pool.nextChunk[i] = 0;
+    pool.helpers = helpers;
+    pool.busy = helpers;
+    pool.generation++;
+    lock.unlock();
+    pool.wake.notify_all();
+
+    if (!settings.numa)
+        pool.RunChunks(0);
+
+    lock.lock();
+    pool.done.wait(lock, [&]() { return pool.busy == 0; });
+}
+
+
+int ParallelMaxThreads()
+{
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
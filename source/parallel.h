@@ -0,0 +1,37 @@
+#pragma once
+
+// Simple "parallel for" on a pool of worker threads.
+
+#include <stddef.h>
+#include <functional>
+#include <vector>
+
+
+// How a loop gets split for parallel execution: number of items in one chunk, and number of
+// threads to run chunks on (1 means just run the loop serially).
+//
+// With numa set, worker threads are pinned to CPUs (spread evenly over NUMA nodes), items are
+// split into one contiguous part per node (sized by how many of the threads are on it), and chunks
+// of each part are only processed by threads of that node; so data placed with ParallelNumaSplit
+// is always processed on the node that holds it.
+struct ParallelSettings
+{
+    size_t chunkSize = 4096;
+    int threadCount = 1;
+    bool numa = false;
+};
+
+// Calls func(begin, end) for chunks of [0,count), and returns once all of them are done. Chunks
+// are handed out to threads dynamically, so uneven cost of items evens out.
+void ParallelFor(size_t count, const ParallelSettings& settings, const std::function<void(size_t begin, size_t end)>& func);
+
+// Number of hardware threads.
+int ParallelMaxThreads();
+
+// Items [begin,end) processed on a NUMA node, when running with numa settings.
+struct ParallelNodePart
+{
+    int node;
+    size_t begin, end;
+};
+std::vector<ParallelNodePart> ParallelNumaSplit(size_t count, int threadCount);
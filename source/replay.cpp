@@ -0,0 +1,636 @@
+#include "replay.h"
+#include "entities.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define REPLAY_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define REPLAY_USE_SSE 0
+#endif
+
+#ifdef _MSC_VER
+#define ftell64 _ftelli64
+#define fseek64 _fseeki64
+#else
+#define ftell64 ftello
+#define fseek64 fseeko
+#endif
+
+
+// Replay file layout:
+// - ReplayHeader
+// - keyframe blobs, each: KeyframeHeader, stream sizes, encoded stream data (a stream for each
+//   component array, see GetStreamRuns)
+// - ReplayFrame for every frame, ReplayKeyframe for every keyframe
+// - ReplayFooter
+
+static const uint32_t kReplayMagic = 0x52444F44; // "DODR"
+static const uint32_t kReplayVersion = 7; // 2: MoveSystem moves objects by their IDs; 3: animation components; 4: emitter & lifetime components; 5: random state of emitters; 6: whole game config; 7: components only of entities that have them
+
+// every this many keyframes, one is stored as-is ("intra") instead of delta against the previous
+// one; this bounds how many keyframes have to be decoded when seeking
+static const int kIntraKeyframeInterval = 16;
+
+struct ReplayHeader
+{
+    uint32_t magic, version;
+    game_config_t config;
+    int32_t keyframeInterval;
+};
+
+struct ReplayFrame
+{
+    double time;
+    float deltaTime;
+    uint32_t padding;
+};
+
+struct ReplayKeyframe
+{
+    int32_t frame;
+    int32_t intra;
+    int64_t offset;
+};
+
+struct ReplayFooter
+{
+    int32_t frameCount, keyframeCount;
+    int64_t tablesOffset;
+    uint32_t magic, padding;
+};
+
+struct KeyframeHeader
+{
+    int32_t intra;
+    int32_t streamCount;
+    int64_t encodedSize;
+};
+
+
+// -------------------------------------------------------------------------------------------------
+// Keyframe data encoding. The state is just raw bytes of component arrays, and between keyframes
+// most of it does not change at all (bounds, flags, colors), or changes only in lower mantissa bits
+// (positions). So data is treated as 32 bit words, each stored as a zigzag-encoded difference from
+// the previous keyframe. Groups of four words get a control byte with 2 bits per word: how many lower
+// bytes of the difference are stored (0, 2, 3 or 4). Zero control byte (whole group unchanged) is
+// followed by a count of additional unchanged groups. Simple enough to run at memory bandwidth speeds.
+
+static const int kCodeLength[4] = { 0, 2, 3, 4 };
+static const uint32_t kCodeMask[4] = { 0, 0xFFFF, 0xFFFFFF, 0xFFFFFFFF };
+
+static size_t MaxEncodedSize(size_t wordCount)
+{
+    size_t groupCount = (wordCount + 3) / 4;
+    return wordCount * 4 + groupCount + 8;
+}
+
+static inline uint32_t ZigZag(uint32_t delta) { return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31); }
+static inline uint32_t UnZigZag(uint32_t v) { return (v >> 1) ^ (0u - (v & 1)); }
+
+static inline bool GroupEqual(const uint32_t* a, const uint32_t* b)
+{
+    uint64_t a0, a1, b0, b1;
+    memcpy(&a0, a, 8); memcpy(&a1, a + 2, 8);
+    memcpy(&b0, b, 8); memcpy(&b1, b + 2, 8);
+    return ((a0 ^ b0) | (a1 ^ b1)) == 0;
+}
+
+static inline uint8_t* EncodeGroup(const uint32_t v[4], uint8_t* dst)
+{
+    uint8_t* control = dst++;
+    uint8_t codes = 0;
+    for (int j = 0; j < 4; ++j)
+    {
+        int code = (v[j] != 0) + (v[j] > 0xFFFF) + (v[j] > 0xFFFFFF);
+        codes |= code << (j * 2);
+        // always writes 4 bytes (little endian), but advances only by the needed amount
+        memcpy(dst, &v[j], 4);
+        dst += kCodeLength[code];
+    }
+    *control = codes;
+    return dst;
+}
+
+#if REPLAY_USE_SSE
+// Encodes a group of four words like EncodeGroup (differences from prev, or as-is if intra), with
+// all four at once; the code of a word is 3 minus how many of the value, and its bits from 16 and
+// from 24 up, are zero. Returns false (writing nothing) if the group did not change.
+static inline bool EncodeGroupSSE(const uint32_t* data, uint32_t* prev, bool intra, uint8_t*& dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i d = _mm_loadu_si128((const __m128i*)data), delta = d;
+    if (!intra)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*)prev);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(d, p)) == 0xFFFF)
+            return false;
+        delta = _mm_sub_epi32(d, p);
+    }
+    __m128i zz = _mm_xor_si128(_mm_slli_epi32(delta, 1), _mm_srai_epi32(delta, 31));
+    __m128i zeros = _mm_add_epi32(_mm_cmpeq_epi32(zz, zero),
+        _mm_add_epi32(_mm_cmpeq_epi32(_mm_srli_epi32(zz, 16), zero), _mm_cmpeq_epi32(_mm_srli_epi32(zz, 24), zero)));
+    __m128i code = _mm_add_epi32(_mm_set1_epi32(3), zeros);
+    uint32_t codeBytes = (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(_mm_packs_epi32(code, zero), zero));
+    _mm_storeu_si128((__m128i*)prev, d);
+    if (codeBytes == 0)
+        return false; // (only zeroes, when intra)
+    uint8_t codes = (uint8_t)((codeBytes & 3) | ((codeBytes >> 6) & 0xC) | ((codeBytes >> 12) & 0x30) | ((codeBytes >> 18) & 0xC0));
+    uint32_t v[4];
+    _mm_storeu_si128((__m128i*)v, zz);
+    *dst++ = codes;
+    for (int j = 0; j < 4; ++j)
+    {
+        // always writes 4 bytes (little endian), but advances only by the needed amount
+        memcpy(dst, &v[j], 4);
+        dst += kCodeLength[(codes >> (j * 2)) & 3];
+    }
+    return true;
+}
+#endif
+
+// Encodes data as difference from prev (or as-is if intra), and updates prev to the new data.
+// Returns encoded size.
+static size_t EncodeDelta(const uint32_t* data, uint32_t* prev, bool intra, size_t wordCount, uint8_t* out)
+{
+    uint8_t* dst = out;
+    uint8_t* zeroRun = NULL; // count byte of the currently open run of unchanged groups
+    for (size_t i = 0; i < wordCount; i += 4)
+    {
+        uint32_t v[4] = {};
+#if REPLAY_USE_SSE
+        if (i + 4 <= wordCount)
+        {
+            // (unchanged groups go into a run of those below)
+            if (EncodeGroupSSE(data + i, prev + i, intra, dst))
+            {
+                zeroRun = NULL;
+                continue;
+            }
+        }
+        else
+#endif
+        if (i + 4 <= wordCount && !intra && GroupEqual(data + i, prev + i))
+        {
+            // common case of unchanged data; no need to update prev either
+        }
+        else if (i + 4 <= wordCount)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                uint32_t d = data[i + j];
+                v[j] = intra ? ZigZag(d) : ZigZag(d - prev[i + j]);
+                prev[i + j] = d;
+            }
+        }
+        else
+        {
+            for (size_t j = 0; i + j < wordCount; ++j)
+            {
+                uint32_t d = data[i + j];
+                v[j] = intra ? ZigZag(d) : ZigZag(d - prev[i + j]);
+                prev[i + j] = d;
+            }
+        }
+
+        if ((v[0] | v[1] | v[2] | v[3]) == 0)
+        {
+            if (zeroRun != NULL && *zeroRun < 255)
+            {
+                ++*zeroRun;
+                continue;
+            }
+            *dst++ = 0;
+            zeroRun = dst;
+            *dst++ = 0;
+            continue;
+        }
+        zeroRun = NULL;
+        dst = EncodeGroup(v, dst);
+    }
+    return dst - out;
+}
+
+// Decodes data in place over the previous state (or from scratch if intra); returns end of encoded data.
+static const uint8_t* DecodeDelta(const uint8_t* src, bool intra, size_t wordCount, uint32_t* data)
+{
+    size_t i = 0;
+    while (i < wordCount)
+    {
+        uint8_t codes = *src++;
+        if (codes == 0)
+        {
+            size_t count = std::min((1 + (size_t)*src++) * 4, wordCount - i);
+            if (intra)
+                memset(data + i, 0, count * 4);
+            i += count;
+            continue;
+        }
+        for (int j = 0; j < 4; ++j, ++i)
+        {
+            int code = (codes >> (j * 2)) & 3;
+            uint32_t v;
+            memcpy(&v, src, 4);
+            src += kCodeLength[code];
+            if (i < wordCount)
+            {
+                uint32_t delta = UnZigZag(v & kCodeMask[code]);
+                data[i] = intra ? delta : data[i] + delta;
+            }
+        }
+    }
+    return src;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Keyframe streams. Data of components that an entity does not have is never used, so each component
+// array is stored only for entities that have its flag (and flags themselves, first, for all of them).
+// Runs of consecutive entities that have a component are encoded right where they are in the array,
+// one after another; which runs there are is known from the flags, so decoding needs nothing more.
+
+typedef std::vector<std::pair<size_t, size_t>> EntityRuns;
+
+// component flag of each stream (zero for the flags themselves)
+static std::vector<int> GetStreamFlags()
+{
+    std::vector<int> streamFlags;
+    Entities().ForEachComponentArray([&](void*, size_t, int flag) { streamFlags.push_back(flag); });
+    return streamFlags;
+}
+
+// Runs [begin,end) of consecutive entities that have all the same flags, with those flags.
+static void GetFlagRuns(const int* flags, size_t count, std::vector<std::pair<EntityRuns::value_type, int>>& flagRuns)
+{
+    flagRuns.clear();
+    for (size_t i = 0; i < count; )
+    {
+        size_t begin = i++;
+#if REPLAY_USE_SSE
+        // long runs are common (whole pools of particles), skip through them 4 flags at a time
+        __m128i flag = _mm_set1_epi32(flags[begin]);
+        while (i + 4 <= count && _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(flags + i)), flag)) == 0xFFFF)
+            i += 4;
+#endif
+        while (i < count && flags[i] == flags[begin])
+            ++i;
+        flagRuns.push_back(std::make_pair(std::make_pair(begin, i), flags[begin]));
+    }
+}
+
+// Runs of entities that have the flag (all of them for a zero flag), from runs of equal flags;
+// returns the number of entities in them.
+static size_t GetStreamRuns(const std::vector<std::pair<EntityRuns::value_type, int>>& flagRuns, int flag, EntityRuns& runs)
+{
+    runs.clear();
+    size_t count = 0;
+    for (const auto& flagRun : flagRuns)
+    {
+        if (flag != 0 && !(flagRun.second & flag))
+            continue;
+        if (!runs.empty() && runs.back().second == flagRun.first.first)
+            runs.back().second = flagRun.first.second;
+        else
+            runs.push_back(flagRun.first);
+        count += flagRun.first.second - flagRun.first.first;
+    }
+    return count;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// recording
+// -------------------------------------------------------------------------------------------------
+// recording
+
+struct ReplayRecorder
+{
+    FILE* file = NULL;
+    ReplayHeader header;
+    int frameIndex = 0;
+    int keyframesSinceIntra = 0;
+    std::vector<ReplayFrame> frames;
+    std::vector<ReplayKeyframe> keyframes;
+    // raw state at previous keyframe, and sizes of each stream in it
+    std::vector<uint32_t> prevState;
+    std::vector<int64_t> prevSizes;
+    std::vector<uint8_t> encoded;
+    // runs of entities with equal flags, and ones that go into each stream
+    std::vector<std::pair<EntityRuns::value_type, int>> flagRuns;
+    std::vector<EntityRuns> runs;
+};
+
+static ReplayRecorder s_Recorder;
+
+
+static void RecordKeyframe()
+{
+    ReplayRecorder& rec = s_Recorder;
+    Entities& entities = GetGameEntities();
+
+    // which entities of each array go into its stream
+    GetFlagRuns(entities.m_Flags.data(), entities.m_Flags.size(), rec.flagRuns);
+    std::vector<int64_t> sizes;
+    std::vector<const uint8_t*> arrays;
+    std::vector<size_t> elementSizes;
+    size_t totalSize = 0;
+    entities.ForEachComponentArray([&](void* array, size_t size, int flag)
+    {
+        if (rec.runs.size() <= sizes.size())
+            rec.runs.resize(sizes.size() + 1);
+        size_t count = GetStreamRuns(rec.flagRuns, flag, rec.runs[sizes.size()]);
+        size_t elementSize = entities.m_Flags.empty() ? 0 : size / entities.m_Flags.size();
+        sizes.push_back(count * elementSize);
+        arrays.push_back((const uint8_t*)array);
+        elementSizes.push_back(elementSize);
+        totalSize += count * elementSize;
+    });
+
+    bool intra = sizes != rec.prevSizes || rec.keyframesSinceIntra >= kIntraKeyframeInterval - 1 || rec.keyframes.empty();
+    rec.keyframesSinceIntra = intra ? 0 : rec.keyframesSinceIntra + 1;
+    rec.prevSizes = sizes;
+    rec.prevState.resize(totalSize / 4);
+    size_t runCount = 0;
+    for (size_t s = 0; s < sizes.size(); ++s)
+        runCount += rec.runs[s].size();
+    rec.encoded.resize(MaxEncodedSize(totalSize / 4) + runCount * 16);
+
+    // encode each run of each stream, and remember them as reference for the next keyframe
+    size_t encodedSize = 0;
+    size_t stateOffset = 0;
+    for (size_t s = 0; s < sizes.size(); ++s)
+    {
+        for (const auto& run : rec.runs[s])
+        {
+            size_t words = (run.second - run.first) * elementSizes[s] / 4;
+            const uint32_t* data = (const uint32_t*)(arrays[s] + run.first * elementSizes[s]);
+            encodedSize += EncodeDelta(data, rec.prevState.data() + stateOffset, intra, words, rec.encoded.data() + encodedSize);
+            stateOffset += words;
+        }
+    }
+
+    ReplayKeyframe key;
+    key.frame = rec.frameIndex;
+    key.intra = intra;
+    key.offset = ftell64(rec.file);
+    rec.keyframes.push_back(key);
+
+    KeyframeHeader kh;
+    kh.intra = intra;
+    kh.streamCount = (int32_t)sizes.size();
+    kh.encodedSize = encodedSize;
+    fwrite(&kh, sizeof(kh), 1, rec.file);
+    fwrite(sizes.data(), sizeof(sizes[0]), sizes.size(), rec.file);
+    fwrite(rec.encoded.data(), 1, encodedSize, rec.file);
+}
+
+
+extern "C" int replay_record_begin(const char* path, const game_config_t* config, int keyframeInterval)
+{
+    replay_record_end();
+    if (config->variant != GAME_VARIANT_DOD)
+        return 0; // keyframes are snapshots of the entity data of game.cpp
+    ReplayRecorder& rec = s_Recorder;
+    rec.file = fopen(path, "wb");
+    if (rec.file == NULL)
+        return 0;
+    rec.header.magic = kReplayMagic;
+    rec.header.version = kReplayVersion;
+    rec.header.config = *config;
+    rec.header.keyframeInterval = std::max(keyframeInterval, 1);
+    fwrite(&rec.header, sizeof(rec.header), 1, rec.file);
+    return 1;
+}
+
+
+extern "C" void replay_record_frame(double time, float deltaTime)
+{
+    ReplayRecorder& rec = s_Recorder;
+    if (rec.file == NULL)
+        return;
+    if (rec.frameIndex % rec.header.keyframeInterval == 0)
+        RecordKeyframe();
+    ReplayFrame frame = { time, deltaTime, 0 };
+    rec.frames.push_back(frame);
+    ++rec.frameIndex;
+}
+
+
+extern "C" void replay_record_end(void)
+{
+    ReplayRecorder& rec = s_Recorder;
+    if (rec.file == NULL)
+        return;
+    ReplayFooter footer;
+    footer.frameCount = (int32_t)rec.frames.size();
+    footer.keyframeCount = (int32_t)rec.keyframes.size();
+    footer.tablesOffset = ftell64(rec.file);
+    footer.magic = kReplayMagic;
+    footer.padding = 0;
+    fwrite(rec.frames.data(), sizeof(rec.frames[0]), rec.frames.size(), rec.file);
+    fwrite(rec.keyframes.data(), sizeof(rec.keyframes[0]), rec.keyframes.size(), rec.file);
+    fwrite(&footer, sizeof(footer), 1, rec.file);
+    fclose(rec.file);
+    rec = ReplayRecorder();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// playback
+
+struct ReplayPlayer
+{
+    FILE* file = NULL;
+    ReplayHeader header;
+    std::vector<ReplayFrame> frames;
+    std::vector<ReplayKeyframe> keyframes;
+    // raw state of the last decoded keyframe (or -1)
+    int decodedKeyframe = -1;
+    std::vector<uint32_t> state;
+    std::vector<int64_t> sizes;
+    std::vector<uint8_t> encoded;
+    int currentFrame = 0;
+};
+
+static ReplayPlayer s_Player;
+
+
+static bool DecodeKeyframe(int index)
+{
+    ReplayPlayer& pl = s_Player;
+    KeyframeHeader kh;
+    fseek64(pl.file, pl.keyframes[index].offset, SEEK_SET);
+    if (fread(&kh, sizeof(kh), 1, pl.file) != 1)
+        return false;
+    std::vector<int64_t> sizes(kh.streamCount);
+    if (fread(sizes.data(), sizeof(sizes[0]), sizes.size(), pl.file) != sizes.size())
+        return false;
+    if (!kh.intra && sizes != pl.sizes)
+        return false;
+    // slack at the end, since decoding reads 4 bytes at a time
+    pl.encoded.resize(kh.encodedSize + 4);
+    if (fread(pl.encoded.data(), 1, kh.encodedSize, pl.file) != (size_t)kh.encodedSize)
+        return false;
+
+    size_t totalSize = 0;
+    for (int64_t s : sizes)
+        totalSize += s;
+    pl.state.resize(totalSize / 4);
+    pl.sizes = sizes;
+
+    // flags come first; they tell which runs of entities the other streams have
+    const std::vector<int> streamFlags = GetStreamFlags();
+    if (sizes.size() != streamFlags.size() || sizes[0] % sizeof(int) != 0)
+        return false;
+    const uint8_t* src = pl.encoded.data();
+    size_t stateOffset = 0;
+    std::vector<std::pair<EntityRuns::value_type, int>> flagRuns;
+    EntityRuns runs;
+    for (size_t s = 0; s < sizes.size(); ++s)
+    {
+        if (s == 0)
+            runs.assign(1, std::make_pair((size_t)0, (size_t)sizes[0] / sizeof(int)));
+        else if (s == 1)
+            GetFlagRuns((const int*)pl.state.data(), sizes[0] / sizeof(int), flagRuns);
+        size_t count = s == 0 ? runs[0].second : GetStreamRuns(flagRuns, streamFlags[s], runs);
+        if (count == 0 ? sizes[s] != 0 : sizes[s] % (count * 4) != 0)
+            return false;
+        size_t elementWords = count ? sizes[s] / 4 / count : 0;
+        for (const auto& run : runs)
+        {
+            size_t words = (run.second - run.first) * elementWords;
+            src = DecodeDelta(src, kh.intra != 0, words, pl.state.data() + stateOffset);
+            stateOffset += words;
+        }
+    }
+    pl.decodedKeyframe = index;
+    return true;
+}
+
+
+extern "C" int replay_play_begin(const char* path)
+{
+    replay_play_end();
+    ReplayPlayer& pl = s_Player;
+    pl.file = fopen(path, "rb");
+    if (pl.file == NULL)
+        return -1;
+    ReplayFooter footer;
+    if (fread(&pl.header, sizeof(pl.header), 1, pl.file) != 1 || pl.header.magic != kReplayMagic || pl.header.version != kReplayVersion ||
+        fseek64(pl.file, -(int64_t)sizeof(footer), SEEK_END) != 0 || fread(&footer, sizeof(footer), 1, pl.file) != 1 || footer.magic != kReplayMagic)
+    {
+        replay_play_end();
+        return -1;
+    }
+    pl.frames.resize(footer.frameCount);
+    pl.keyframes.resize(footer.keyframeCount);
+    fseek64(pl.file, footer.tablesOffset, SEEK_SET);
+    fread(pl.frames.data(), sizeof(pl.frames[0]), pl.frames.size(), pl.file);
+    fread(pl.keyframes.data(), sizeof(pl.keyframes[0]), pl.keyframes.size(), pl.file);
+
+    if (pl.header.config.variant != GAME_VARIANT_DOD)
+    {
+        replay_play_end();
+        return -1;
+    }
+    game_destroy();
+    game_initialize(&pl.header.config);
+    pl.currentFrame = 0;
+    return footer.frameCount;
+}
+
+
+extern "C" int replay_seek(int frame, sprite_data_t* data)
+{
+    ReplayPlayer& pl = s_Player;
+    if (pl.file == NULL || pl.keyframes.empty())
+        return 0;
+    frame = std::max(0, std::min(frame, (int)pl.frames.size()));
+
+    // find closest keyframe before the frame, and the intra keyframe that it depends on
+    int key = (int)pl.keyframes.size() - 1;
+    while (key > 0 && pl.keyframes[key].frame > frame)
+        --key;
+    int start = key;
+    while (!pl.keyframes[start].intra)
+        --start;
+    // if already decoded keyframe is in between, continue from there
+    if (pl.decodedKeyframe >= start && pl.decodedKeyframe <= key)
+        start = pl.decodedKeyframe + 1;
+    for (int k = start; k <= key; ++k)
+    {
+        if (!DecodeKeyframe(k))
+            return 0;
+    }
+
+    // put keyframe state into a freshly initialized game (so that no state of systems is left from
+    // other frames), with as many entities as there were (particles come and go in the pool)
+    game_destroy();
+    game_initialize(&pl.header.config);
+    Entities& entities = GetGameEntities();
+    size_t entityCount = pl.sizes.empty() ? 0 : (size_t)pl.sizes[0] / sizeof(entities.m_Flags[0]); // flags are the first stream
+    if (entityCount < entities.m_PoolBegin || entityCount > entities.m_PoolBegin + entities.m_PoolCapacity)
+        return 0;
+    entities.resize(entityCount);
+    // (flags get restored first, and tell which entities the data of the other streams goes to)
+    size_t stateOffset = 0, streamIndex = 0;
+    bool sizesMatch = true;
+    std::vector<std::pair<EntityRuns::value_type, int>> flagRuns;
+    EntityRuns runs;
+    entities.ForEachComponentArray([&](void* array, size_t size, int flag)
+    {
+        if (flag != 0 && flagRuns.empty())
+            GetFlagRuns(entities.m_Flags.data(), entityCount, flagRuns);
+        size_t elementSize = entityCount ? size / entityCount : 0;
+        size_t streamSize = GetStreamRuns(flagRuns, flag, runs) * elementSize;
+        if (flag == 0)
+        {
+            runs.assign(entityCount ? 1 : 0, std::make_pair((size_t)0, entityCount));
+            streamSize = size;
+        }
+        if (!sizesMatch || streamIndex >= pl.sizes.size() || pl.sizes[streamIndex] != (int64_t)streamSize)
+        {
+            sizesMatch = false;
+            return;
+        }
+        const uint8_t* src = (const uint8_t*)(pl.state.data() + stateOffset);
+        for (const auto& run : runs)
+        {
+            memcpy((uint8_t*)array + run.first * elementSize, src, (run.second - run.first) * elementSize);
+            src += (run.second - run.first) * elementSize;
+        }
+        stateOffset += streamSize / 4;
+        ++streamIndex;
+    });
+    if (!sizesMatch)
+        return 0;
+
+    // re-simulate from the keyframe up to the requested frame
+    pl.currentFrame = pl.keyframes[key].frame;
+    while (pl.currentFrame < frame)
+        replay_play_frame(data);
+    return 1;
+}
+
+
+extern "C" int replay_play_frame(sprite_data_t* data)
+{
+    ReplayPlayer& pl = s_Player;
+    if (pl.file == NULL || pl.currentFrame >= (int)pl.frames.size())
+        return -1;
+    const ReplayFrame& f = pl.frames[pl.currentFrame++];
+    return game_update(data, f.time, f.deltaTime);
+}
+
+
+extern "C" void replay_play_end(void)
+{
+    ReplayPlayer& pl = s_Player;
+    if (pl.file != NULL)
+        fclose(pl.file);
+    pl = ReplayPlayer();
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "game.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Deterministic replays of the game simulation.
+//
+// A replay stores the game config, time & delta time of every frame, and periodic snapshots
+// ("keyframes") of the whole entity state. Each keyframe is XOR-delta encoded against the previous
+// one, so data that did not change takes almost no space. Any frame can be restored by loading the
+// closest keyframe before it, and re-simulating the frames after that.
+//
+// Frame N is the state after N game_update calls; frame 0 is the state right after game_initialize.
+
+// Recording: begin right after game_initialize, and call replay_record_frame before each game_update.
+// keyframeInterval is number of frames between keyframes. Only the "dod" variant can be recorded.
+// Returns zero on failure.
+int replay_record_begin(const char* path, const game_config_t* config, int keyframeInterval);
+void replay_record_frame(double time, float deltaTime);
+void replay_record_end(void);
+
+// Playback: replay_play_begin initializes the game with the recorded config, and returns number of
+// recorded frames (negative on failure). replay_seek re-initializes the game and restores state of
+// any frame (data receives sprites of re-simulated frames), replay_play_frame runs the next recorded
+// frame and returns the amount of sprites (negative when at the end).
+int replay_play_begin(const char* path);
+int replay_seek(int frame, sprite_data_t* data);
+int replay_play_frame(sprite_data_t* data);
+void replay_play_end(void);
+
+
+#ifdef __cplusplus
+}
+#endif
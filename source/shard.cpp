@@ -0,0 +1,609 @@
+#include "shard.h"
+#include "shared_memory.h"
+#include "systems.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+typedef HANDLE ProcessHandle;
+static int64_t CurrentProcessID() { return (int64_t)GetCurrentProcessId(); }
+#else
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+typedef pid_t ProcessHandle;
+static int64_t CurrentProcessID() { return (int64_t)getpid(); }
+#endif
+
+
+static const uint32_t kShardMagic = 0x48444F44; // "DODH"
+static const uint32_t kShardVersion = 1;
+
+// Shared memory layout: ShardHeader, ShardTile for each tile, ShardAvoider for each thing to
+// avoid, outbox of migrants for each tile, sprite data.
+
+struct ShardHeader
+{
+    uint32_t magic, version;
+    game_config_t config;
+    int32_t tilesX, tilesY;
+    int32_t migrantCapacity; // per tile outbox
+    int32_t spriteCount;
+    int64_t coordinatorID;
+
+    // current frame parameters; written by the coordinator before it bumps the frame counter
+    double time;
+    float deltaTime;
+    int32_t writeSprites;
+
+    std::atomic<uint32_t> frame; // frames started
+    std::atomic<uint32_t> done; // sum of frames finished by all workers
+    std::atomic<int32_t> ready; // workers done initializing
+    std::atomic<int32_t> quit;
+    std::atomic<int32_t> failed;
+    // barrier for workers within a frame
+    std::atomic<uint32_t> barrierCount, barrierGeneration;
+};
+
+struct ShardTile
+{
+    int32_t migrantCount;
+    int32_t owned, ghosts, migrated;
+    int32_t padding[12]; // each in its own cache line
+};
+
+struct ShardAvoider
+{
+    uint32_t id;
+    float distanceSq;
+    PositionComponent pos;
+    float colorR, colorG, colorB;
+};
+
+struct ShardMigrant
+{
+    uint32_t id;
+    int32_t tile, flags;
+    PositionComponent pos;
+    MoveComponent move;
+    SpriteComponent sprite;
+};
+
+static_assert(sizeof(ShardTile) == 64, "tile info should be one cache line");
+
+struct ShardLayout
+{
+    size_t tiles, avoiders, migrants, sprites, size;
+};
+
+static size_t AlignUp(size_t v) { return (v + 63) & ~(size_t)63; }
+
+static ShardLayout ComputeLayout(int tileCount, int avoidCount, int migrantCapacity, int spriteCount)
+{
+    ShardLayout l;
+    l.tiles = AlignUp(sizeof(ShardHeader));
+    l.avoiders = AlignUp(l.tiles + tileCount * sizeof(ShardTile));
+    l.migrants = AlignUp(l.avoiders + avoidCount * sizeof(ShardAvoider));
+    l.sprites = AlignUp(l.migrants + (size_t)tileCount * migrantCapacity * sizeof(ShardMigrant));
+    l.size = l.sprites + (size_t)spriteCount * sizeof(sprite_data_t);
+    return l;
+}
+
+static ShardLayout ComputeLayout(const ShardHeader* h)
+{
+    return ComputeLayout(h->tilesX * h->tilesY, h->config.avoidCount, h->migrantCapacity, h->spriteCount);
+}
+
+static ShardTile* Tiles(ShardHeader* h) { return (ShardTile*)((char*)h + ComputeLayout(h).tiles); }
+static ShardAvoider* Avoiders(ShardHeader* h) { return (ShardAvoider*)((char*)h + ComputeLayout(h).avoiders); }
+static ShardMigrant* Outbox(ShardHeader* h, int tile) { return (ShardMigrant*)((char*)h + ComputeLayout(h).migrants) + (size_t)tile * h->migrantCapacity; }
+static sprite_data_t* Sprites(ShardHeader* h) { return (sprite_data_t*)((char*)h + ComputeLayout(h).sprites); }
+
+
+// Waits until cond() is true. Gives up (returns false) if anyone flagged a failure, or alive()
+// says the other side is gone. Spins for short waits, and sleeps during longer ones (e.g. between
+// frames).
+template<typename Cond, typename Alive>
+static bool WaitFor(ShardHeader* h, Cond cond, Alive alive)
+{
+    for (int spin = 0; !cond(); ++spin)
+    {
+        if (h->failed.load(std::memory_order_relaxed))
+            return false;
+        if (spin < 1000)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        if ((spin & 255) == 0 && !alive())
+        {
+            h->failed.store(1);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Worker: owns the objects within one tile of the world.
+
+struct ShardWorker
+{
+    ShardHeader* header;
+    int tile;
+    WorldBoundsComponent area; // of this tile
+    WorldBoundsComponent world;
+    float tileSizeX, tileSizeY;
+    float maxSpeed; // of any object; movement only ever flips velocity, so this does not change
+    float prevDeltaTime = 0.0f;
+    #ifdef _WIN32
+    HANDLE coordinator = NULL;
+    #endif
+
+    // entity 0 is the world bounds, followed by owned objects, and during avoidance, ghosts
+    Entities objects;
+    std::vector<uint32_t> ids; // global entity ID of each
+    size_t ownedCount;
+    MoveSystem move;
+    AvoidanceSystem avoidance;
+
+    std::vector<uint32_t> avoiderIDs; // sorted global IDs of things to avoid
+    std::vector<EntityID> avoiderLocal; // local ID of each owned thing to avoid
+};
+
+static int TileOf(const ShardWorker& w, const PositionComponent& pos)
+{
+    int tx = std::min(std::max((int)((pos.x - w.world.xMin) / w.tileSizeX), 0), w.header->tilesX - 1);
+    int ty = std::min(std::max((int)((pos.y - w.world.yMin) / w.tileSizeY), 0), w.header->tilesY - 1);
+    return ty * w.header->tilesX + tx;
+}
+
+static bool CoordinatorAlive(const ShardWorker& w)
+{
+    #ifdef _WIN32
+    return w.coordinator == NULL || WaitForSingleObject(w.coordinator, 0) == WAIT_TIMEOUT;
+    #else
+    return (int64_t)getppid() == w.header->coordinatorID;
+    #endif
+}
+
+static bool WorkerBarrier(ShardWorker& w)
+{
+    ShardHeader* h = w.header;
+    uint32_t count = h->tilesX * h->tilesY;
+    uint32_t generation = h->barrierGeneration.load(std::memory_order_acquire);
+    if (h->barrierCount.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+    {
+        h->barrierCount.store(0, std::memory_order_relaxed);
+        h->barrierGeneration.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+    return WaitFor(h, [&]() { return h->barrierGeneration.load(std::memory_order_acquire) != generation; }, [&]() { return CoordinatorAlive(w); });
+}
+
+static EntityID AddObject(ShardWorker& w, uint32_t id, int flags, const PositionComponent& pos, const MoveComponent& move, const SpriteComponent& sprite)
+{
+    EntityID go = w.objects.AddEntity("object");
+    w.objects.m_Positions[go] = pos;
+    w.objects.m_Moves[go] = move;
+    w.objects.m_Sprites[go] = sprite;
+    w.objects.m_Flags[go] = flags;
+    w.ids.push_back(id);
+    return go;
+}
+
+// Rebuilds system memberships after objects came or went.
+static void RebuildSystems(ShardWorker& w)
+{
+    w.move.entities.clear();
+    w.avoidance.objectList.clear();
+    std::fill(w.avoiderLocal.begin(), w.avoiderLocal.end(), 0);
+    for (EntityID go = 1; go < w.ownedCount; ++go)
+    {
+        w.move.AddObjectToSystem(go);
+        auto it = std::lower_bound(w.avoiderIDs.begin(), w.avoiderIDs.end(), w.ids[go]);
+        if (it != w.avoiderIDs.end() && *it == w.ids[go])
+            w.avoiderLocal[it - w.avoiderIDs.begin()] = go;
+        else
+            w.avoidance.AddObjectToSystem(go);
+    }
+}
+
+static bool InitializeWorker(ShardWorker& w)
+{
+    ShardHeader* h = w.header;
+    int tx = w.tile % h->tilesX, ty = w.tile / h->tilesX;
+
+    // simplest way to get exactly the same initial state as a single process game has: initialize
+    // the whole game, take the objects that are within our tile, and throw away the rest
+    game_destroy(); // forked workers inherit whatever the coordinator process had
+    game_initialize(&h->config);
+    Entities& all = GetGameEntities();
+    MoveSystem& allMove = GetGameMoveSystem();
+    AvoidanceSystem& allAvoidance = GetGameAvoidanceSystem();
+
+    w.world = all.m_WorldBounds[allMove.boundsID];
+    w.tileSizeX = (w.world.xMax - w.world.xMin) / h->tilesX;
+    w.tileSizeY = (w.world.yMax - w.world.yMin) / h->tilesY;
+    w.area.xMin = tx == 0 ? -INFINITY : w.world.xMin + tx * w.tileSizeX;
+    w.area.xMax = tx == h->tilesX - 1 ? INFINITY : w.world.xMin + (tx + 1) * w.tileSizeX;
+    w.area.yMin = ty == 0 ? -INFINITY : w.world.yMin + ty * w.tileSizeY;
+    w.area.yMax = ty == h->tilesY - 1 ? INFINITY : w.world.yMin + (ty + 1) * w.tileSizeY;
+
+    EntityID bounds = w.objects.AddEntity("bounds");
+    w.objects.m_WorldBounds[bounds] = w.world;
+    w.objects.m_Flags[bounds] = Entities::kFlagWorldBounds;
+    w.ids.push_back((uint32_t)allMove.boundsID);
+    w.move.SetBounds(bounds);
+
+    // things to avoid: tile 0 publishes their distances (those never change) while we have them
+    ShardAvoider* avoiders = Avoiders(h);
+    for (size_t ia = 0; ia < allAvoidance.avoidList.size(); ++ia)
+        w.avoiderIDs.push_back((uint32_t)allAvoidance.avoidList[ia]);
+    std::sort(w.avoiderIDs.begin(), w.avoiderIDs.end());
+    w.avoiderLocal.resize(w.avoiderIDs.size());
+    if ((int)w.avoiderIDs.size() != h->config.avoidCount)
+        return false;
+
+    w.maxSpeed = 0.0f;
+    allMove.entities.ForEach([&](EntityID id)
+    {
+        const MoveComponent& m = all.m_Moves[id];
+        w.maxSpeed = std::max(w.maxSpeed, sqrtf(m.velx * m.velx + m.vely * m.vely));
+        if (TileOf(w, all.m_Positions[id]) == w.tile)
+            AddObject(w, (uint32_t)id, all.m_Flags[id], all.m_Positions[id], all.m_Moves[id], all.m_Sprites[id]);
+    });
+    if (w.tile == 0)
+    {
+        for (size_t ia = 0; ia < allAvoidance.avoidList.size(); ++ia)
+        {
+            size_t index = std::lower_bound(w.avoiderIDs.begin(), w.avoiderIDs.end(), (uint32_t)allAvoidance.avoidList[ia]) - w.avoiderIDs.begin();
+            avoiders[index].id = (uint32_t)allAvoidance.avoidList[ia];
+            avoiders[index].distanceSq = allAvoidance.avoidDistanceList[ia];
+        }
+    }
+    game_destroy();
+
+    w.ownedCount = w.objects.m_Flags.size();
+    RebuildSystems(w);
+    return true;
+}
+
+// Squared distance from a point to a tile area.
+static float DistanceSqToArea(const WorldBoundsComponent& area, const PositionComponent& pos)
+{
+    float dx = std::max(std::max(area.xMin - pos.x, pos.x - area.xMax), 0.0f);
+    float dy = std::max(std::max(area.yMin - pos.y, pos.y - area.yMax), 0.0f);
+    return dx * dx + dy * dy;
+}
+
+static bool WorkerFrame(ShardWorker& w)
+{
+    ShardHeader* h = w.header;
+    ShardAvoider* avoiders = Avoiders(h);
+    ShardTile& tileInfo = Tiles(h)[w.tile];
+    double time = h->time;
+    float deltaTime = h->deltaTime;
+
+    // move our objects, and publish where our things to avoid are now
+    w.move.UpdateSystem(w.objects, time, deltaTime);
+    for (size_t ia = 0; ia < w.avoiderIDs.size(); ++ia)
+    {
+        EntityID go = w.avoiderLocal[ia];
+        if (go == 0)
+            continue;
+        ShardAvoider& a = avoiders[ia];
+        a.pos = w.objects.m_Positions[go];
+        a.colorR = w.objects.m_Sprites[go].colorR;
+        a.colorG = w.objects.m_Sprites[go].colorG;
+        a.colorB = w.objects.m_Sprites[go].colorB;
+    }
+    if (!WorkerBarrier(w))
+        return false;
+
+    // Things to avoid that can reach any of our objects; everything else is left out. Objects were
+    // within our area at the end of the last frame; since then they moved for one frame, and can
+    // get pushed out of each collision during avoidance, moving a bit more each time. Both that and
+    // previous frame delta time are accounted for, with some extra margin.
+    float reach = w.maxSpeed * (w.prevDeltaTime + deltaTime) * (1.0f + 1.1f * w.avoiderIDs.size()) * 1.5f + 0.01f;
+    w.avoidance.avoidList.clear();
+    w.avoidance.avoidDistanceList.clear();
+    int ghosts = 0;
+    for (size_t ia = 0; ia < w.avoiderIDs.size(); ++ia)
+    {
+        const ShardAvoider& a = avoiders[ia];
+        float range = sqrtf(a.distanceSq) + reach;
+        if (DistanceSqToArea(w.area, a.pos) >= range * range)
+            continue;
+        EntityID go = w.avoiderLocal[ia];
+        if (go == 0)
+        {
+            go = w.objects.AddEntity("ghost");
+            w.objects.m_Positions[go] = a.pos;
+            w.objects.m_Sprites[go].colorR = a.colorR;
+            w.objects.m_Sprites[go].colorG = a.colorG;
+            w.objects.m_Sprites[go].colorB = a.colorB;
+            w.objects.m_Flags[go] = Entities::kFlagPosition;
+            ++ghosts;
+        }
+        // (distance is already squared, so don't go through AddAvoidThisObjectToSystem)
+        w.avoidance.avoidList.push_back(go);
+        w.avoidance.avoidDistanceList.push_back(a.distanceSq);
+    }
+    w.avoidance.UpdateSystem(w.objects, time, deltaTime);
+    w.objects.resize(w.ownedCount);
+    w.prevDeltaTime = deltaTime;
+
+    // world bounds object (ID 0) is the only one without a sprite, so sprite index is ID-1
+    if (h->writeSprites)
+    {
+        sprite_data_t* sprites = Sprites(h);
+        for (EntityID go = 1; go < w.ownedCount; ++go)
+            WriteSpriteData(w.objects.m_Positions[go], w.objects.m_Sprites[go], sprites[w.ids[go] - 1]);
+    }
+
+    // send objects that are not in our area anymore to their new owners
+    ShardMigrant* outbox = Outbox(h, w.tile);
+    int migrated = 0;
+    for (EntityID go = 1; go < w.objects.m_Flags.size(); )
+    {
+        int tile = TileOf(w, w.objects.m_Positions[go]);
+        if (tile == w.tile)
+        {
+            ++go;
+            continue;
+        }
+        if (migrated == h->migrantCapacity)
+        {
+            fprintf(stderr, "shard %i: too many objects migrating in one frame\n", w.tile);
+            h->failed.store(1);
+            return false;
+        }
+        ShardMigrant& m = outbox[migrated++];
+        m.id = w.ids[go];
+        m.tile = tile;
+        m.flags = w.objects.m_Flags[go];
+        m.pos = w.objects.m_Positions[go];
+        m.move = w.objects.m_Moves[go];
+        m.sprite = w.objects.m_Sprites[go];
+        w.objects.RemoveEntitySwapLast(go);
+        w.ids[go] = w.ids.back();
+        w.ids.pop_back();
+    }
+    tileInfo.migrantCount = migrated;
+    if (!WorkerBarrier(w))
+        return false;
+
+    // and receive the ones that came to us
+    for (int t = 0, n = h->tilesX * h->tilesY; t < n; ++t)
+    {
+        const ShardMigrant* inbox = Outbox(h, t);
+        for (int i = 0, ni = Tiles(h)[t].migrantCount; i < ni; ++i)
+        {
+            if (inbox[i].tile == w.tile)
+                AddObject(w, inbox[i].id, inbox[i].flags, inbox[i].pos, inbox[i].move, inbox[i].sprite);
+        }
+    }
+    w.ownedCount = w.objects.m_Flags.size();
+    if (migrated != 0 || w.ownedCount != w.move.entities.size() + 1)
+        RebuildSystems(w);
+
+    tileInfo.owned = (int)w.ownedCount - 1;
+    tileInfo.ghosts = ghosts;
+    tileInfo.migrated = migrated;
+    return true;
+}
+
+extern "C" int shard_worker_run(const char* name, int tile)
+{
+    SharedMemory shm;
+    if (!MapSharedMemory(name, sizeof(ShardHeader), false, shm))
+        return 1;
+    ShardHeader* h = (ShardHeader*)shm.data;
+    #ifdef _WIN32
+    // on Windows mapping view size has to be known upfront; remap now that we know it
+    size_t size = ComputeLayout(h).size;
+    UnmapSharedMemory(shm);
+    if (!MapSharedMemory(name, size, false, shm))
+        return 1;
+    h = (ShardHeader*)shm.data;
+    #endif
+    if (h->magic != kShardMagic || h->version != kShardVersion || tile < 0 || tile >= h->tilesX * h->tilesY)
+    {
+        UnmapSharedMemory(shm);
+        return 1;
+    }
+
+    ShardWorker* w = new ShardWorker();
+    w->header = h;
+    w->tile = tile;
+    #ifdef _WIN32
+    w->coordinator = OpenProcess(SYNCHRONIZE, FALSE, (DWORD)h->coordinatorID);
+    #endif
+    bool ok = InitializeWorker(*w);
+    if (ok)
+    {
+        h->ready.fetch_add(1, std::memory_order_release);
+        for (uint32_t frame = 0; ok; )
+        {
+            ok = WaitFor(h, [&]() { return h->frame.load(std::memory_order_acquire) != frame || h->quit.load(); }, [&]() { return CoordinatorAlive(*w); });
+            if (!ok || h->quit.load())
+                break;
+            ++frame;
+            ok = WorkerFrame(*w);
+            h->done.fetch_add(1, std::memory_order_release);
+        }
+    }
+    if (!ok)
+        h->failed.store(1);
+    #ifdef _WIN32
+    if (w->coordinator)
+        CloseHandle(w->coordinator);
+    #endif
+    delete w;
+    UnmapSharedMemory(shm);
+    return ok ? 0 : 1;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Coordinator: starts the workers, and tells them when to run each frame.
+
+struct shard_world_t
+{
+    SharedMemory shm;
+    std::vector<ProcessHandle> workers;
+};
+
+static ShardHeader* Header(const shard_world_t* world) { return (ShardHeader*)world->shm.data; }
+
+static bool WorkersAlive(shard_world_t* world)
+{
+    for (ProcessHandle p : world->workers)
+    {
+        #ifdef _WIN32
+        if (WaitForSingleObject(p, 0) != WAIT_TIMEOUT)
+            return false;
+        #else
+        if (waitpid(p, NULL, WNOHANG) != 0)
+            return false;
+        #endif
+    }
+    return true;
+}
+
+static bool StartWorker(shard_world_t* world, const char* name, int tile)
+{
+    #ifdef _WIN32
+    char exe[MAX_PATH];
+    GetModuleFileNameA(NULL, exe, sizeof(exe));
+    char cmd[MAX_PATH + 200];
+    snprintf(cmd, sizeof(cmd), "\"%s\" --shard-worker %s %i", exe, name, tile);
+    STARTUPINFOA si = { sizeof(si) };
+    PROCESS_INFORMATION pi;
+    if (!CreateProcessA(NULL, cmd, NULL, NULL, FALSE, 0, NULL, NULL, &si, &pi))
+        return false;
+    CloseHandle(pi.hThread);
+    world->workers.push_back(pi.hProcess);
+    #else
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0)
+        return false;
+    if (pid == 0)
+        _exit(shard_worker_run(name, tile));
+    world->workers.push_back(pid);
+    #endif
+    return true;
+}
+
+extern "C" shard_world_t* shard_world_create(const game_config_t* config, int tilesX, int tilesY)
+{
+    game_config_t defaultConfig;
+    if (config == NULL)
+    {
+        game_default_config(&defaultConfig);
+        config = &defaultConfig;
+    }
+    // (separation would need all objects near tile borders as ghosts, not just things to avoid; and
+    // ghosts of things to avoid are read only, so they could not be pushed around)
+    if (tilesX < 1 || tilesY < 1 || config->variant != GAME_VARIANT_DOD || config->separationRadius > 0.0f || config->avoidersRepel || config->animateSprites ||
+        config->tintHalfLife > 0.0f || config->trailRate > 0.0f ||
+        config->attachmentCount > 0 || config->flocking)
+        return NULL;
+    int tileCount = tilesX * tilesY;
+    int spriteCount = config->objectCount + config->avoidCount;
+    // objects only cross tile borders near them, so normally just a small fraction of them migrate
+    // in one frame; this is plenty unless delta time is huge
+    int migrantCapacity = spriteCount / 16 + 1024;
+
+    static int s_WorldCounter;
+    char name[100];
+    snprintf(name, sizeof(name), "dod-shard-%lli-%i", (long long)CurrentProcessID(), s_WorldCounter++);
+    ShardLayout layout = ComputeLayout(tileCount, config->avoidCount, migrantCapacity, spriteCount);
+    shard_world_t* world = new shard_world_t();
+    if (!MapSharedMemory(name, layout.size, true, world->shm))
+    {
+        delete world;
+        return NULL;
+    }
+    ShardHeader* h = Header(world);
+    memset((void*)h, 0, layout.tiles);
+    h->magic = kShardMagic;
+    h->version = kShardVersion;
+    h->config = *config;
+    h->tilesX = tilesX;
+    h->tilesY = tilesY;
+    h->migrantCapacity = migrantCapacity;
+    h->spriteCount = spriteCount;
+    h->coordinatorID = CurrentProcessID();
+    memset((void*)Tiles(h), 0, tileCount * sizeof(ShardTile));
+
+    bool ok = true;
+    for (int t = 0; t < tileCount && ok; ++t)
+        ok = StartWorker(world, name, t);
+    ok = ok && WaitFor(h, [&]() { return h->ready.load(std::memory_order_acquire) == tileCount; }, [&]() { return WorkersAlive(world); });
+    if (!ok)
+    {
+        shard_world_destroy(world);
+        return NULL;
+    }
+    return world;
+}
+
+extern "C" int shard_world_update(shard_world_t* world, sprite_data_t* data, double time, float deltaTime)
+{
+    ShardHeader* h = Header(world);
+    if (h->failed.load())
+        return -1;
+    h->time = time;
+    h->deltaTime = deltaTime;
+    h->writeSprites = data != NULL;
+    uint32_t frame = h->frame.load(std::memory_order_relaxed) + 1;
+    uint32_t tileCount = h->tilesX * h->tilesY;
+    h->frame.store(frame, std::memory_order_release);
+    if (!WaitFor(h, [&]() { return h->done.load(std::memory_order_acquire) == frame * tileCount; }, [&]() { return WorkersAlive(world); }))
+        return -1;
+    if (data)
+        memcpy(data, Sprites(h), h->spriteCount * sizeof(sprite_data_t));
+    return h->spriteCount;
+}
+
+extern "C" void shard_world_tile_stats(const shard_world_t* world, int tile, int* owned, int* ghosts, int* migrated)
+{
+    const ShardTile& t = Tiles(Header(world))[tile];
+    if (owned)
+        *owned = t.owned;
+    if (ghosts)
+        *ghosts = t.ghosts;
+    if (migrated)
+        *migrated = t.migrated;
+}
+
+extern "C" void shard_world_destroy(shard_world_t* world)
+{
+    if (world == NULL)
+        return;
+    Header(world)->quit.store(1);
+    for (ProcessHandle p : world->workers)
+    {
+        #ifdef _WIN32
+        WaitForSingleObject(p, INFINITE);
+        CloseHandle(p);
+        #else
+        waitpid(p, NULL, 0);
+        #endif
+    }
+    UnmapSharedMemory(world->shm);
+    delete world;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "game.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Simulation of one world split across several processes on one machine ("sharding").
+//
+// World bounds are split into a grid of tiles, and each tile is owned by a separate worker process
+// that runs the regular game systems on just the objects within it. Processes talk through one
+// shared memory segment:
+// - objects that moved out of a tile are put into its outbox, and picked up by their new owner
+//   at the end of each frame ("migration");
+// - positions of things to be avoided are published every frame, and each tile adds the ones close
+//   enough to its area to affect its objects as local copies ("ghosts");
+// - sprite data is written by owners directly into a shared output buffer.
+// Results are identical to running the same game in one process.
+//
+// Workers are started with fork() on POSIX systems; on Windows the application executable is
+// started again with "--shard-worker <name> <tile>" arguments, which should call shard_worker_run.
+
+typedef struct shard_world_t shard_world_t;
+
+// Initializes the game with given config (null for defaults), split into tilesX*tilesY tiles.
+// Returns null on failure.
+shard_world_t* shard_world_create(const game_config_t* config, int tilesX, int tilesY);
+// Simulates one frame on all tiles, and writes sprites into data (if not null); returns amount of
+// sprites, or negative if a worker failed.
+int shard_world_update(shard_world_t* world, sprite_data_t* data, double time, float deltaTime);
+// Objects owned by the tile, ghosts it used and objects that migrated out of it in the last frame.
+void shard_world_tile_stats(const shard_world_t* world, int tile, int* owned, int* ghosts, int* migrated);
+void shard_world_destroy(shard_world_t* world);
+
+// Worker process entry point; returns process exit code.
+int shard_worker_run(const char* name, int tile);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,179 @@
+#include "shared_export.h"
+#include "shared_memory.h"
+#include <atomic>
+#include <string.h>
+
+
+static const uint32_t kExportMagic = 0x58444F44; // "DODX"
+static const uint32_t kExportVersion = 1;
+static const int kBufferCount = 2;
+
+struct ExportBuffer
+{
+    std::atomic<uint64_t> sequence; // odd while being written
+    uint64_t frame;
+    double time;
+    int32_t spriteCount;
+    int32_t padding[9]; // keep each buffer header in its own cache line
+};
+
+struct ExportHeader
+{
+    uint32_t magic, version;
+    int32_t maxSprites, bufferCount;
+    std::atomic<uint64_t> latestFrame; // frame number + 1 of the latest complete frame; zero if none
+    uint64_t padding[5];
+    ExportBuffer buffers[kBufferCount];
+    // followed by sprite data of each buffer
+};
+
+static_assert(sizeof(ExportBuffer) == 64, "buffer header should be one cache line");
+
+static size_t ExportSize(int maxSprites)
+{
+    return sizeof(ExportHeader) + (size_t)kBufferCount * maxSprites * sizeof(sprite_data_t);
+}
+
+static sprite_data_t* BufferData(ExportHeader* header, int index)
+{
+    return (sprite_data_t*)(header + 1) + (size_t)index * header->maxSprites;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// writer
+
+static SharedMemory s_Export;
+static uint64_t s_ExportFrame;
+
+extern "C" int shared_export_create(const char* name, int maxSprites)
+{
+    shared_export_destroy();
+    if (!MapSharedMemory(name, ExportSize(maxSprites), true, s_Export))
+        return 0;
+    ExportHeader* h = (ExportHeader*)s_Export.data;
+    h->magic = kExportMagic;
+    h->version = kExportVersion;
+    h->maxSprites = maxSprites;
+    h->bufferCount = kBufferCount;
+    h->latestFrame.store(0);
+    for (ExportBuffer& b : h->buffers)
+    {
+        b.sequence.store(0);
+        b.frame = 0;
+        b.spriteCount = 0;
+    }
+    s_ExportFrame = 0;
+    return 1;
+}
+
+
+extern "C" sprite_data_t* shared_export_begin_frame(void)
+{
+    ExportHeader* h = (ExportHeader*)s_Export.data;
+    if (h == NULL)
+        return NULL;
+    ExportBuffer& b = h->buffers[s_ExportFrame % kBufferCount];
+    b.sequence.store(b.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return BufferData(h, (int)(s_ExportFrame % kBufferCount));
+}
+
+
+extern "C" void shared_export_end_frame(int spriteCount, double time)
+{
+    ExportHeader* h = (ExportHeader*)s_Export.data;
+    if (h == NULL)
+        return;
+    ExportBuffer& b = h->buffers[s_ExportFrame % kBufferCount];
+    b.frame = s_ExportFrame;
+    b.time = time;
+    b.spriteCount = spriteCount;
+    b.sequence.store(b.sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    h->latestFrame.store(s_ExportFrame + 1, std::memory_order_release);
+    ++s_ExportFrame;
+}
+
+
+extern "C" void shared_export_destroy(void)
+{
+    UnmapSharedMemory(s_Export);
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// reader
+
+struct shared_export_reader_t
+{
+    SharedMemory mapping;
+    ExportBuffer* acquired = NULL;
+    uint64_t acquiredSequence = 0;
+};
+
+extern "C" shared_export_reader_t* shared_export_open(const char* name)
+{
+    shared_export_reader_t* r = new shared_export_reader_t();
+    if (!MapSharedMemory(name, sizeof(ExportHeader), false, r->mapping) || ((ExportHeader*)r->mapping.data)->magic != kExportMagic ||
+        ((ExportHeader*)r->mapping.data)->version != kExportVersion)
+    {
+        UnmapSharedMemory(r->mapping);
+        delete r;
+        return NULL;
+    }
+    #ifdef _WIN32
+    // on Windows mapping view size has to be known upfront; remap now that we know it
+    int maxSprites = ((ExportHeader*)r->mapping.data)->maxSprites;
+    UnmapSharedMemory(r->mapping);
+    if (!MapSharedMemory(name, ExportSize(maxSprites), false, r->mapping))
+    {
+        delete r;
+        return NULL;
+    }
+    #endif
+    return r;
+}
+
+
+extern "C" const sprite_data_t* shared_export_acquire(shared_export_reader_t* reader, int* spriteCount, uint64_t* frame, double* time)
+{
+    ExportHeader* h = (ExportHeader*)reader->mapping.data;
+    reader->acquired = NULL;
+    uint64_t latest = h->latestFrame.load(std::memory_order_acquire);
+    if (latest == 0)
+        return NULL;
+    int index = (int)((latest - 1) % kBufferCount);
+    ExportBuffer& b = h->buffers[index];
+    uint64_t seq = b.sequence.load(std::memory_order_acquire);
+    if (seq & 1)
+        return NULL; // writer already came around to it again
+    reader->acquired = &b;
+    reader->acquiredSequence = seq;
+    if (spriteCount)
+        *spriteCount = b.spriteCount;
+    if (frame)
+        *frame = b.frame;
+    if (time)
+        *time = b.time;
+    return BufferData(h, index);
+}
+
+
+extern "C" int shared_export_release(shared_export_reader_t* reader)
+{
+    if (reader->acquired == NULL)
+        return 0;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool valid = reader->acquired->sequence.load(std::memory_order_relaxed) == reader->acquiredSequence;
+    reader->acquired = NULL;
+    return valid;
+}
+
+
+extern "C" void shared_export_close(shared_export_reader_t* reader)
+{
+    if (reader == NULL)
+        return;
+    UnmapSharedMemory(reader->mapping);
+    delete reader;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "game.h"
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Zero-copy export of sprite data to other processes, through a named shared memory segment.
+//
+// The segment has a small header, and two sprite buffers that game_update writes into directly,
+// alternating between them every frame. Each buffer has a sequence counter that is odd while the
+// buffer is being written into (a "seqlock"): readers use the data in place, and check the counter
+// afterwards to know whether the writer came around and overwrote it while they were reading. The
+// writer never waits for readers, so slow readers can't stall the simulation; they just miss frames.
+
+// Writer side. begin_frame returns the buffer (with room for maxSprites) to write the next frame into.
+int shared_export_create(const char* name, int maxSprites);
+sprite_data_t* shared_export_begin_frame(void);
+void shared_export_end_frame(int spriteCount, double time);
+void shared_export_destroy(void);
+
+// Reader side. acquire returns the latest complete frame (or null if there is none yet), without
+// copying; once done with the data, release returns non-zero if it was not overwritten meanwhile.
+typedef struct shared_export_reader_t shared_export_reader_t;
+
+shared_export_reader_t* shared_export_open(const char* name);
+const sprite_data_t* shared_export_acquire(shared_export_reader_t* reader, int* spriteCount, uint64_t* frame, double* time);
+int shared_export_release(shared_export_reader_t* reader);
+void shared_export_close(shared_export_reader_t* reader);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,77 @@
+#include "shared_memory.h"
+#include <stdint.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+bool MapSharedMemory(const char* name, size_t size, bool create, SharedMemory& m)
+{
+    #ifdef _WIN32
+    std::string path = std::string("Local\\") + name;
+    if (create)
+        m.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, path.c_str());
+    else
+        m.handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+    if (m.handle == NULL)
+        return false;
+    void* ptr = MapViewOfFile(m.handle, FILE_MAP_ALL_ACCESS, 0, 0, size);
+    if (ptr == NULL)
+    {
+        CloseHandle(m.handle);
+        return false;
+    }
+    #else
+    m.name = std::string("/") + name;
+    int fd = create ? shm_open(m.name.c_str(), O_CREAT | O_RDWR, 0644) : shm_open(m.name.c_str(), O_RDWR, 0);
+    if (fd < 0)
+        return false;
+    if (create && ftruncate(fd, size) != 0)
+    {
+        close(fd);
+        shm_unlink(m.name.c_str());
+        return false;
+    }
+    if (!create)
+    {
+        struct stat st;
+        fstat(fd, &st);
+        size = (size_t)st.st_size;
+    }
+    void* ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED)
+    {
+        if (create)
+            shm_unlink(m.name.c_str());
+        return false;
+    }
+    m.owner = create;
+    #endif
+    m.data = ptr;
+    m.size = size;
+    return true;
+}
+
+
+void UnmapSharedMemory(SharedMemory& m)
+{
+    if (m.data == NULL)
+        return;
+    #ifdef _WIN32
+    UnmapViewOfFile(m.data);
+    CloseHandle(m.handle);
+    #else
+    munmap(m.data, m.size);
+    if (m.owner)
+        shm_unlink(m.name.c_str());
+    #endif
+    m = SharedMemory();
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+// Named shared memory segments, for sharing data between processes on one machine.
+
+#include <stddef.h>
+#include <string>
+
+struct SharedMemory
+{
+    void* data = NULL;
+    size_t size = 0;
+    #ifdef _WIN32
+    void* handle = NULL; // file mapping HANDLE
+    #else
+    std::string name;
+    bool owner = false;
+    #endif
+};
+
+// Creates a new segment (create=true; it gets removed when the creator unmaps it), or opens an
+// existing one. When opening, size is how much of it to map; on POSIX systems the whole segment
+// is always mapped, and size gets set to that.
+bool MapSharedMemory(const char* name, size_t size, bool create, SharedMemory& m);
+void UnmapSharedMemory(SharedMemory& m);
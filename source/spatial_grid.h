@@ -0,0 +1,404 @@
+#pragma once
+
+// Uniform grid over the world, indexing which entities are in which cell; used for neighbour
+// queries & culling.
+
+#include "entities.h"
+#include "parallel.h"
+#include <stdint.h>
+
+
+// Entity IDs of each cell are stored contiguously, cell after cell, in one array ("cell-ordered
+// index"); queries just walk the ranges of the cells they overlap.
+//
+// The grid is meant to be kept up to date incrementally: objects move much less than a cell size
+// per frame, so only a small fraction of them cross into another cell each frame, and only these
+// get relinked. To make that cheap, each cell has some free slots at the end of its range; an
+// entity leaving a cell is replaced by the last one in it, and an entity entering gets appended.
+// When a cell runs out of free slots, the whole index is repacked (with entities of each cell in
+// ID order, and free slots distributed again).
+class SpatialGrid
+{
+public:
+    // Sets up grid covering the bounds with square cells of given size; positions outside of the
+    // bounds are clamped into edge cells. Removes all entities.
+    void Initialize(const WorldBoundsComponent& bounds, float cellSize)
+    {
+        m_Map = CellMap::Create(bounds, cellSize);
+        m_CellSize = cellSize;
+        m_EntityCell.clear();
+        m_EntitySlot.clear();
+        m_Count = 0;
+        Repack();
+        m_MoveCount = m_RepackCount = 0;
+    }
+
+    bool IsInitialized() const { return m_Map.width > 0; }
+    int Width() const { return m_Map.width; }
+    int Height() const { return m_Map.height; }
+    int CellCount() const { return m_Map.width * m_Map.height; }
+    float CellSize() const { return m_CellSize; }
+    // number of entities in the grid
+    size_t size() const { return m_Count; }
+    // how many times entities moved to another cell, and how many times the index had to be
+    // repacked since initialization
+    size_t MoveCount() const { return m_MoveCount; }
+    size_t RepackCount() const { return m_RepackCount; }
+
+    // Mapping of positions to cells. Hot loops should work on a local copy of it (see GetCellMap),
+    // since compilers can't know that writing float positions does not change it.
+    struct CellMap
+    {
+        float xMin = 0.0f, yMin = 0.0f, invCellSize = 1.0f;
+        int width = 0, height = 0;
+
+        static CellMap Create(const WorldBoundsComponent& bounds, float cellSize)
+        {
+            CellMap map;
+            map.xMin = bounds.xMin;
+            map.yMin = bounds.yMin;
+            map.invCellSize = 1.0f / cellSize;
+            map.width = std::max(1, (int)ceilf((bounds.xMax - bounds.xMin) * map.invCellSize));
+            map.height = std::max(1, (int)ceilf((bounds.yMax - bounds.yMin) * map.invCellSize));
+            return map;
+        }
+
+        // (clamped while still a float, so that a plain truncating conversion works)
+        int CellX(float x) const { return (int)std::min(std::max((x - xMin) * invCellSize, 0.0f), width - 1.0f); }
+        int CellY(float y) const { return (int)std::min(std::max((y - yMin) * invCellSize, 0.0f), height - 1.0f); }
+        int CellOf(float x, float y) const { return CellY(y) * width + CellX(x); }
+    };
+    const CellMap& GetCellMap() const { return m_Map; }
+    int CellX(float x) const { return m_Map.CellX(x); }
+    int CellY(float y) const { return m_Map.CellY(y); }
+    int CellOf(float x, float y) const { return m_Map.CellOf(x, y); }
+
+    // cell the entity is in, or -1 if it is not in the grid
+    int EntityCell(EntityID id) const { return id < m_EntityCell.size() ? m_EntityCell[id] : -1; }
+    // cell of each entity (or -1), indexed by ID; has at least as many entries as given to Reserve
+    const int* EntityCells() const { return m_EntityCell.data(); }
+
+    // Makes room for entity IDs below the count.
+    void Reserve(size_t entityCount)
+    {
+        if (entityCount > m_EntityCell.size())
+        {
+            m_EntityCell.resize(entityCount, -1);
+            m_EntitySlot.resize(entityCount, 0);
+        }
+    }
+
+    // Puts entity into given cell (adding it to the grid if it was not in it).
+    void Move(EntityID id, int cell)
+    {
+        Reserve(id + 1);
+        int prev = m_EntityCell[id];
+        if (prev == cell)
+            return;
+        if (prev >= 0)
+            Unlink(id);
+        else
+            ++m_Count;
+        m_EntityCell[id] = cell;
+        ++m_MoveCount;
+        if (m_CellCount[cell] == m_CellStart[cell + 1] - m_CellStart[cell])
+        {
+            // no free slots left in the cell; repack puts the entity into it too
+            Repack();
+            return;
+        }
+        uint32_t slot = m_CellStart[cell] + m_CellCount[cell]++;
+        m_Slots[slot] = id;
+        m_EntitySlot[id] = slot;
+    }
+
+    void Remove(EntityID id)
+    {
+        if (EntityCell(id) < 0)
+            return;
+        Unlink(id);
+        m_EntityCell[id] = -1;
+        --m_Count;
+    }
+
+    // Applies a batch of (entity, new cell) moves. When many entities move at once (e.g. when
+    // initially adding everything), repacks the index once instead of relinking each of them.
+    void MoveBatch(const std::vector<std::pair<EntityID, int>>& moves)
+    {
+        if (moves.size() * 8 < m_Count)
+        {
+            for (const auto& m : moves)
+                Move(m.first, m.second);
+            return;
+        }
+        for (const auto& m : moves)
+        {
+            Reserve(m.first + 1);
+            m_Count += m_EntityCell[m.first] < 0;
+            m_EntityCell[m.first] = m.second;
+        }
+        m_MoveCount += moves.size();
+        Repack();
+    }
+
+    // Rebuilds the index from scratch from positions of the set members.
+    void Rebuild(const std::vector<PositionComponent>& positions, const EntitySet& set)
+    {
+        m_EntityCell.assign(positions.size(), -1);
+        m_EntitySlot.resize(positions.size());
+        m_Count = set.size();
+        set.ForEachRun([&](EntityID begin, EntityID end)
+        {
+            for (EntityID id = begin; id != end; ++id)
+                m_EntityCell[id] = CellOf(positions[id].x, positions[id].y);
+        });
+        Repack();
+    }
+
+    // Calls func(ids, count) with entities of each non-empty cell overlapping the rectangle (so
+    // some of them can be just outside of it).
+    template<typename F> void ForEachCellInRect(float xMin, float yMin, float xMax, float yMax, F func) const
+    {
+        int cx0 = CellX(xMin), cx1 = CellX(xMax);
+        int cy0 = CellY(yMin), cy1 = CellY(yMax);
+        for (int cy = cy0; cy <= cy1; ++cy)
+        {
+            for (int cell = cy * m_Map.width + cx0, end = cy * m_Map.width + cx1; cell <= end; ++cell)
+            {
+                if (m_CellCount[cell] != 0)
+                    func(m_Slots.data() + m_CellStart[cell], (size_t)m_CellCount[cell]);
+            }
+        }
+    }
+
+    // Calls func(ids, count) with entities of a cell.
+    template<typename F> void ForEachInCell(int cell, F func) const
+    {
+        func(m_Slots.data() + m_CellStart[cell], (size_t)m_CellCount[cell]);
+    }
+
+private:
+    // Takes entity out of its cell's range, by moving the last entity of the cell into its slot.
+    void Unlink(EntityID id)
+    {
+        int cell = m_EntityCell[id];
+        uint32_t slot = m_EntitySlot[id];
+        uint32_t last = m_CellStart[cell] + --m_CellCount[cell];
+        EntityID lastID = m_Slots[last];
+        m_Slots[slot] = lastID;
+        m_EntitySlot[lastID] = slot;
+    }
+
+    // Lays out all entities again in cell order (by ID within each cell), with half as many free
+    // slots in each cell on top of what is used.
+    void Repack()
+    {
+        int cellCount = CellCount();
+        m_CellCount.assign(cellCount, 0);
+        for (int cell : m_EntityCell)
+        {
+            if (cell >= 0)
+                m_CellCount[cell]++;
+        }
+        m_CellStart.resize(cellCount + 1);
+        uint32_t start = 0;
+        for (int cell = 0; cell < cellCount; ++cell)
+        {
+            m_CellStart[cell] = start;
+            start += m_CellCount[cell] + m_CellCount[cell] / 2 + 4;
+            m_CellCount[cell] = 0;
+        }
+        m_CellStart[cellCount] = start;
+        m_Slots.resize(start);
+        for (EntityID id = 0, n = m_EntityCell.size(); id != n; ++id)
+        {
+            int cell = m_EntityCell[id];
+            if (cell < 0)
+                continue;
+            uint32_t slot = m_CellStart[cell] + m_CellCount[cell]++;
+            m_Slots[slot] = id;
+            m_EntitySlot[id] = slot;
+        }
+        ++m_RepackCount;
+    }
+
+    CellMap m_Map;
+    float m_CellSize = 1.0f;
+    // per cell: where its range starts in m_Slots (with one extra entry for the end), and how many
+    // entities are in it
+    std::vector<uint32_t> m_CellStart;
+    std::vector<uint32_t> m_CellCount;
+    std::vector<EntityID> m_Slots;
+    // per entity: its cell (or -1) and slot
+    std::vector<int> m_EntityCell;
+    std::vector<uint32_t> m_EntitySlot;
+    size_t m_Count = 0;
+    size_t m_MoveCount = 0;
+    size_t m_RepackCount = 0;
+};
+
+
+// Cell-sorted index of entities, rebuilt from scratch from their positions: IDs of entities in each
+// cell are contiguous (in increasing ID order), with a table of where each cell starts. For
+// neighbour queries of any system that can't keep a SpatialGrid up to date incrementally.
+// Positions are copied into cell order too, so that queries read them sequentially instead of
+// from all over the position array.
+//
+// Built with a parallel two pass counting sort: set members are split into one contiguous part per
+// thread; first each part computes cells of its members and counts them per cell, then a prefix sum
+// over (cell, part) gives each part where to put its members of each cell, and finally each part
+// scatters its members there. Buffers are kept between builds, so rebuilding every frame does not
+// allocate memory.
+class CellIndex
+{
+public:
+    void Build(const SpatialGrid::CellMap& map, const std::vector<PositionComponent>& positions, const EntitySet& set, const ParallelSettings& parallel = ParallelSettings())
+    {
+        m_Map = map;
+        size_t count = set.size();
+        int cellCount = map.width * map.height;
+        int partCount = (int)std::max<size_t>(1, std::min<size_t>(parallel.threadCount, count / 4096));
+
+        // runs of the set, and index of the first member in each
+        m_Runs.clear();
+        m_RunStarts.clear();
+        size_t index = 0;
+        set.ForEachRun([&](EntityID begin, EntityID end)
+        {
+            m_Runs.emplace_back(begin, end);
+            m_RunStarts.push_back(index);
+            index += end - begin;
+        });
+
+        // one chunk per part (parts have to be in member order, so NUMA split can't be used)
+        ParallelSettings settings;
+        settings.threadCount = partCount;
+        settings.chunkSize = std::max<size_t>(1, (count + partCount - 1) / partCount);
+        m_MemberCells.resize(count);
+        m_Histograms.assign((size_t)partCount * cellCount, 0);
+
+        // pass 1: cell of each member, and member counts of each cell per part
+        ParallelFor(count, settings, [&](size_t first, size_t last)
+        {
+            uint32_t* histogram = m_Histograms.data() + first / settings.chunkSize * cellCount;
+            const SpatialGrid::CellMap cellMap = m_Map;
+            ForEachMemberRun(first, last, [&](size_t member, EntityID begin, EntityID end)
+            {
+                const PositionComponent* pos = positions.data();
+                int* cells = m_MemberCells.data() + member;
+                for (EntityID id = begin; id != end; ++id)
+                {
+                    int cell = cellMap.CellOf(pos[id].x, pos[id].y);
+                    *cells++ = cell;
+                    histogram[cell]++;
+                }
+            });
+        });
+
+        // prefix sum: where members of each part go within each cell; turns the histograms into
+        // write positions
+        m_CellStart.resize(cellCount + 1);
+        uint32_t start = 0;
+        for (int cell = 0; cell < cellCount; ++cell)
+        {
+            m_CellStart[cell] = start;
+            for (int part = 0; part < partCount; ++part)
+            {
+                uint32_t& h = m_Histograms[(size_t)part * cellCount + cell];
+                uint32_t n = h;
+                h = start;
+                start += n;
+            }
+        }
+        m_CellStart[cellCount] = start;
+
+        // pass 2: scatter members into their cells
+        m_IDs.resize(count);
+        m_Positions.resize(count);
+        ParallelFor(count, settings, [&](size_t first, size_t last)
+        {
+            uint32_t* offsets = m_Histograms.data() + first / settings.chunkSize * cellCount;
+            EntityID* ids = m_IDs.data();
+            PositionComponent* sortedPositions = m_Positions.data();
+            ForEachMemberRun(first, last, [&](size_t member, EntityID begin, EntityID end)
+            {
+                const int* cells = m_MemberCells.data() + member;
+                for (EntityID id = begin; id != end; ++id)
+                {
+                    uint32_t index = offsets[*cells++]++;
+                    ids[index] = id;
+                    sortedPositions[index] = positions[id];
+                }
+            });
+        });
+    }
+
+    const SpatialGrid::CellMap& GetCellMap() const { return m_Map; }
+    int CellCount() const { return m_Map.width * m_Map.height; }
+    size_t size() const { return m_IDs.size(); }
+
+    // IDs & positions of all entities, in cell order; entities of a cell are
+    // [CellStart(cell), CellStart(cell+1))
+    const EntityID* IDs() const { return m_IDs.data(); }
+    const PositionComponent* Positions() const { return m_Positions.data(); }
+    uint32_t CellStart(int cell) const { return m_CellStart[cell]; }
+
+    // Calls func(ids, count) with entities of cells overlapping the rectangle (so some of them can
+    // be just outside of it), one row of cells at a time.
+    template<typename F> void ForEachCellInRect(float xMin, float yMin, float xMax, float yMax, F func) const
+    {
+        int cx0 = m_Map.CellX(xMin), cx1 = m_Map.CellX(xMax);
+        int cy0 = m_Map.CellY(yMin), cy1 = m_Map.CellY(yMax);
+        for (int cy = cy0; cy <= cy1; ++cy)
+        {
+            // cells of a row are next to each other, so the whole row is one range
+            uint32_t begin = m_CellStart[cy * m_Map.width + cx0], end = m_CellStart[cy * m_Map.width + cx1 + 1];
+            if (begin != end)
+                func(m_IDs.data() + begin, (size_t)(end - begin));
+        }
+    }
+
+    // Same, but calls func(begin, end) with ranges of the IDs() & Positions() arrays.
+    template<typename F> void ForEachRangeInRect(float xMin, float yMin, float xMax, float yMax, F func) const
+    {
+        int cx0 = m_Map.CellX(xMin), cx1 = m_Map.CellX(xMax);
+        int cy0 = m_Map.CellY(yMin), cy1 = m_Map.CellY(yMax);
+        for (int cy = cy0; cy <= cy1; ++cy)
+        {
+            uint32_t begin = m_CellStart[cy * m_Map.width + cx0], end = m_CellStart[cy * m_Map.width + cx1 + 1];
+            if (begin != end)
+                func((size_t)begin, (size_t)end);
+        }
+    }
+
+    // Calls func(ids, count) with entities of a cell.
+    template<typename F> void ForEachInCell(int cell, F func) const
+    {
+        func(m_IDs.data() + m_CellStart[cell], (size_t)(m_CellStart[cell + 1] - m_CellStart[cell]));
+    }
+
+private:
+    // Calls func(member, begin, end) for pieces of runs covering members [first,last); member is
+    // the index of the first one.
+    template<typename F> void ForEachMemberRun(size_t first, size_t last, F func) const
+    {
+        size_t r = std::upper_bound(m_RunStarts.begin(), m_RunStarts.end(), first) - m_RunStarts.begin() - 1;
+        for (; first < last; ++r)
+        {
+            EntityID begin = m_Runs[r].first + (first - m_RunStarts[r]);
+            EntityID end = std::min<EntityID>(m_Runs[r].second, begin + (last - first));
+            func(first, begin, end);
+            first += end - begin;
+        }
+    }
+
+    SpatialGrid::CellMap m_Map;
+    std::vector<uint32_t> m_CellStart;
+    std::vector<EntityID> m_IDs;
+    std::vector<PositionComponent> m_Positions;
+    // build scratch: runs of the set, cell of each member, and per part histograms
+    std::vector<std::pair<EntityID, EntityID>> m_Runs;
+    std::vector<size_t> m_RunStarts;
+    std::vector<int> m_MemberCells;
+    std::vector<uint32_t> m_Histograms;
+};
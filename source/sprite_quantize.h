@@ -0,0 +1,120 @@
+#pragma once
+
+// Quantized sprite data, shared by everything that sends or stores sprite_data_t frames: positions
+// become 16 bit integers within a fixed range, and "attributes" (color, sprite index & scale) are
+// packed into one integer, so that checking whether they changed is cheap.
+
+#include "game.h"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+static const float kScaleQuant = 4096.0f;
+
+struct QuantParams
+{
+    float posMinX, posMinY, posStep;
+};
+
+struct QuantizedFrame
+{
+    int frame = -1;
+    // sorted sprite IDs (indices) when this is only part of the world, empty otherwise
+    std::vector<uint32_t> ids;
+    std::vector<uint16_t> x, y;
+    std::vector<uint64_t> attr; // r,g,b,sprite: 8 bits each, scale: 16 bits
+};
+
+static inline uint64_t QuantizeUnit(float v)
+{
+    return (uint64_t)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+static inline uint16_t QuantizePos(float v, float vmin, float invStep)
+{
+    return (uint16_t)std::min(std::max((v - vmin) * invStep + 0.5f, 0.0f), 65535.0f);
+}
+
+// Quantization range that covers the given frame, with some margin around it.
+static inline QuantParams ComputeQuantParams(const sprite_data_t* sprites, int count)
+{
+    float xmin = 0, xmax = 0, ymin = 0, ymax = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        xmin = std::min(xmin, sprites[i].posX); xmax = std::max(xmax, sprites[i].posX);
+        ymin = std::min(ymin, sprites[i].posY); ymax = std::max(ymax, sprites[i].posY);
+    }
+    float extent = std::max(xmax - xmin, ymax - ymin) * 1.1f + 1.0e-3f;
+    QuantParams q;
+    q.posMinX = (xmin + xmax - extent) * 0.5f;
+    q.posMinY = (ymin + ymax - extent) * 0.5f;
+    q.posStep = extent / 65535.0f;
+    return q;
+}
+
+static inline void Quantize(const sprite_data_t* sprites, int count, const QuantParams& q, QuantizedFrame& out)
+{
+    out.x.resize(count);
+    out.y.resize(count);
+    out.attr.resize(count);
+    float invStep = 1.0f / q.posStep;
+    for (int i = 0; i < count; ++i)
+    {
+        const sprite_data_t& s = sprites[i];
+        out.x[i] = QuantizePos(s.posX, q.posMinX, invStep);
+        out.y[i] = QuantizePos(s.posY, q.posMinY, invStep);
+        uint64_t scale = (uint64_t)std::min(s.scale * kScaleQuant + 0.5f, 65535.0f);
+        out.attr[i] = QuantizeUnit(s.colR) | QuantizeUnit(s.colG) << 8 | QuantizeUnit(s.colB) << 16 | ((uint64_t)s.sprite & 0xFF) << 24 | scale << 32;
+    }
+}
+
+static inline void DequantizeAttr(uint64_t a, sprite_data_t& s)
+{
+    // (converting from signed int is a lot cheaper than from uint64_t)
+    s.colR = (int)(a & 0xFF) * (1.0f / 255.0f);
+    s.colG = (int)((a >> 8) & 0xFF) * (1.0f / 255.0f);
+    s.colB = (int)((a >> 16) & 0xFF) * (1.0f / 255.0f);
+    s.sprite = (float)(int)((a >> 24) & 0xFF);
+    s.scale = (int)(a >> 32) * (1.0f / kScaleQuant);
+}
+
+static inline void Dequantize(const QuantizedFrame& in, const QuantParams& q, sprite_data_t* sprites)
+{
+    for (size_t i = 0, n = in.x.size(); i != n; ++i)
+    {
+        sprite_data_t& s = sprites[i];
+        s.posX = q.posMinX + in.x[i] * q.posStep;
+        s.posY = q.posMinY + in.y[i] * q.posStep;
+        DequantizeAttr(in.attr[i], s);
+    }
+}
+
+
+// Variable length integers, 7 bits per byte.
+
+static inline uint8_t* WriteVarint(uint8_t* dst, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *dst++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *dst++ = (uint8_t)v;
+    return dst;
+}
+
+static inline const uint8_t* ReadVarint(const uint8_t* src, uint32_t& v)
+{
+    v = 0;
+    for (int shift = 0; ; shift += 7)
+    {
+        uint8_t b = *src++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (b < 0x80)
+            return src;
+    }
+}
+
+// Deltas of 16 bit values (wrapping around), mapped so that small magnitudes are small numbers.
+static inline uint32_t ZigZag16(uint16_t delta) { return (uint16_t)((delta << 1) ^ (uint16_t)((int16_t)delta >> 15)); }
+static inline uint16_t UnZigZag16(uint32_t v) { return (uint16_t)((v >> 1) ^ (0u - (v & 1))); }
@@ -0,0 +1,593 @@
+#include "sprite_stream.h"
+#include "sprite_quantize.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#define ftell64 _ftelli64
+#define fseek64 _fseeki64
+#else
+#define ftell64 ftello
+#define fseek64 fseeko
+#endif
+
+
+// Sprite stream file layout:
+// - SpriteStreamHeader (written when the first frame is recorded, since quantization depends on it)
+// - every frame: SpriteStreamFrame, then its planes (see below)
+// - file offset of every block
+// - SpriteStreamFooter
+
+static const uint32_t kSpriteStreamMagic = 0x53444F44; // "DODS"
+static const uint32_t kSpriteStreamVersion = 1;
+
+// every this many frames a new block starts with a keyframe; this bounds how many frames have to be
+// decoded when seeking
+static const int kBlockFrames = 30;
+
+struct SpriteStreamHeader
+{
+    uint32_t magic, version;
+    QuantParams quant;
+    int32_t blockFrames;
+};
+
+struct SpriteStreamFrame
+{
+    uint32_t size; // of the planes that follow
+    int32_t spriteCount;
+    int32_t keyframe;
+    uint32_t padding;
+};
+
+struct SpriteStreamFooter
+{
+    int32_t frameCount, blockCount;
+    int64_t tablesOffset;
+    uint32_t magic, padding;
+};
+
+
+// -------------------------------------------------------------------------------------------------
+// Entropy coding of byte planes: order-0 rANS, with 12 bit probabilities and four interleaved states
+// (so that the decoder has several independent dependency chains to work on). See Fabian Giesen's
+// "rANS notes" and ryg_rans. A plane is stored as: symbol count, mode byte, and then either the raw
+// bytes, or 256 symbol frequencies, encoded size and rANS data.
+
+static const int kProbBits = 12;
+static const uint32_t kProbScale = 1u << kProbBits;
+static const uint32_t kRansL = 1u << 16; // lower bound of the normalized state; renormalized 16 bits at a time
+static const int kRansStates = 4;
+static const size_t kMinRansPlaneSize = 4096; // smaller planes are not worth the frequency table
+
+enum PlaneMode { kPlaneRaw = 0, kPlaneRans = 1 };
+
+static inline void Append(std::vector<uint8_t>& out, const void* data, size_t size)
+{
+    out.insert(out.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+}
+
+static inline uint32_t Read32(const uint8_t* src)
+{
+    uint32_t v;
+    memcpy(&v, src, 4);
+    return v;
+}
+
+// Scales symbol counts so that they sum up to kProbScale, keeping every present symbol non-zero.
+static void NormalizeFrequencies(const uint32_t counts[256], size_t total, uint16_t freq[256])
+{
+    uint32_t sum = 0;
+    int largest = 0;
+    for (int s = 0; s < 256; ++s)
+    {
+        freq[s] = counts[s] ? (uint16_t)std::max<uint64_t>(1, (uint64_t)counts[s] * kProbScale / total) : 0;
+        sum += freq[s];
+        if (freq[s] > freq[largest])
+            largest = s;
+    }
+    // rounding down leaves a bit of room that goes to the most common symbol; but if lots of rare
+    // symbols got bumped up to 1, take the excess away from the most common ones instead
+    while (sum > kProbScale)
+    {
+        int s = (int)(std::max_element(freq, freq + 256) - freq);
+        --freq[s];
+        --sum;
+    }
+    freq[largest] += (uint16_t)(kProbScale - sum);
+}
+
+static inline void RansPut(uint32_t& x, uint8_t*& ptr, uint32_t freq, uint32_t start)
+{
+    uint64_t xMax = (uint64_t)((kRansL >> kProbBits) << 16) * freq;
+    if (x >= xMax)
+    {
+        ptr -= 2;
+        ptr[0] = (uint8_t)x; ptr[1] = (uint8_t)(x >> 8);
+        x >>= 16;
+    }
+    x = ((x / freq) << kProbBits) + (x % freq) + start;
+}
+
+static inline void RansFlush(uint32_t x, uint8_t*& ptr)
+{
+    ptr -= 4;
+    ptr[0] = (uint8_t)x; ptr[1] = (uint8_t)(x >> 8); ptr[2] = (uint8_t)(x >> 16); ptr[3] = (uint8_t)(x >> 24);
+}
+
+static void EncodePlane(const std::vector<uint8_t>& in, std::vector<uint8_t>& out, std::vector<uint8_t>& scratch)
+{
+    uint32_t n = (uint32_t)in.size();
+    Append(out, &n, 4);
+    if (n >= kMinRansPlaneSize)
+    {
+        uint32_t counts[256] = {};
+        for (uint8_t s : in)
+            counts[s]++;
+        uint16_t freq[256];
+        uint32_t start[256];
+        NormalizeFrequencies(counts, n, freq);
+        for (int s = 0, cum = 0; s < 256; cum += freq[s++])
+            start[s] = cum;
+
+        // rANS encodes backwards; symbol i goes to state i%kRansStates
+        scratch.resize(n * 2 + 16);
+        uint8_t* end = scratch.data() + scratch.size();
+        uint8_t* ptr = end;
+        uint32_t x[kRansStates];
+        for (uint32_t& s : x)
+            s = kRansL;
+        uint32_t i = n;
+        while (i % kRansStates)
+        {
+            --i;
+            RansPut(x[i % kRansStates], ptr, freq[in[i]], start[in[i]]);
+        }
+        while (i > 0)
+        {
+            i -= 4;
+            RansPut(x[3], ptr, freq[in[i + 3]], start[in[i + 3]]);
+            RansPut(x[2], ptr, freq[in[i + 2]], start[in[i + 2]]);
+            RansPut(x[1], ptr, freq[in[i + 1]], start[in[i + 1]]);
+            RansPut(x[0], ptr, freq[in[i]], start[in[i]]);
+        }
+        for (int s = kRansStates - 1; s >= 0; --s)
+            RansFlush(x[s], ptr);
+
+        uint32_t size = (uint32_t)(end - ptr);
+        if (size + sizeof(freq) + 4 < n)
+        {
+            out.push_back(kPlaneRans);
+            Append(out, freq, sizeof(freq));
+            Append(out, &size, 4);
+            Append(out, ptr, size);
+            return;
+        }
+    }
+    out.push_back(kPlaneRaw);
+    Append(out, in.data(), n);
+}
+
+static inline uint8_t RansGet(uint32_t& x, const uint8_t*& ptr, const uint32_t* table)
+{
+    uint32_t e = table[x & (kProbScale - 1)];
+    x = ((e >> 20) + 1) * (x >> kProbBits) + ((e >> 8) & 0xFFF);
+    // branchless renormalization, since whether it is needed is quite random; this always reads
+    // two bytes, so input needs that much padding at the end
+    uint32_t word = ptr[0] | ptr[1] << 8;
+    bool renormalize = x < kRansL;
+    x = renormalize ? (x << 16) | word : x;
+    ptr += renormalize ? 2 : 0;
+    return (uint8_t)e;
+}
+
+// Returns pointer past the plane, or null if data is malformed.
+static const uint8_t* DecodePlane(const uint8_t* src, const uint8_t* end, std::vector<uint8_t>& out)
+{
+    if (end - src < 5)
+        return NULL;
+    uint32_t n = Read32(src);
+    uint8_t mode = src[4];
+    src += 5;
+    out.resize(n);
+    if (mode == kPlaneRaw)
+    {
+        if ((size_t)(end - src) < n)
+            return NULL;
+        memcpy(out.data(), src, n);
+        return src + n;
+    }
+    if (end - src < 256 * 2 + 4)
+        return NULL;
+    uint16_t freq[256];
+    memcpy(freq, src, sizeof(freq));
+    uint32_t size = Read32(src + sizeof(freq));
+    src += sizeof(freq) + 4;
+    if ((size_t)(end - src) < size || size < kRansStates * 4)
+        return NULL;
+
+    // one table entry per probability slot: symbol (8 bits), slot offset from symbol start (12 bits),
+    // symbol frequency minus one (12 bits)
+    uint32_t table[kProbScale];
+    uint32_t cum = 0;
+    for (uint32_t s = 0; s < 256; ++s)
+    {
+        if (cum + freq[s] > kProbScale)
+            return NULL;
+        for (uint32_t j = 0; j < freq[s]; ++j)
+            table[cum + j] = s | j << 8 | (uint32_t)(freq[s] - 1) << 20;
+        cum += freq[s];
+    }
+    if (cum != kProbScale)
+        return NULL;
+
+    const uint8_t* ptr = src;
+    uint32_t x0 = Read32(ptr), x1 = Read32(ptr + 4), x2 = Read32(ptr + 8), x3 = Read32(ptr + 12);
+    ptr += 16;
+    uint8_t* dst = out.data();
+    uint32_t i = 0;
+    for (; i + 3 < n; i += 4)
+    {
+        dst[i + 0] = RansGet(x0, ptr, table);
+        dst[i + 1] = RansGet(x1, ptr, table);
+        dst[i + 2] = RansGet(x2, ptr, table);
+        dst[i + 3] = RansGet(x3, ptr, table);
+    }
+    uint32_t* tail[3] = { &x0, &x1, &x2 };
+    for (; i < n; ++i)
+        dst[i] = RansGet(*tail[i % kRansStates], ptr, table);
+    // corrupt data could make the decoder read past its input; at least don't silently accept it
+    if (ptr > src + size)
+        return NULL;
+    return src + size;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Frame encoding. Each frame is four byte planes:
+// - motion: for every sprite one byte with zigzag-encoded differences of x and y from their
+//   predicted values, 4 bits each; or kEscape if either does not fit;
+// - escape low & high bytes: both 16 bit differences of escaped sprites;
+// - attributes: on keyframes all of them (6 bytes each), otherwise varint index gap & 6 bytes for
+//   every sprite where they changed.
+// Prediction is linear extrapolation of the previous two frames, so sprites moving at constant
+// speed have nearly zero differences; with less history (right after a keyframe) it is just the
+// previous position, or zero on a keyframe itself.
+
+static const uint32_t kEscape = 0xFF;
+static const int kAttrBytes = 6;
+
+enum { kPlaneMotion, kPlaneEscapeLo, kPlaneEscapeHi, kPlaneAttr, kPlaneCount };
+
+static inline uint16_t Predict(int history, const uint16_t* prev, const uint16_t* prev2, size_t i)
+{
+    if (history >= 2)
+        return (uint16_t)(2 * prev[i] - prev2[i]);
+    return history == 1 ? prev[i] : 0;
+}
+
+static inline uint8_t EncodeMotion(uint16_t x, uint16_t y, uint16_t predX, uint16_t predY, std::vector<uint8_t>* planes)
+{
+    uint32_t vx = ZigZag16((uint16_t)(x - predX));
+    uint32_t vy = ZigZag16((uint16_t)(y - predY));
+    if (vx < 15 && vy < 15)
+        return (uint8_t)(vx << 4 | vy);
+    planes[kPlaneEscapeLo].push_back((uint8_t)vx);
+    planes[kPlaneEscapeLo].push_back((uint8_t)vy);
+    planes[kPlaneEscapeHi].push_back((uint8_t)(vx >> 8));
+    planes[kPlaneEscapeHi].push_back((uint8_t)(vy >> 8));
+    return kEscape;
+}
+
+static inline uint8_t* WriteAttr(uint8_t* dst, uint64_t a)
+{
+    for (int b = 0; b < kAttrBytes; ++b)
+        *dst++ = (uint8_t)(a >> (b * 8));
+    return dst;
+}
+
+static inline const uint8_t* ReadAttr(const uint8_t* src, uint64_t& a)
+{
+    a = 0;
+    for (int b = 0; b < kAttrBytes; ++b)
+        a |= (uint64_t)*src++ << (b * 8);
+    return src;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Recording
+
+struct SpriteStreamRecorder
+{
+    FILE* file = NULL;
+    QuantParams quant;
+    int frameCount = 0;
+    int history = 0; // how many previous frames can be used for prediction
+    QuantizedFrame cur, prev, prev2;
+    std::vector<uint8_t> planes[kPlaneCount];
+    std::vector<uint8_t> encoded, scratch;
+    std::vector<int64_t> blockOffsets;
+};
+
+static SpriteStreamRecorder s_Recorder;
+
+extern "C" int sprite_stream_record_begin(const char* path)
+{
+    sprite_stream_record_end();
+    s_Recorder.file = fopen(path, "wb");
+    return s_Recorder.file != NULL;
+}
+
+extern "C" void sprite_stream_record_frame(const sprite_data_t* data, int spriteCount)
+{
+    SpriteStreamRecorder& r = s_Recorder;
+    if (r.file == NULL)
+        return;
+    if (r.frameCount == 0)
+    {
+        r.quant = ComputeQuantParams(data, spriteCount);
+        SpriteStreamHeader header = { kSpriteStreamMagic, kSpriteStreamVersion, r.quant, kBlockFrames };
+        fwrite(&header, sizeof(header), 1, r.file);
+    }
+    if (r.frameCount % kBlockFrames == 0)
+    {
+        r.blockOffsets.push_back(ftell64(r.file));
+        r.history = 0;
+    }
+    if (r.history > 0 && (size_t)spriteCount != r.prev.x.size())
+        r.history = 0;
+    bool keyframe = r.history == 0;
+
+    Quantize(data, spriteCount, r.quant, r.cur);
+    for (std::vector<uint8_t>& p : r.planes)
+        p.clear();
+    std::vector<uint8_t>& motion = r.planes[kPlaneMotion];
+    std::vector<uint8_t>& attr = r.planes[kPlaneAttr];
+    motion.resize(spriteCount);
+    for (int i = 0; i < spriteCount; ++i)
+        motion[i] = EncodeMotion(r.cur.x[i], r.cur.y[i], Predict(r.history, r.prev.x.data(), r.prev2.x.data(), i), Predict(r.history, r.prev.y.data(), r.prev2.y.data(), i), r.planes);
+    if (keyframe)
+    {
+        attr.resize((size_t)spriteCount * kAttrBytes);
+        uint8_t* dst = attr.data();
+        for (int i = 0; i < spriteCount; ++i)
+            dst = WriteAttr(dst, r.cur.attr[i]);
+    }
+    else
+    {
+        uint8_t buf[16];
+        for (int i = 0, next = 0; i < spriteCount; ++i)
+        {
+            if (r.cur.attr[i] == r.prev.attr[i])
+                continue;
+            uint8_t* dst = WriteVarint(buf, i - next);
+            dst = WriteAttr(dst, r.cur.attr[i]);
+            attr.insert(attr.end(), buf, dst);
+            next = i + 1;
+        }
+    }
+
+    r.encoded.clear();
+    for (const std::vector<uint8_t>& p : r.planes)
+        EncodePlane(p, r.encoded, r.scratch);
+    SpriteStreamFrame frame = { (uint32_t)r.encoded.size(), spriteCount, keyframe, 0 };
+    fwrite(&frame, sizeof(frame), 1, r.file);
+    fwrite(r.encoded.data(), 1, r.encoded.size(), r.file);
+
+    std::swap(r.prev2, r.prev);
+    std::swap(r.prev, r.cur);
+    r.history = std::min(r.history + 1, 2);
+    ++r.frameCount;
+}
+
+extern "C" void sprite_stream_record_end(void)
+{
+    SpriteStreamRecorder& r = s_Recorder;
+    if (r.file == NULL)
+        return;
+    if (r.frameCount == 0)
+    {
+        SpriteStreamHeader header = { kSpriteStreamMagic, kSpriteStreamVersion, {0, 0, 1}, kBlockFrames };
+        fwrite(&header, sizeof(header), 1, r.file);
+    }
+    SpriteStreamFooter footer = {};
+    footer.frameCount = r.frameCount;
+    footer.blockCount = (int)r.blockOffsets.size();
+    footer.tablesOffset = ftell64(r.file);
+    footer.magic = kSpriteStreamMagic;
+    fwrite(r.blockOffsets.data(), sizeof(r.blockOffsets[0]), r.blockOffsets.size(), r.file);
+    fwrite(&footer, sizeof(footer), 1, r.file);
+    fclose(r.file);
+    r = SpriteStreamRecorder();
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Playback
+
+struct SpriteStreamPlayer
+{
+    FILE* file = NULL;
+    SpriteStreamHeader header;
+    int frameCount = 0;
+    int nextFrame = 0;
+    int history = 0;
+    std::vector<int64_t> blockOffsets;
+    std::vector<uint16_t> x, y, prevX, prevY, prev2X, prev2Y;
+    std::vector<uint64_t> attr;
+    std::vector<uint8_t> planes[kPlaneCount];
+    std::vector<uint8_t> encoded;
+};
+
+static SpriteStreamPlayer s_Player;
+
+// Reads and decodes the next frame into quantized state, and into data if that is not null; returns
+// amount of sprites, or negative on failure.
+static int DecodeNextFrame(sprite_data_t* data)
+{
+    SpriteStreamPlayer& p = s_Player;
+    SpriteStreamFrame frame;
+    if (fread(&frame, sizeof(frame), 1, p.file) != 1 || frame.spriteCount < 0 || frame.spriteCount > kMaxSpriteCount)
+        return -1;
+    p.encoded.resize(frame.size + 2); // padding for rANS decoding
+    if (fread(p.encoded.data(), 1, frame.size, p.file) != frame.size)
+        return -1;
+    const uint8_t* src = p.encoded.data();
+    const uint8_t* end = src + frame.size;
+    for (std::vector<uint8_t>& plane : p.planes)
+    {
+        src = DecodePlane(src, end, plane);
+        if (src == NULL)
+            return -1;
+    }
+    size_t n = (size_t)frame.spriteCount;
+    if (frame.keyframe)
+        p.history = 0;
+    else if (p.history == 0 || p.x.size() != n)
+        return -1;
+    const std::vector<uint8_t>& motion = p.planes[kPlaneMotion];
+    const std::vector<uint8_t>& escLo = p.planes[kPlaneEscapeLo];
+    const std::vector<uint8_t>& escHi = p.planes[kPlaneEscapeHi];
+    if (motion.size() != n || escLo.size() != escHi.size())
+        return -1;
+
+    const std::vector<uint8_t>& attrPlane = p.planes[kPlaneAttr];
+    const uint8_t* a = attrPlane.data();
+    const uint8_t* aEnd = a + attrPlane.size();
+    if (frame.keyframe)
+    {
+        if (attrPlane.size() != n * kAttrBytes)
+            return -1;
+        p.attr.resize(n);
+        for (size_t i = 0; i < n; ++i)
+            a = ReadAttr(a, p.attr[i]);
+    }
+    else
+    {
+        for (uint32_t next = 0; a < aEnd; )
+        {
+            uint32_t gap;
+            a = ReadVarint(a, gap);
+            next += gap;
+            if (next >= n || aEnd - a < kAttrBytes)
+                return -1;
+            a = ReadAttr(a, p.attr[next++]);
+        }
+    }
+
+    // reconstruct positions, and output the whole frame in the same pass; previous frames shift
+    // down, and the oldest buffer gets reused
+    std::swap(p.prev2X, p.prevX); std::swap(p.prev2Y, p.prevY);
+    std::swap(p.prevX, p.x); std::swap(p.prevY, p.y);
+    p.x.resize(n);
+    p.y.resize(n);
+    uint16_t* x = p.x.data();
+    uint16_t* y = p.y.data();
+    const uint16_t* prevX = p.prevX.data(); const uint16_t* prev2X = p.prev2X.data();
+    const uint16_t* prevY = p.prevY.data(); const uint16_t* prev2Y = p.prev2Y.data();
+    int history = p.history;
+    const uint64_t* attr = p.attr.data();
+    const QuantParams q = p.header.quant;
+    size_t esc = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        uint32_t m = motion[i];
+        uint32_t vx = m >> 4, vy = m & 15;
+        if (m == kEscape)
+        {
+            if (esc + 2 > escLo.size())
+                return -1;
+            vx = escLo[esc] | escHi[esc] << 8;
+            vy = escLo[esc + 1] | escHi[esc + 1] << 8;
+            esc += 2;
+        }
+        x[i] = (uint16_t)(Predict(history, prevX, prev2X, i) + UnZigZag16(vx));
+        y[i] = (uint16_t)(Predict(history, prevY, prev2Y, i) + UnZigZag16(vy));
+        if (data)
+        {
+            sprite_data_t& s = data[i];
+            s.posX = q.posMinX + x[i] * q.posStep;
+            s.posY = q.posMinY + y[i] * q.posStep;
+            DequantizeAttr(attr[i], s);
+        }
+    }
+    p.history = std::min(p.history + 1, 2);
+    return frame.spriteCount;
+}
+
+extern "C" int sprite_stream_play_begin(const char* path)
+{
+    sprite_stream_play_end();
+    SpriteStreamPlayer& p = s_Player;
+    p.file = fopen(path, "rb");
+    if (p.file == NULL)
+        return -1;
+    SpriteStreamFooter footer;
+    if (fread(&p.header, sizeof(p.header), 1, p.file) != 1 || p.header.magic != kSpriteStreamMagic || p.header.version != kSpriteStreamVersion ||
+        fseek64(p.file, -(int64_t)sizeof(footer), SEEK_END) != 0 || fread(&footer, sizeof(footer), 1, p.file) != 1 || footer.magic != kSpriteStreamMagic ||
+        p.header.blockFrames <= 0 || footer.blockCount != (footer.frameCount + p.header.blockFrames - 1) / p.header.blockFrames)
+    {
+        sprite_stream_play_end();
+        return -1;
+    }
+    p.blockOffsets.resize(footer.blockCount);
+    fseek64(p.file, footer.tablesOffset, SEEK_SET);
+    if (fread(p.blockOffsets.data(), sizeof(p.blockOffsets[0]), p.blockOffsets.size(), p.file) != p.blockOffsets.size())
+    {
+        sprite_stream_play_end();
+        return -1;
+    }
+    p.frameCount = footer.frameCount;
+    fseek64(p.file, sizeof(p.header), SEEK_SET);
+    return p.frameCount;
+}
+
+extern "C" int sprite_stream_seek(int frame)
+{
+    SpriteStreamPlayer& p = s_Player;
+    if (p.file == NULL || frame < 0 || frame > p.frameCount)
+        return 0;
+    if (frame == p.frameCount)
+    {
+        p.nextFrame = frame;
+        return 1;
+    }
+    // continue from where we are if that is in the same block, otherwise start at the block keyframe
+    int block = frame / p.header.blockFrames;
+    if (p.nextFrame > frame || p.nextFrame < block * p.header.blockFrames)
+    {
+        p.nextFrame = block * p.header.blockFrames;
+        p.history = 0;
+        fseek64(p.file, p.blockOffsets[block], SEEK_SET);
+    }
+    while (p.nextFrame < frame)
+    {
+        if (DecodeNextFrame(NULL) < 0)
+            return 0;
+        ++p.nextFrame;
+    }
+    return 1;
+}
+
+extern "C" int sprite_stream_play_frame(sprite_data_t* data)
+{
+    SpriteStreamPlayer& p = s_Player;
+    if (p.file == NULL || p.nextFrame >= p.frameCount)
+        return -1;
+    int count = DecodeNextFrame(data);
+    if (count < 0)
+        return -1;
+    ++p.nextFrame;
+    return count;
+}
+
+extern "C" void sprite_stream_play_end(void)
+{
+    if (s_Player.file)
+        fclose(s_Player.file);
+    s_Player = SpriteStreamPlayer();
+}
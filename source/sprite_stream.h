@@ -0,0 +1,37 @@
+#pragma once
+
+#include "game.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Recording of the rendered sprite data itself (not the simulation), so that it can be played back
+// without running game_update at all, e.g. for capturing or profiling the rendering side.
+//
+// Every frame is quantized (see sprite_quantize.h), and positions are predicted from the two previous
+// frames, assuming sprites keep moving the same way; only the prediction errors are stored, and those
+// are nearly all tiny. Colors etc. are stored only for sprites where they changed. The resulting byte
+// streams are entropy coded with rANS, which decodes a lot faster than e.g. zlib at a similar ratio.
+//
+// Frames are grouped into blocks that start with a keyframe (a frame not predicted from previous
+// ones), and the file ends with a table of blocks, so playback can seek to any frame quickly.
+
+// Recording: call sprite_stream_record_frame with sprite data of every frame. Returns zero on failure.
+int sprite_stream_record_begin(const char* path);
+void sprite_stream_record_frame(const sprite_data_t* data, int spriteCount);
+void sprite_stream_record_end(void);
+
+// Playback: sprite_stream_play_begin returns number of recorded frames (negative on failure).
+// sprite_stream_seek makes given frame be the next one played; sprite_stream_play_frame decodes the
+// next frame into data and returns the amount of sprites (negative when at the end).
+int sprite_stream_play_begin(const char* path);
+int sprite_stream_seek(int frame);
+int sprite_stream_play_frame(sprite_data_t* data);
+void sprite_stream_play_end(void);
+
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,798 @@
+#include "stream.h"
+#include "sprite_quantize.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET Socket;
+static const Socket kInvalidSocket = INVALID_SOCKET;
+static void CloseSocket(Socket s) { closesocket(s); }
+static bool SocketWouldBlock() { return WSAGetLastError() == WSAEWOULDBLOCK; }
+static void SetNonBlocking(Socket s) { u_long mode = 1; ioctlsocket(s, FIONBIO, &mode); }
+static void InitSockets() { static bool done = false; if (!done) { WSADATA data; WSAStartup(MAKEWORD(2, 2), &data); done = true; } }
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+typedef int Socket;
+static const Socket kInvalidSocket = -1;
+static void CloseSocket(Socket s) { close(s); }
+static bool SocketWouldBlock() { return errno == EAGAIN || errno == EWOULDBLOCK; }
+static void SetNonBlocking(Socket s) { fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK); }
+static void InitSockets() { }
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+
+static double TimeNow()
+{
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+static void SetupSocket(Socket s)
+{
+    int one = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    #ifdef SO_NOSIGPIPE
+    setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, (const char*)&one, sizeof(one));
+    #endif
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Protocol: each message is a MessageHeader followed by "size" bytes of payload.
+// Server sends Hello once (quantization parameters), and then Frame messages. Client sends an Ack
+// for each frame it decoded. Client can also send a Viewport, after which it gets ViewFrame messages
+// with only the sprites inside of it.
+
+static const uint32_t kStreamMagic = 0x53444F44; // "DODS"
+static const uint32_t kStreamVersion = 1;
+
+enum { kMsgHello = 1, kMsgFrame = 2, kMsgViewFrame = 3 }; // server -> client
+enum { kMsgAck = 1, kMsgViewport = 2 }; // client -> server
+
+struct MessageHeader
+{
+    uint32_t type, size;
+};
+
+struct HelloMessage
+{
+    uint32_t magic, version;
+    QuantParams quant;
+    uint32_t padding;
+};
+
+// followed by posBytes of position deltas, then the attribute changes
+struct FrameMessage
+{
+    int32_t frame, baseFrame;
+    uint32_t spriteCount, posBytes;
+    double sendTime;
+};
+
+// followed by IDs of sprites that left the view, IDs & data of sprites that entered it, and then
+// position deltas & attribute changes of sprites that stayed in view
+struct ViewFrameMessage
+{
+    int32_t frame, baseFrame;
+    uint32_t leftCount, enterCount, stayCount, padding;
+    double sendTime;
+};
+
+struct AckMessage
+{
+    int32_t frame;
+};
+
+// in sprite coordinates; min > max means "everything"
+struct ViewportMessage
+{
+    float xMin, yMin, xMax, yMax;
+};
+
+
+static const int kHistorySize = 8;
+
+
+// -------------------------------------------------------------------------------------------------
+// Frame encoding, against a base frame (or from scratch when there is none):
+// - position deltas: zigzag encoded 16 bit differences as varints, usually one byte each.
+// - attributes: count of changed sprites, then for each: varint index gap since previous changed one,
+//   and 6 bytes of attribute data.
+
+// Appends a complete frame message to out
+static void EncodeFrame(const QuantizedFrame& cur, const QuantizedFrame* base, double sendTime, std::vector<uint8_t>& out)
+{
+    size_t count = cur.x.size();
+    if (base != NULL && base->x.size() != count)
+        base = NULL;
+
+    size_t start = out.size();
+    out.resize(start + sizeof(MessageHeader) + sizeof(FrameMessage) + count * 17 + 4);
+    uint8_t* dst = out.data() + start + sizeof(MessageHeader) + sizeof(FrameMessage);
+
+    uint8_t* posStart = dst;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint16_t bx = base ? base->x[i] : 0;
+        uint16_t by = base ? base->y[i] : 0;
+        dst = WriteVarint(dst, ZigZag16((uint16_t)(cur.x[i] - bx)));
+        dst = WriteVarint(dst, ZigZag16((uint16_t)(cur.y[i] - by)));
+    }
+    uint32_t posBytes = (uint32_t)(dst - posStart);
+
+    uint8_t* changedCountPtr = dst;
+    dst += 4;
+    uint32_t changedCount = 0;
+    size_t prevChanged = (size_t)-1;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint64_t a = cur.attr[i];
+        if (base != NULL && base->attr[i] == a)
+            continue;
+        dst = WriteVarint(dst, (uint32_t)(i - prevChanged - 1));
+        memcpy(dst, &a, 6);
+        dst += 6;
+        prevChanged = i;
+        ++changedCount;
+    }
+    memcpy(changedCountPtr, &changedCount, 4);
+
+    size_t payloadSize = dst - (out.data() + start + sizeof(MessageHeader));
+    MessageHeader mh = { kMsgFrame, (uint32_t)payloadSize };
+    FrameMessage fm = { cur.frame, base ? base->frame : -1, (uint32_t)count, posBytes, sendTime };
+    memcpy(out.data() + start, &mh, sizeof(mh));
+    memcpy(out.data() + start + sizeof(mh), &fm, sizeof(fm));
+    out.resize(start + sizeof(MessageHeader) + payloadSize);
+}
+
+static bool DecodeFrame(const uint8_t* src, size_t size, const QuantizedFrame* base, const FrameMessage& fm, QuantizedFrame& cur)
+{
+    size_t count = fm.spriteCount;
+    if (base != NULL && base->x.size() != count)
+        return false;
+    cur.frame = fm.frame;
+    cur.ids.clear();
+    cur.x.resize(count);
+    cur.y.resize(count);
+    cur.attr.resize(count);
+    const uint8_t* end = src + size;
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t dx, dy;
+        src = ReadVarint(src, dx);
+        src = ReadVarint(src, dy);
+        cur.x[i] = (uint16_t)((base ? base->x[i] : 0) + UnZigZag16(dx));
+        cur.y[i] = (uint16_t)((base ? base->y[i] : 0) + UnZigZag16(dy));
+    }
+    if (base != NULL)
+        cur.attr = base->attr;
+    uint32_t changedCount;
+    memcpy(&changedCount, src, 4);
+    src += 4;
+    size_t idx = (size_t)-1;
+    for (uint32_t c = 0; c < changedCount; ++c)
+    {
+        uint32_t gap;
+        src = ReadVarint(src, gap);
+        idx += gap + 1;
+        if (idx >= count)
+            return false;
+        uint64_t a = 0;
+        memcpy(&a, src, 6);
+        src += 6;
+        cur.attr[idx] = a;
+    }
+    return src <= end;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// Frames for clients that only see part of the world ("interest management"). Each frame is encoded
+// against the set of sprites visible in the base frame: sprites that left the view are sent just as
+// IDs, sprites that entered it with their full data, and the ones that stayed as deltas like above.
+
+static inline uint8_t* WriteIdGaps(uint8_t* dst, const std::vector<uint32_t>& ids)
+{
+    uint32_t prev = (uint32_t)-1;
+    for (uint32_t id : ids)
+    {
+        dst = WriteVarint(dst, id - prev - 1);
+        prev = id;
+    }
+    return dst;
+}
+
+static inline const uint8_t* ReadIdGaps(const uint8_t* src, uint32_t count, std::vector<uint32_t>& ids)
+{
+    ids.resize(count);
+    uint32_t prev = (uint32_t)-1;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t gap;
+        src = ReadVarint(src, gap);
+        prev += gap + 1;
+        ids[i] = prev;
+    }
+    return src;
+}
+
+// cur is the whole world, visible are the sorted sprite IDs in view now, baseVisible the ones that
+// were visible in base frame (base can be null)
+static void EncodeViewFrame(const QuantizedFrame& cur, const std::vector<uint32_t>& visible, const QuantizedFrame* base, const std::vector<uint32_t>& baseVisible, double sendTime, std::vector<uint8_t>& out)
+{
+    std::vector<uint32_t> left, entered, stayed;
+    size_t i = 0, j = 0, nb = base ? baseVisible.size() : 0, nc = visible.size();
+    while (i < nb || j < nc)
+    {
+        if (j == nc || (i < nb && baseVisible[i] < visible[j]))
+            left.push_back(baseVisible[i++]);
+        else if (i == nb || visible[j] < baseVisible[i])
+            entered.push_back(visible[j++]);
+        else
+        {
+            stayed.push_back(visible[j]);
+            ++i, ++j;
+        }
+    }
+
+    size_t start = out.size();
+    out.resize(start + sizeof(MessageHeader) + sizeof(ViewFrameMessage) + left.size() * 5 + entered.size() * 15 + stayed.size() * 17 + 4);
+    uint8_t* dst = out.data() + start + sizeof(MessageHeader) + sizeof(ViewFrameMessage);
+    dst = WriteIdGaps(dst, left);
+    dst = WriteIdGaps(dst, entered);
+    for (uint32_t id : entered)
+    {
+        memcpy(dst, &cur.x[id], 2);
+        memcpy(dst + 2, &cur.y[id], 2);
+        memcpy(dst + 4, &cur.attr[id], 6);
+        dst += 10;
+    }
+    for (uint32_t id : stayed)
+    {
+        dst = WriteVarint(dst, ZigZag16((uint16_t)(cur.x[id] - base->x[id])));
+        dst = WriteVarint(dst, ZigZag16((uint16_t)(cur.y[id] - base->y[id])));
+    }
+    uint8_t* changedCountPtr = dst;
+    dst += 4;
+    uint32_t changedCount = 0;
+    size_t prevChanged = (size_t)-1;
+    for (size_t s = 0; s < stayed.size(); ++s)
+    {
+        uint64_t a = cur.attr[stayed[s]];
+        if (base->attr[stayed[s]] == a)
+            continue;
+        dst = WriteVarint(dst, (uint32_t)(s - prevChanged - 1));
+        memcpy(dst, &a, 6);
+        dst += 6;
+        prevChanged = s;
+        ++changedCount;
+    }
+    memcpy(changedCountPtr, &changedCount, 4);
+
+    size_t payloadSize = dst - (out.data() + start + sizeof(MessageHeader));
+    MessageHeader mh = { kMsgViewFrame, (uint32_t)payloadSize };
+    ViewFrameMessage vm = { cur.frame, base ? base->frame : -1, (uint32_t)left.size(), (uint32_t)entered.size(), (uint32_t)stayed.size(), 0, sendTime };
+    memcpy(out.data() + start, &mh, sizeof(mh));
+    memcpy(out.data() + start + sizeof(mh), &vm, sizeof(vm));
+    out.resize(start + sizeof(MessageHeader) + payloadSize);
+}
+
+// base here is what the client has: only the sprites visible in the base frame
+static bool DecodeViewFrame(const uint8_t* src, size_t size, const QuantizedFrame* base, const ViewFrameMessage& vm, QuantizedFrame& cur)
+{
+    std::vector<uint32_t> left, entered;
+    const uint8_t* end = src + size;
+    size_t nb = base ? base->ids.size() : 0;
+    if (nb < vm.leftCount || nb - vm.leftCount != vm.stayCount)
+        return false;
+    src = ReadIdGaps(src, vm.leftCount, left);
+    src = ReadIdGaps(src, vm.enterCount, entered);
+    const uint8_t* enteredData = src;
+    src += entered.size() * 10;
+
+    // sprites that stayed: base ones minus those that left; decode their new values
+    size_t stayCount = vm.stayCount;
+    std::vector<uint32_t> stayIds(stayCount);
+    std::vector<uint16_t> sx(stayCount), sy(stayCount);
+    std::vector<uint64_t> sa(stayCount);
+    for (size_t b = 0, l = 0, s = 0; b < nb; ++b)
+    {
+        if (l < left.size() && left[l] == base->ids[b])
+        {
+            ++l;
+            continue;
+        }
+        uint32_t dx, dy;
+        src = ReadVarint(src, dx);
+        src = ReadVarint(src, dy);
+        stayIds[s] = base->ids[b];
+        sx[s] = (uint16_t)(base->x[b] + UnZigZag16(dx));
+        sy[s] = (uint16_t)(base->y[b] + UnZigZag16(dy));
+        sa[s] = base->attr[b];
+        ++s;
+    }
+    uint32_t changedCount;
+    memcpy(&changedCount, src, 4);
+    src += 4;
+    size_t idx = (size_t)-1;
+    for (uint32_t c = 0; c < changedCount; ++c)
+    {
+        uint32_t gap;
+        src = ReadVarint(src, gap);
+        idx += gap + 1;
+        if (idx >= stayCount)
+            return false;
+        uint64_t a = 0;
+        memcpy(&a, src, 6);
+        src += 6;
+        sa[idx] = a;
+    }
+
+    // merge stayed & entered sprites, both sorted by ID
+    size_t count = stayCount + entered.size();
+    cur.frame = vm.frame;
+    cur.ids.resize(count);
+    cur.x.resize(count);
+    cur.y.resize(count);
+    cur.attr.resize(count);
+    for (size_t o = 0, s = 0, e = 0; o < count; ++o)
+    {
+        if (e == entered.size() || (s < stayCount && stayIds[s] < entered[e]))
+        {
+            cur.ids[o] = stayIds[s];
+            cur.x[o] = sx[s];
+            cur.y[o] = sy[s];
+            cur.attr[o] = sa[s];
+            ++s;
+        }
+        else
+        {
+            const uint8_t* d = enteredData + e * 10;
+            cur.ids[o] = entered[e];
+            memcpy(&cur.x[o], d, 2);
+            memcpy(&cur.y[o], d + 2, 2);
+            uint64_t a = 0;
+            memcpy(&a, d + 4, 6);
+            cur.attr[o] = a;
+            ++e;
+        }
+    }
+    return src <= end;
+}
+
+
+// Spatial index of quantized sprite positions: kGridSize x kGridSize cells, with sprite IDs sorted
+// by cell (counting sort), so finding sprites within a viewport only looks at the overlapping cells.
+struct SpriteGrid
+{
+    enum { kGridBits = 6, kGridSize = 1 << kGridBits, kCellShift = 16 - kGridBits };
+    std::vector<uint32_t> cellStart; // kGridSize*kGridSize+1 entries
+    std::vector<uint32_t> ids;
+
+    static int CellOf(uint16_t x, uint16_t y) { return (y >> kCellShift) * kGridSize + (x >> kCellShift); }
+
+    void Build(const QuantizedFrame& frame)
+    {
+        size_t count = frame.x.size();
+        cellStart.assign(kGridSize * kGridSize + 1, 0);
+        for (size_t i = 0; i < count; ++i)
+            cellStart[CellOf(frame.x[i], frame.y[i]) + 1]++;
+        for (int c = 0; c < kGridSize * kGridSize; ++c)
+            cellStart[c + 1] += cellStart[c];
+        ids.resize(count);
+        std::vector<uint32_t> cursor(cellStart.begin(), cellStart.end() - 1);
+        for (size_t i = 0; i < count; ++i)
+            ids[cursor[CellOf(frame.x[i], frame.y[i])]++] = (uint32_t)i;
+    }
+
+    // sorted IDs of sprites within [x0,x1] x [y0,y1] (quantized coordinates)
+    void Query(const QuantizedFrame& frame, uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1, std::vector<uint32_t>& out) const
+    {
+        out.clear();
+        for (int cy = y0 >> kCellShift; cy <= (y1 >> kCellShift); ++cy)
+        {
+            for (int cx = x0 >> kCellShift; cx <= (x1 >> kCellShift); ++cx)
+            {
+                int cell = cy * kGridSize + cx;
+                for (uint32_t k = cellStart[cell]; k < cellStart[cell + 1]; ++k)
+                {
+                    uint32_t id = ids[k];
+                    uint16_t x = frame.x[id], y = frame.y[id];
+                    if (x >= x0 && x <= x1 && y >= y0 && y <= y1)
+                        out.push_back(id);
+                }
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+};
+
+
+// -------------------------------------------------------------------------------------------------
+// server
+
+// what was sent to a client in each recent frame: whole world, or the sprites visible in its viewport
+struct SentFrame
+{
+    int frame = -1;
+    bool viewport = false;
+    std::vector<uint32_t> visible;
+};
+
+struct ServerClient
+{
+    Socket socket = kInvalidSocket;
+    std::vector<uint8_t> inBuffer;
+    std::vector<uint8_t> outBuffer;
+    size_t outOffset = 0;
+    int ackedFrame = -1;
+    bool failed = false;
+    bool hasViewport = false;
+    ViewportMessage viewport;
+    std::vector<SentFrame> sent = std::vector<SentFrame>(kHistorySize);
+};
+
+static void FlushClient(ServerClient& c)
+{
+    while (c.outOffset < c.outBuffer.size())
+    {
+        int n = (int)send(c.socket, (const char*)c.outBuffer.data() + c.outOffset, (int)std::min<size_t>(c.outBuffer.size() - c.outOffset, 1 << 20), MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            if (n < 0 && SocketWouldBlock())
+                return;
+            c.failed = true;
+            return;
+        }
+        c.outOffset += n;
+    }
+    c.outBuffer.clear();
+    c.outOffset = 0;
+}
+
+static void ReadClient(ServerClient& c)
+{
+    char buf[4096];
+    while (true)
+    {
+        int n = (int)recv(c.socket, buf, sizeof(buf), 0);
+        if (n <= 0)
+        {
+            if (n < 0 && SocketWouldBlock())
+                break;
+            c.failed = true;
+            return;
+        }
+        c.inBuffer.insert(c.inBuffer.end(), buf, buf + n);
+    }
+    size_t pos = 0;
+    while (c.inBuffer.size() - pos >= sizeof(MessageHeader))
+    {
+        MessageHeader mh;
+        memcpy(&mh, c.inBuffer.data() + pos, sizeof(mh));
+        if (c.inBuffer.size() - pos - sizeof(mh) < mh.size)
+            break;
+        const uint8_t* payload = c.inBuffer.data() + pos + sizeof(mh);
+        if (mh.type == kMsgAck && mh.size >= sizeof(AckMessage))
+        {
+            AckMessage ack;
+            memcpy(&ack, payload, sizeof(ack));
+            c.ackedFrame = std::max(c.ackedFrame, (int)ack.frame);
+        }
+        if (mh.type == kMsgViewport && mh.size >= sizeof(ViewportMessage))
+        {
+            memcpy(&c.viewport, payload, sizeof(c.viewport));
+            c.hasViewport = c.viewport.xMin <= c.viewport.xMax && c.viewport.yMin <= c.viewport.yMax;
+        }
+        pos += sizeof(mh) + mh.size;
+    }
+    c.inBuffer.erase(c.inBuffer.begin(), c.inBuffer.begin() + pos);
+}
+
+
+extern "C" int stream_server_run(int port, int frameCount, float frameRate)
+{
+    InitSockets();
+    Socket listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == kInvalidSocket)
+        return 1;
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listener, (const sockaddr*)&addr, sizeof(addr)) != 0 || listen(listener, 16) != 0)
+    {
+        CloseSocket(listener);
+        return 1;
+    }
+    SetNonBlocking(listener);
+
+    game_initialize(NULL);
+    std::vector<sprite_data_t> sprites(kMaxSpriteCount);
+    std::vector<QuantizedFrame> history(kHistorySize);
+    std::vector<ServerClient> clients;
+    HelloMessage hello = {};
+    SpriteGrid grid;
+
+    // frames encoded this tick, keyed by base frame; clients that acked the same frame share them
+    std::vector<std::pair<int, std::vector<uint8_t> > > encodeCache;
+
+    const float deltaTime = frameRate > 0.0f ? 1.0f / frameRate : 1.0f / 60.0f;
+    double nextTick = TimeNow();
+    for (int frame = 0; frameCount <= 0 || frame < frameCount; ++frame)
+    {
+        int count = game_update(sprites.data(), frame * deltaTime, deltaTime);
+
+        // quantization range is decided on the first frame
+        if (frame == 0)
+        {
+            hello.magic = kStreamMagic;
+            hello.version = kStreamVersion;
+            hello.quant = ComputeQuantParams(sprites.data(), count);
+        }
+        QuantizedFrame& cur = history[frame % kHistorySize];
+        Quantize(sprites.data(), count, hello.quant, cur);
+        cur.frame = frame;
+
+        // new clients
+        while (true)
+        {
+            Socket s = accept(listener, NULL, NULL);
+            if (s == kInvalidSocket)
+                break;
+            SetupSocket(s);
+            SetNonBlocking(s);
+            ServerClient c;
+            c.socket = s;
+            MessageHeader mh = { kMsgHello, sizeof(HelloMessage) };
+            c.outBuffer.insert(c.outBuffer.end(), (const uint8_t*)&mh, (const uint8_t*)(&mh + 1));
+            c.outBuffer.insert(c.outBuffer.end(), (const uint8_t*)&hello, (const uint8_t*)(&hello + 1));
+            clients.push_back(c);
+        }
+
+        for (ServerClient& c : clients)
+            ReadClient(c);
+        bool anyViewports = std::any_of(clients.begin(), clients.end(), [](const ServerClient& c) { return c.hasViewport; });
+        if (anyViewports)
+            grid.Build(cur);
+
+        // send the frame to everyone that is not still busy receiving a previous one
+        encodeCache.clear();
+        double sendTime = TimeNow();
+        for (ServerClient& c : clients)
+        {
+            FlushClient(c);
+            if (c.failed || !c.outBuffer.empty())
+                continue;
+            // base frame must be still in history, and sent the same way
+            int base = c.ackedFrame;
+            if (base <= frame - kHistorySize || history[base % kHistorySize].frame != base ||
+                c.sent[base % kHistorySize].frame != base || c.sent[base % kHistorySize].viewport != c.hasViewport)
+                base = -1;
+            SentFrame& sent = c.sent[frame % kHistorySize];
+            sent.frame = frame;
+            sent.viewport = c.hasViewport;
+            if (c.hasViewport)
+            {
+                const QuantParams& q = hello.quant;
+                float invStep = 1.0f / q.posStep;
+                grid.Query(cur,
+                    QuantizePos(c.viewport.xMin, q.posMinX, invStep), QuantizePos(c.viewport.yMin, q.posMinY, invStep),
+                    QuantizePos(c.viewport.xMax, q.posMinX, invStep), QuantizePos(c.viewport.yMax, q.posMinY, invStep),
+                    sent.visible);
+                const QuantizedFrame* baseFrame = base >= 0 ? &history[base % kHistorySize] : NULL;
+                EncodeViewFrame(cur, sent.visible, baseFrame, c.sent[std::max(base, 0) % kHistorySize].visible, sendTime, c.outBuffer);
+                FlushClient(c);
+                continue;
+            }
+            sent.visible.clear();
+            auto it = std::find_if(encodeCache.begin(), encodeCache.end(), [&](const std::pair<int, std::vector<uint8_t> >& e) { return e.first == base; });
+            if (it == encodeCache.end())
+            {
+                encodeCache.push_back(std::make_pair(base, std::vector<uint8_t>()));
+                it = encodeCache.end() - 1;
+                EncodeFrame(cur, base >= 0 ? &history[base % kHistorySize] : NULL, sendTime, it->second);
+            }
+            c.outBuffer = it->second;
+            FlushClient(c);
+        }
+        for (size_t i = 0; i < clients.size(); )
+        {
+            if (clients[i].failed)
+            {
+                CloseSocket(clients[i].socket);
+                clients.erase(clients.begin() + i);
+            }
+            else
+                ++i;
+        }
+
+        if (frameRate > 0.0f)
+        {
+            nextTick += deltaTime;
+            double wait = nextTick - TimeNow();
+            if (wait > 0.0)
+                std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+            else
+                nextTick = TimeNow();
+        }
+    }
+
+    for (ServerClient& c : clients)
+        CloseSocket(c.socket);
+    CloseSocket(listener);
+    game_destroy();
+    return 0;
+}
+
+
+// -------------------------------------------------------------------------------------------------
+// client
+
+struct stream_client_t
+{
+    Socket socket = kInvalidSocket;
+    HelloMessage hello = {};
+    std::vector<QuantizedFrame> history;
+    std::vector<uint8_t> payload;
+    double receivedBytes = 0;
+};
+
+static bool RecvAll(Socket s, void* data, size_t size)
+{
+    char* dst = (char*)data;
+    while (size > 0)
+    {
+        int n = (int)recv(s, dst, (int)std::min<size_t>(size, 1 << 20), 0);
+        if (n <= 0)
+            return false;
+        dst += n;
+        size -= n;
+    }
+    return true;
+}
+
+
+template<typename T> static void SendMessage(stream_client_t* client, uint32_t type, const T& message)
+{
+    MessageHeader mh = { type, sizeof(T) };
+    uint8_t msg[sizeof(mh) + sizeof(T)];
+    memcpy(msg, &mh, sizeof(mh));
+    memcpy(msg + sizeof(mh), &message, sizeof(T));
+    send(client->socket, (const char*)msg, sizeof(msg), MSG_NOSIGNAL);
+}
+
+static void SendAck(stream_client_t* client, int frame)
+{
+    AckMessage ack = { frame };
+    SendMessage(client, kMsgAck, ack);
+}
+
+
+extern "C" stream_client_t* stream_client_connect(const char* host, int port)
+{
+    InitSockets();
+    Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == kInvalidSocket)
+        return NULL;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    if (inet_pton(AF_INET, host, &addr.sin_addr) != 1 || connect(s, (const sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        CloseSocket(s);
+        return NULL;
+    }
+    SetupSocket(s);
+    stream_client_t* client = new stream_client_t();
+    client->socket = s;
+    client->history.resize(kHistorySize);
+    return client;
+}
+
+
+extern "C" int stream_client_receive(stream_client_t* client, sprite_data_t* data, double* latency)
+{
+    while (true)
+    {
+        MessageHeader mh;
+        if (!RecvAll(client->socket, &mh, sizeof(mh)))
+            return -1;
+        client->payload.resize(mh.size + 4);
+        if (!RecvAll(client->socket, client->payload.data(), mh.size))
+            return -1;
+        const uint8_t* payload = client->payload.data();
+        client->receivedBytes += sizeof(mh) + mh.size;
+
+        if (mh.type == kMsgHello && mh.size >= sizeof(HelloMessage))
+        {
+            memcpy(&client->hello, payload, sizeof(HelloMessage));
+            if (client->hello.magic != kStreamMagic || client->hello.version != kStreamVersion)
+                return -1;
+            continue;
+        }
+        if (mh.type == kMsgViewFrame && mh.size >= sizeof(ViewFrameMessage))
+        {
+            ViewFrameMessage vm;
+            memcpy(&vm, payload, sizeof(vm));
+            const QuantizedFrame* base = NULL;
+            if (vm.baseFrame >= 0)
+            {
+                base = &client->history[vm.baseFrame % kHistorySize];
+                if (base->frame != vm.baseFrame)
+                    return -1;
+            }
+            QuantizedFrame& cur = client->history[vm.frame % kHistorySize];
+            if (!DecodeViewFrame(payload + sizeof(vm), mh.size - sizeof(vm), base, vm, cur))
+                return -1;
+            Dequantize(cur, client->hello.quant, data);
+            SendAck(client, vm.frame);
+            if (latency != NULL)
+                *latency = TimeNow() - vm.sendTime;
+            return (int)cur.ids.size();
+        }
+        if (mh.type != kMsgFrame || mh.size < sizeof(FrameMessage))
+            continue;
+
+        FrameMessage fm;
+        memcpy(&fm, payload, sizeof(fm));
+        const QuantizedFrame* base = NULL;
+        if (fm.baseFrame >= 0)
+        {
+            base = &client->history[fm.baseFrame % kHistorySize];
+            if (base->frame != fm.baseFrame)
+                return -1;
+        }
+        QuantizedFrame& cur = client->history[fm.frame % kHistorySize];
+        if (!DecodeFrame(payload + sizeof(fm), mh.size - sizeof(fm), base, fm, cur))
+            return -1;
+        Dequantize(cur, client->hello.quant, data);
+        SendAck(client, fm.frame);
+
+        if (latency != NULL)
+            *latency = TimeNow() - fm.sendTime;
+        return (int)fm.spriteCount;
+    }
+}
+
+
+extern "C" void stream_client_set_viewport(stream_client_t* client, float xMin, float yMin, float xMax, float yMax)
+{
+    ViewportMessage vm = { xMin, yMin, xMax, yMax };
+    SendMessage(client, kMsgViewport, vm);
+}
+
+
+extern "C" double stream_client_received_bytes(const stream_client_t* client)
+{
+    return client->receivedBytes;
+}
+
+
+extern "C" void stream_client_close(stream_client_t* client)
+{
+    if (client == NULL)
+        return;
+    CloseSocket(client->socket);
+    delete client;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "game.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Streaming of simulation state over a local TCP socket, so that the game can run headless in one
+// process, and be visualized or analyzed in others.
+//
+// Server runs game_update at a fixed rate, and sends every frame to each connected client:
+// positions quantized to 16 bits, colors/sprite/scale only when they changed. Each frame is
+// delta-encoded against the last frame that the client acknowledged (or sent whole if there is no
+// such frame in server history). Clients that can't keep up are skipped for a frame instead of
+// stalling the simulation.
+//
+// Clients can register a viewport, and then only receive sprites within it. Server keeps a spatial
+// grid of sprites and the set of sprites each client saw in recent frames, so sprites entering and
+// leaving the view are sent efficiently, and bandwidth is bounded by what each client can see.
+
+// Runs the server on the given port; frameCount <= 0 runs forever. frameRate <= 0 runs as fast as
+// possible. Returns zero on success.
+int stream_server_run(int port, int frameCount, float frameRate);
+
+// Client side: connect to a server, and receive frames.
+typedef struct stream_client_t stream_client_t;
+
+stream_client_t* stream_client_connect(const char* host, int port);
+// Waits for the next frame and decodes it into data; returns amount of sprites, or negative when
+// the server is gone. If latency is not null, it receives seconds it took since server sent the frame.
+int stream_client_receive(stream_client_t* client, sprite_data_t* data, double* latency);
+// Only receive sprites within the given rectangle (in sprite_data_t coordinates) from now on;
+// min > max goes back to receiving everything. Sprites are ordered by their index in the whole world.
+void stream_client_set_viewport(stream_client_t* client, float xMin, float yMin, float xMax, float yMax);
+// Total amount of bytes received so far.
+double stream_client_received_bytes(const stream_client_t* client);
+void stream_client_close(stream_client_t* client);
+
+
+#ifdef __cplusplus
+}
+#endif
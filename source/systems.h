@@ -0,0 +1,2052 @@
+#pragma once
+
+// "Systems" of the game; they operate on components of game objects. They live in a header so
+// that other modes than the regular game (e.g. sharded simulation) can run them on their own
+// entity storage.
+
+#include "entities.h"
+#include "game.h"
+#include "parallel.h"
+#include "numa.h"
+#include "spatial_grid.h"
+#include "bvh.h"
+#include <chrono>
+#include <mutex>
+#include <atomic>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define SYSTEMS_USE_SSE 1
+#include <emmintrin.h>
+#else
+#define SYSTEMS_USE_SSE 0
+#endif
+
+
+// Calls func(begin, end) for each run of consecutive IDs in the set; with multiple threads in the
+// settings, members are split into chunks of chunkSize that are processed in parallel (so runs
+// get split into pieces at chunk boundaries).
+template<typename F> static void ParallelForEachRun(const EntitySet& set, const ParallelSettings& settings, F func)
+{
+    if (settings.threadCount <= 1 && !settings.numa)
+    {
+        set.ForEachRun(func);
+        return;
+    }
+    // runs, and index of the first member in each
+    std::vector<std::pair<EntityID, EntityID>> runs;
+    std::vector<size_t> runStarts;
+    size_t count = 0;
+    set.ForEachRun([&](EntityID begin, EntityID end)
+    {
+        runs.emplace_back(begin, end);
+        runStarts.push_back(count);
+        count += end - begin;
+    });
+    ParallelFor(count, settings, [&](size_t first, size_t last)
+    {
+        size_t r = std::upper_bound(runStarts.begin(), runStarts.end(), first) - runStarts.begin() - 1;
+        for (; first < last; ++r)
+        {
+            EntityID begin = runs[r].first + (first - runStarts[r]);
+            EntityID end = std::min<EntityID>(runs[r].second, begin + (last - first));
+            func(begin, end);
+            first += end - begin;
+        }
+    });
+}
+
+// With numa settings, moves component data of the set members onto the NUMA nodes whose threads
+// will process them (see ParallelSettings). Returns false if memory could not be moved.
+static inline bool NumaPlaceComponents(Entities& objects, const EntitySet& set, const ParallelSettings& settings)
+{
+    if (!settings.numa || objects.m_Flags.empty())
+        return true;
+    bool ok = true;
+    size_t entityCount = objects.m_Flags.size();
+    for (const ParallelNodePart& part : ParallelNumaSplit(set.size(), settings.threadCount))
+    {
+        // IDs of members [part.begin, part.end)
+        size_t index = 0;
+        set.ForEachRun([&](EntityID begin, EntityID end)
+        {
+            size_t from = std::max(index, part.begin), to = std::min(index + (end - begin), part.end);
+            if (from < to)
+            {
+                EntityID first = begin + (from - index), last = begin + (to - index);
+                objects.ForEachComponentArray([&](void* data, size_t size, int)
+                {
+                    size_t elementSize = size / entityCount;
+                    ok &= NumaMoveToNode((char*)data + first * elementSize, (last - first) * elementSize, part.node);
+                });
+            }
+            index += end - begin;
+        });
+    }
+    return ok;
+}
+
+
+// Move all the objects with velocity, and bounce them off world bounds.
+struct MoveSystem
+{
+    EntityID boundsID; // ID if object with world bounds
+    EntitySet entities; // IDs of objects that should be moved
+    // once initialized, kept up to date with where the moved objects are
+    SpatialGrid grid;
+
+    void AddObjectToSystem(EntityID id)
+    {
+        entities.Add(id);
+    }
+
+    void SetBounds(EntityID id)
+    {
+        boundsID = id;
+    }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        const WorldBoundsComponent bounds = objects.m_WorldBounds[boundsID];
+        const bool updateGrid = grid.IsInitialized();
+        if (updateGrid)
+            grid.Reserve(objects.m_Positions.size());
+        const SpatialGrid::CellMap cellMap = grid.GetCellMap();
+        const int* cells = grid.EntityCells();
+        std::vector<std::pair<EntityID, int>> gridMoves;
+        std::mutex gridMovesMutex;
+
+        // go through all the objects, one run of consecutive IDs at a time
+        ParallelForEachRun(entities, parallel, [&](EntityID begin, EntityID end)
+        {
+            PositionComponent* positions = objects.m_Positions.data() + begin;
+            MoveComponent* moves = objects.m_Moves.data() + begin;
+            std::vector<std::pair<EntityID, int>> localGridMoves;
+            for (size_t io = 0, no = end - begin; io != no; ++io)
+            {
+                PositionComponent& pos = positions[io];
+                MoveComponent& move = moves[io];
+
+                // update position based on movement velocity & delta time
+                pos.x += move.velx * deltaTime;
+                pos.y += move.vely * deltaTime;
+
+                // check against world bounds; put back onto bounds and mirror the velocity component to "bounce" back
+                if (pos.x < bounds.xMin)
+                {
+                    move.velx = -move.velx;
+                    pos.x = bounds.xMin;
+                }
+                if (pos.x > bounds.xMax)
+                {
+                    move.velx = -move.velx;
+                    pos.x = bounds.xMax;
+                }
+                if (pos.y < bounds.yMin)
+                {
+                    move.vely = -move.vely;
+                    pos.y = bounds.yMin;
+                }
+                if (pos.y > bounds.yMax)
+                {
+                    move.vely = -move.vely;
+                    pos.y = bounds.yMax;
+                }
+
+                // note objects that crossed into another grid cell
+                if (updateGrid)
+                {
+                    int cell = cellMap.CellOf(pos.x, pos.y);
+                    if (cell != cells[begin + io])
+                        localGridMoves.emplace_back(begin + io, cell);
+                }
+            }
+            if (!localGridMoves.empty())
+            {
+                std::lock_guard<std::mutex> lock(gridMovesMutex);
+                gridMoves.insert(gridMoves.end(), localGridMoves.begin(), localGridMoves.end());
+            }
+        });
+
+        // relink them in ID order, so that the grid ends up the same no matter how threads ran
+        if (!gridMoves.empty())
+        {
+            std::sort(gridMoves.begin(), gridMoves.end());
+            grid.MoveBatch(gridMoves);
+        }
+    }
+};
+
+
+// One bit per entity ID, that can be set from multiple threads at once; e.g. objects that something
+// happened to in this frame, for another system to process. Finding the set bits reads 1/64th of
+// a word per entity and skips empty words, so it costs next to nothing even with millions of IDs.
+class EntityBits
+{
+public:
+    void resize(size_t idCount)
+    {
+        std::vector<std::atomic<uint64_t>> words((idCount + 63) / 64);
+        for (size_t i = 0; i < words.size() && i < m_Words.size(); ++i)
+            words[i].store(m_Words[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_Words.swap(words);
+    }
+    size_t size() const { return m_Words.size() * 64; }
+
+    void Set(EntityID id)
+    {
+        m_Words[id / 64].fetch_or(uint64_t(1) << (id % 64), std::memory_order_relaxed);
+    }
+
+    // Calls func(id) for each set bit in increasing ID order, and clears them.
+    template<typename F> void ConsumeAll(F func)
+    {
+        for (size_t i = 0; i < m_Words.size(); ++i)
+        {
+            uint64_t bits = m_Words[i].load(std::memory_order_relaxed);
+            if (bits == 0)
+                continue;
+            m_Words[i].store(0, std::memory_order_relaxed);
+            for (int b = 0; b < 64; ++b)
+            {
+                if (bits & (uint64_t(1) << b))
+                    func((EntityID)(i * 64 + b));
+            }
+        }
+    }
+
+private:
+    std::vector<std::atomic<uint64_t>> m_Words;
+};
+
+
+// Statistics of time budgeted avoidance (see AvoidanceSystem::timeBudget) for the last frame.
+struct AvoidanceBudgetStats
+{
+    size_t dueCount = 0; // objects that were close enough to things to avoid that they had to be checked
+    size_t sliceCount = 0; // objects checked from the rotating slice of all objects
+    int sliceMaxStale = 0; // frames since the slice objects were checked before: largest, and average
+    float sliceAvgStale = 0.0f;
+    int rotationFrames = 0; // frames the last full rotation through all objects took
+    size_t lateCount = 0; // objects that could have collided in an earlier frame, but were not checked then due to budget
+};
+
+
+// "Avoidance system" works out interactions between objects that "avoid" and "should be avoided".
+// Objects that avoid:
+// - when they get closer to things that should be avoided than the given distance, they bounce back,
+// - also they take sprite color from the object they just bumped into
+//
+// With a time budget set, not every object is checked every frame. Speeds of everything are
+// bounded (bouncing only changes directions, and when something steers objects they stay below
+// maxObjectSpeed), and so are moves by other systems (extraTravel: pushes of objects apart, or of
+// things to avoid off each other); so how far an object was from things to avoid when it was
+// checked tells how long it can't collide with any of them. Objects are
+// checked when that runs out, closest to colliding first; the rest of the budget goes to a rotating
+// slice of all objects, which refreshes that distance. Unless the budget does not even cover the
+// objects that might collide, results are exactly the same as checking everything.
+//
+// With more than a few things to avoid, objects only check the ones near them, found through a
+// "broadphase" structure (see Broadphase). Objects still bump into them in the same order as when
+// checking all of them, so results are the same too. With just a few, given a grid of objects (see
+// objectGrid), it goes the other way around: only objects in grid cells near things to avoid get
+// checked, instead of all of them (unless brute force was picked explicitly).
+struct AvoidanceSystem
+{
+    // How objects find things to avoid they might collide with.
+    enum Broadphase
+    {
+        kBroadphaseAuto, // brute force for a few things to avoid; else BVH if their distances vary a lot, grid if not
+        kBroadphaseBruteForce, // check all of them, with all objects (auto uses the object grid instead, if there is one)
+        kBroadphaseGrid, // uniform grid of things to avoid, with cells as large as the largest distance
+        kBroadphaseBVH, // tree of things to avoid, queried by spatially coherent batches of objects
+        kBroadphaseSweep, // objects & things to avoid kept sorted along x; only overlapping x ranges get checked (never picked by auto)
+        kBroadphaseCount
+    };
+    static const char* BroadphaseName(Broadphase b)
+    {
+        static const char* kNames[kBroadphaseCount] = { "auto", "brute", "grid", "bvh", "sweep" };
+        return b >= 0 && b < kBroadphaseCount ? kNames[b] : "unknown";
+    }
+    // Returns kBroadphaseCount if there's no broadphase with that name.
+    static Broadphase BroadphaseFromName(const char* name)
+    {
+        int b = 0;
+        while (b < kBroadphaseCount && strcmp(name, BroadphaseName((Broadphase)b)) != 0)
+            ++b;
+        return (Broadphase)b;
+    }
+
+    // things to be avoided: distances to them, and their IDs
+    std::vector<float> avoidDistanceList;
+    std::vector<EntityID> avoidList;
+
+    // objects that avoid: their IDs
+    EntitySet objectList;
+
+    // time budget per frame in seconds; zero checks all objects every frame
+    double timeBudget = 0.0;
+    // with a time budget: bound of object speeds, if something changes them (e.g. flocking); zero
+    // if they keep the speeds they have when the budgeted updates start
+    float maxObjectSpeed = 0.0f;
+    // with a time budget: how much closer objects & things to avoid could have gotten in this frame
+    // other than by their velocities (e.g. both pushed by other systems); has to be set before each update
+    float extraTravel = 0.0f;
+    AvoidanceBudgetStats budgetStats;
+
+    // (time budgeted updates always check all things to avoid)
+    Broadphase broadphase = kBroadphaseAuto;
+    EntityID boundsID = (EntityID)-1; // ID of object with world bounds, if any (to batch objects by where they are)
+    // if set, objects that bumped into something get their bit set here (has to be sized for all IDs)
+    EntityBits* bumpedObjects = nullptr;
+    // if set, grid of where objects are (e.g. the one MoveSystem keeps); it has to be up to date with
+    // their positions, i.e. nothing may move them between its update and this system's
+    const SpatialGrid* objectGrid = nullptr;
+
+    void AddAvoidThisObjectToSystem(EntityID id, float distance)
+    {
+        avoidList.emplace_back(id);
+        avoidDistanceList.emplace_back(distance * distance);
+    }
+
+    void AddObjectToSystem(EntityID id)
+    {
+        objectList.Add(id);
+    }
+
+    void SetBounds(EntityID id)
+    {
+        boundsID = id;
+    }
+
+    // Broadphase that the next update will use.
+    Broadphase ChooseBroadphase() const
+    {
+        if (broadphase != kBroadphaseAuto)
+            return broadphase;
+        const size_t kBruteForceMaxCount = 32;
+        if (avoidList.size() <= kBruteForceMaxCount)
+            return kBroadphaseBruteForce;
+        // a grid has cells as large as the largest distance; when most are much smaller than that,
+        // objects would check many more than they need to
+        auto minmax = std::minmax_element(avoidDistanceList.begin(), avoidDistanceList.end());
+        const float kMaxDistanceRatio = 4.0f;
+        return *minmax.second > *minmax.first * (kMaxDistanceRatio * kMaxDistanceRatio) ? kBroadphaseBVH : kBroadphaseGrid;
+    }
+
+    // broadphase used in the last update, and how many times the BVH was rebuilt since it was
+    // first built (it is just refit to moved things to avoid otherwise)
+    Broadphase LastBroadphase() const { return m_LastBroadphase; }
+    size_t BVHRebuildCount() const { return m_BVHRebuildCount; }
+
+    static float DistanceSq(const PositionComponent& a, const PositionComponent& b)
+    {
+        float dx = a.x - b.x;
+        float dy = a.y - b.y;
+        return dx * dx + dy * dy;
+    }
+
+    static void ResolveCollision(Entities& objects, EntityID id, float deltaTime)
+    {
+        PositionComponent& pos = objects.m_Positions[id];
+        MoveComponent& move = objects.m_Moves[id];
+
+        // flip velocity
+        move.velx = -move.velx;
+        move.vely = -move.vely;
+
+        // move us out of collision, by moving just a tiny bit more than we'd normally move during a frame
+        pos.x += move.velx * deltaTime * 1.1f;
+        pos.y += move.vely * deltaTime * 1.1f;
+    }
+
+    // Bounces object off a thing to avoid, and makes it take its sprite color.
+    void BumpInto(Entities& objects, EntityID go, EntityID avoid, float deltaTime)
+    {
+        ResolveCollision(objects, go, deltaTime);
+        SpriteComponent& avoidSprite = objects.m_Sprites[avoid];
+        SpriteComponent& mySprite = objects.m_Sprites[go];
+        mySprite.colorR = avoidSprite.colorR;
+        mySprite.colorG = avoidSprite.colorG;
+        mySprite.colorB = avoidSprite.colorB;
+        if (bumpedObjects)
+            bumpedObjects->Set(go);
+    }
+
+    // Objects are independent of each other (things to avoid never avoid anything themselves), so
+    // they can be processed in parallel (except in time budget mode).
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        if (timeBudget > 0.0)
+        {
+            UpdateSystemBudgeted(objects, deltaTime);
+            return;
+        }
+        m_Budget = BudgetState();
+        m_LastBroadphase = ChooseBroadphase();
+        if (m_LastBroadphase == kBroadphaseGrid)
+        {
+            UpdateSystemGrid(objects, deltaTime, parallel);
+            return;
+        }
+        if (m_LastBroadphase == kBroadphaseBVH)
+        {
+            UpdateSystemBVH(objects, deltaTime, parallel);
+            return;
+        }
+        m_BVH = BVH();
+        if (m_LastBroadphase == kBroadphaseSweep)
+        {
+            UpdateSystemSweep(objects, deltaTime, parallel);
+            return;
+        }
+        m_SweepObjects.clear();
+        // (an explicitly picked brute force does check all objects)
+        if (broadphase == kBroadphaseAuto && objectGrid != nullptr && objectGrid->IsInitialized())
+        {
+            UpdateSystemObjectGrid(objects, deltaTime, parallel);
+            return;
+        }
+
+        // go through all the objects, one run of consecutive IDs at a time
+        ParallelForEachRun(objectList, parallel, [&](EntityID begin, EntityID end)
+        {
+            const PositionComponent* positions = objects.m_Positions.data();
+            for (EntityID go = begin; go != end; ++go)
+            {
+                const PositionComponent& myposition = positions[go];
+
+                // check each thing in avoid list
+                for (size_t ia = 0, na = avoidList.size(); ia != na; ++ia)
+                {
+                    float avDistance = avoidDistanceList[ia];
+                    EntityID avoid = avoidList[ia];
+                    const PositionComponent& avoidposition = positions[avoid];
+
+                    // is our position closer to "thing to avoid" position than the avoid distance?
+                    if (DistanceSq(myposition, avoidposition) < avDistance)
+                        BumpInto(objects, go, avoid, deltaTime);
+                }
+            }
+        });
+    }
+
+private:
+    // Checks an object against all things to avoid (same as UpdateSystem does); returns how far
+    // it is from colliding with any of them, or a negative value if it collided.
+    float CheckObject(Entities& objects, EntityID go, float deltaTime)
+    {
+        const PositionComponent& myposition = objects.m_Positions[go];
+        float clearance = INFINITY;
+        bool collided = false;
+        for (size_t ia = 0, na = avoidList.size(); ia != na; ++ia)
+        {
+            float avDistance = avoidDistanceList[ia];
+            EntityID avoid = avoidList[ia];
+            float distSq = DistanceSq(myposition, objects.m_Positions[avoid]);
+            if (distSq < avDistance)
+            {
+                BumpInto(objects, go, avoid, deltaTime);
+                collided = true;
+            }
+            else
+            {
+                float reach = m_Budget.avoidRadius[ia] + clearance;
+                if (distSq < reach * reach)
+                    clearance = sqrtf(distSq) - m_Budget.avoidRadius[ia];
+            }
+        }
+        return collided ? -1.0f : clearance;
+    }
+
+    // Updates boxes that objects have to be in to possibly collide with each thing to avoid
+    // (slightly larger, so that float rounding can't make a box miss a collision).
+    void UpdateAvoidBoxes(const Entities& objects)
+    {
+        m_AvoidBoxes.resize(avoidList.size());
+        for (size_t ia = 0, na = avoidList.size(); ia != na; ++ia)
+        {
+            const PositionComponent& pos = objects.m_Positions[avoidList[ia]];
+            float r = sqrtf(avoidDistanceList[ia]) * 1.0001f + 1.0e-5f;
+            m_AvoidBoxes[ia] = AABB{ pos.x - r, pos.y - r, pos.x + r, pos.y + r };
+        }
+    }
+
+    // Checks object against things to avoid. initial are candidates for its current position
+    // (indices into avoidList, in any order); query(x, y, result) appends candidates for any other
+    // position. Almost always the object collides with none of them, and then their order does not
+    // matter; otherwise it bumps into them in avoidList order (as when checking all things to
+    // avoid), finding candidates again after each collision, since that moves it.
+    template<typename Q> void CheckCandidates(Entities& objects, EntityID go, float deltaTime, const int* initial, size_t initialCount,
+        std::vector<int>& candidates, Q query)
+    {
+        const PositionComponent* positions = objects.m_Positions.data();
+        const PositionComponent& pos = positions[go];
+        bool collides = false;
+        for (size_t k = 0; k != initialCount && !collides; ++k)
+            collides = DistanceSq(pos, positions[avoidList[initial[k]]]) < avoidDistanceList[initial[k]];
+        if (!collides)
+            return;
+        candidates.assign(initial, initial + initialCount);
+        std::sort(candidates.begin(), candidates.end());
+        size_t k = 0;
+        while (k < candidates.size())
+        {
+            int ia = candidates[k++];
+            if (DistanceSq(pos, positions[avoidList[ia]]) < avoidDistanceList[ia])
+            {
+                BumpInto(objects, go, avoidList[ia], deltaTime);
+                // (the remaining ones are the ones after this one in avoidList order)
+                candidates.clear();
+                query(pos.x, pos.y, candidates);
+                candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&](int c) { return c <= ia; }), candidates.end());
+                std::sort(candidates.begin(), candidates.end());
+                k = 0;
+            }
+        }
+    }
+
+    // With a grid of objects: objects in the cells that boxes of things to avoid overlap are the only
+    // ones that can collide; each of them then checks the things to avoid whose box it is in.
+    void UpdateSystemObjectGrid(Entities& objects, float deltaTime, const ParallelSettings& parallel)
+    {
+        UpdateAvoidBoxes(objects);
+        m_NearObjects.clear();
+        for (const AABB& box : m_AvoidBoxes)
+        {
+            objectGrid->ForEachCellInRect(box.xMin, box.yMin, box.xMax, box.yMax, [&](const EntityID* ids, size_t count)
+            {
+                for (size_t i = 0; i != count; ++i)
+                {
+                    if (box.Contains(objects.m_Positions[ids[i]].x, objects.m_Positions[ids[i]].y))
+                        m_NearObjects.push_back(ids[i]);
+                }
+            });
+        }
+        // (in ID order, and without things to avoid or other objects the grid has)
+        std::sort(m_NearObjects.begin(), m_NearObjects.end());
+        m_NearObjects.erase(std::unique(m_NearObjects.begin(), m_NearObjects.end()), m_NearObjects.end());
+        m_NearObjects.erase(std::remove_if(m_NearObjects.begin(), m_NearObjects.end(), [&](EntityID go) { return !objectList.Contains(go); }), m_NearObjects.end());
+
+        auto query = [&](float x, float y, std::vector<int>& result)
+        {
+            for (size_t ia = 0, na = m_AvoidBoxes.size(); ia != na; ++ia)
+            {
+                if (m_AvoidBoxes[ia].Contains(x, y))
+                    result.push_back((int)ia);
+            }
+        };
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        ParallelFor(m_NearObjects.size(), settings, [&](size_t first, size_t last)
+        {
+            std::vector<int> initial, candidates;
+            for (size_t i = first; i != last; ++i)
+            {
+                EntityID go = m_NearObjects[i];
+                initial.clear();
+                query(objects.m_Positions[go].x, objects.m_Positions[go].y, initial);
+                CheckCandidates(objects, go, deltaTime, initial.data(), initial.size(), candidates, query);
+            }
+        });
+    }
+
+    // Grid broadphase: things to avoid sorted by cell (cells as large as the largest distance, over
+    // the area they are in); each object checks the ones in the 3x3 cells around it.
+    void UpdateSystemGrid(Entities& objects, float deltaTime, const ParallelSettings& parallel)
+    {
+        UpdateAvoidBoxes(objects);
+        WorldBoundsComponent extent = { 1.0e30f, -1.0e30f, 1.0e30f, -1.0e30f };
+        float maxRadius = 0.0f;
+        for (const AABB& box : m_AvoidBoxes)
+        {
+            float cx = (box.xMin + box.xMax) * 0.5f, cy = (box.yMin + box.yMax) * 0.5f;
+            extent = WorldBoundsComponent{ std::min(extent.xMin, cx), std::max(extent.xMax, cx), std::min(extent.yMin, cy), std::max(extent.yMax, cy) };
+            maxRadius = std::max(maxRadius, (box.xMax - box.xMin) * 0.5f);
+        }
+        float cellSize = std::max(maxRadius, std::max(extent.xMax - extent.xMin, extent.yMax - extent.yMin) / 1024.0f);
+        const SpatialGrid::CellMap map = SpatialGrid::CellMap::Create(extent, cellSize);
+
+        // counting sort by cell
+        int cellCount = map.width * map.height;
+        m_GridStart.assign(cellCount + 1, 0);
+        m_GridCells.resize(m_AvoidBoxes.size());
+        for (size_t ia = 0; ia < m_AvoidBoxes.size(); ++ia)
+        {
+            const AABB& box = m_AvoidBoxes[ia];
+            m_GridCells[ia] = map.CellOf((box.xMin + box.xMax) * 0.5f, (box.yMin + box.yMax) * 0.5f);
+            m_GridStart[m_GridCells[ia] + 1]++;
+        }
+        for (int cell = 0; cell < cellCount; ++cell)
+            m_GridStart[cell + 1] += m_GridStart[cell];
+        m_GridItems.resize(m_AvoidBoxes.size());
+        std::vector<int> offsets(m_GridStart.begin(), m_GridStart.end() - 1);
+        for (size_t ia = 0; ia < m_AvoidBoxes.size(); ++ia)
+            m_GridItems[offsets[m_GridCells[ia]]++] = (int)ia;
+
+        // candidates: things to avoid in 3x3 cells around, whose box contains the position
+        auto query = [&](float x, float y, std::vector<int>& result)
+        {
+            int cx = map.CellX(x), cy = map.CellY(y);
+            int cx0 = std::max(cx - 1, 0), cx1 = std::min(cx + 1, map.width - 1);
+            for (int row = std::max(cy - 1, 0), rowEnd = std::min(cy + 1, map.height - 1); row <= rowEnd; ++row)
+            {
+                for (int i = m_GridStart[row * map.width + cx0], end = m_GridStart[row * map.width + cx1 + 1]; i != end; ++i)
+                {
+                    if (m_AvoidBoxes[m_GridItems[i]].Contains(x, y))
+                        result.push_back(m_GridItems[i]);
+                }
+            }
+        };
+        ParallelForEachRun(objectList, parallel, [&](EntityID begin, EntityID end)
+        {
+            std::vector<int> initial, candidates;
+            for (EntityID go = begin; go != end; ++go)
+            {
+                initial.clear();
+                query(objects.m_Positions[go].x, objects.m_Positions[go].y, initial);
+                if (!initial.empty())
+                    CheckCandidates(objects, go, deltaTime, initial.data(), initial.size(), candidates, query);
+            }
+        });
+    }
+
+    // BVH broadphase: a tree of things to avoid, refit as they move (and rebuilt when that made it
+    // too loose). Objects are sorted into a cell index, and each cell queries the tree once with the
+    // bounds of its objects; then its objects only check the (few) things to avoid that overlap it.
+    void UpdateSystemBVH(Entities& objects, float deltaTime, const ParallelSettings& parallel)
+    {
+        UpdateAvoidBoxes(objects);
+        if (m_BVH.empty() || m_BVHItemCount != m_AvoidBoxes.size())
+        {
+            m_BVH.Build(m_AvoidBoxes);
+            m_BVHItemCount = m_AvoidBoxes.size();
+            m_BVHRebuildCount = 0;
+        }
+        else if (m_BVH.Refit(m_AvoidBoxes))
+        {
+            m_BVH.Build(m_AvoidBoxes);
+            m_BVHRebuildCount++;
+        }
+
+        // cells sized to have a few dozen objects each, over the world bounds (or where objects are)
+        WorldBoundsComponent bounds;
+        if (boundsID != (EntityID)-1)
+            bounds = objects.m_WorldBounds[boundsID];
+        else
+        {
+            bounds = WorldBoundsComponent{ 1.0e30f, -1.0e30f, 1.0e30f, -1.0e30f };
+            objectList.ForEach([&](EntityID go)
+            {
+                const PositionComponent& pos = objects.m_Positions[go];
+                bounds = WorldBoundsComponent{ std::min(bounds.xMin, pos.x), std::max(bounds.xMax, pos.x), std::min(bounds.yMin, pos.y), std::max(bounds.yMax, pos.y) };
+            });
+        }
+        const float kObjectsPerCell = 32.0f;
+        float area = std::max((bounds.xMax - bounds.xMin) * (bounds.yMax - bounds.yMin), 1.0e-6f);
+        float cellSize = std::max(sqrtf(area * kObjectsPerCell / std::max<size_t>(objectList.size(), 1)),
+            std::max(bounds.xMax - bounds.xMin, bounds.yMax - bounds.yMin) / 2048.0f);
+        m_ObjectIndex.Build(SpatialGrid::CellMap::Create(bounds, cellSize), objects.m_Positions, objectList, parallel);
+
+        auto query = [&](float x, float y, std::vector<int>& result)
+        {
+            m_BVH.Query(AABB{ x, y, x, y }, [&](int ia)
+            {
+                if (m_AvoidBoxes[ia].Contains(x, y))
+                    result.push_back(ia);
+            });
+        };
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        settings.chunkSize = std::max<size_t>(1, parallel.chunkSize / (size_t)kObjectsPerCell);
+        ParallelFor(m_ObjectIndex.CellCount(), settings, [&](size_t firstCell, size_t lastCell)
+        {
+            std::vector<int> batch, candidates;
+            const EntityID* ids = m_ObjectIndex.IDs();
+            const PositionComponent* positions = m_ObjectIndex.Positions();
+            for (size_t cell = firstCell; cell != lastCell; ++cell)
+            {
+                uint32_t begin = m_ObjectIndex.CellStart((int)cell), end = m_ObjectIndex.CellStart((int)cell + 1);
+                if (begin == end)
+                    continue;
+                AABB box = { positions[begin].x, positions[begin].y, positions[begin].x, positions[begin].y };
+                for (uint32_t i = begin + 1; i != end; ++i)
+                    box.Add(AABB{ positions[i].x, positions[i].y, positions[i].x, positions[i].y });
+                batch.clear();
+                m_BVH.Query(box, [&](int ia) { batch.push_back(ia); });
+                if (batch.empty())
+                    continue;
+                for (uint32_t i = begin; i != end; ++i)
+                    CheckCandidates(objects, ids[i], deltaTime, batch.data(), batch.size(), candidates, query);
+            }
+        });
+    }
+
+    // Sweep broadphase ("sort and sweep"): objects sorted by x, and boxes of things to avoid sorted
+    // by their left edge. Both orders are kept from the previous frame, and things move very little
+    // in a frame, so insertion sort brings them up to date with few moves. Then going over objects
+    // in x order, only the boxes whose x range spans the object's x need checking.
+    void UpdateSystemSweep(Entities& objects, float deltaTime, const ParallelSettings& parallel)
+    {
+        UpdateAvoidBoxes(objects);
+        const PositionComponent* positions = objects.m_Positions.data();
+        if (m_SweepObjects.size() != objectList.size())
+        {
+            m_SweepObjects.clear();
+            objectList.ForEach([&](EntityID go) { m_SweepObjects.push_back(SweepObject{ positions[go].x, positions[go].y, go }); });
+            std::sort(m_SweepObjects.begin(), m_SweepObjects.end(), [](const SweepObject& a, const SweepObject& b) { return a.x < b.x; });
+        }
+        else
+        {
+            ParallelSettings settings = parallel;
+            settings.numa = false;
+            ParallelFor(m_SweepObjects.size(), settings, [&](size_t first, size_t last)
+            {
+                for (size_t i = first; i != last; ++i)
+                {
+                    SweepObject& o = m_SweepObjects[i];
+                    o.x = positions[o.id].x;
+                    o.y = positions[o.id].y;
+                }
+            });
+        }
+        InsertionSort(m_SweepObjects, [](const SweepObject& a, const SweepObject& b) { return a.x < b.x; });
+        if (m_SweepAvoiders.size() != avoidList.size())
+        {
+            m_SweepAvoiders.resize(avoidList.size());
+            for (size_t ia = 0; ia < avoidList.size(); ++ia)
+                m_SweepAvoiders[ia] = (int)ia;
+        }
+        InsertionSort(m_SweepAvoiders, [&](int a, int b) { return m_AvoidBoxes[a].xMin < m_AvoidBoxes[b].xMin; });
+        m_SweepAvoiderXMin.resize(m_SweepAvoiders.size());
+        float maxWidth = 0.0f;
+        for (size_t k = 0; k < m_SweepAvoiders.size(); ++k)
+        {
+            const AABB& box = m_AvoidBoxes[m_SweepAvoiders[k]];
+            m_SweepAvoiderXMin[k] = box.xMin;
+            maxWidth = std::max(maxWidth, box.xMax - box.xMin);
+        }
+
+        // point query for the requery after a bump: boxes whose left edge is within the widest
+        // box width to the left of the point
+        auto query = [&](float x, float y, std::vector<int>& result)
+        {
+            size_t k = std::upper_bound(m_SweepAvoiderXMin.begin(), m_SweepAvoiderXMin.end(), x) - m_SweepAvoiderXMin.begin();
+            while (k-- > 0 && m_SweepAvoiderXMin[k] >= x - maxWidth)
+            {
+                int ia = m_SweepAvoiders[k];
+                if (m_AvoidBoxes[ia].Contains(x, y))
+                    result.push_back(ia);
+            }
+        };
+
+        // sweep along x over sorted objects, keeping the set of boxes that span current x; each
+        // chunk of objects starts its own sweep with the boxes spanning x of its first object
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        ParallelFor(m_SweepObjects.size(), settings, [&](size_t first, size_t last)
+        {
+            // (active boxes carry copies of what's needed to check them)
+            struct ActiveBox
+            {
+                AABB box;
+                PositionComponent pos;
+                float distanceSq;
+                int ia;
+            };
+            std::vector<ActiveBox> active;
+            std::vector<int> initial, candidates;
+            auto activate = [&](size_t k)
+            {
+                int ia = m_SweepAvoiders[k];
+                active.push_back(ActiveBox{ m_AvoidBoxes[ia], positions[avoidList[ia]], avoidDistanceList[ia], ia });
+            };
+            float x0 = m_SweepObjects[first].x;
+            size_t next = std::upper_bound(m_SweepAvoiderXMin.begin(), m_SweepAvoiderXMin.end(), x0) - m_SweepAvoiderXMin.begin();
+            for (size_t k = next; k-- > 0 && m_SweepAvoiderXMin[k] >= x0 - maxWidth; )
+                activate(k);
+            for (size_t i = first; i != last; ++i)
+            {
+                const SweepObject& o = m_SweepObjects[i];
+                for (; next < m_SweepAvoiders.size() && m_SweepAvoiderXMin[next] <= o.x; ++next)
+                    activate(next);
+                initial.clear();
+                bool collides = false;
+                for (size_t k = 0; k < active.size(); )
+                {
+                    const ActiveBox& a = active[k];
+                    if (a.box.xMax < o.x)
+                    {
+                        active[k] = active.back();
+                        active.pop_back();
+                        continue;
+                    }
+                    if (o.y >= a.box.yMin && o.y <= a.box.yMax)
+                    {
+                        initial.push_back(a.ia);
+                        collides |= DistanceSq(PositionComponent{ o.x, o.y }, a.pos) < a.distanceSq;
+                    }
+                    ++k;
+                }
+                // (only go to the object's own data if it collides with anything)
+                if (collides)
+                    CheckCandidates(objects, o.id, deltaTime, initial.data(), initial.size(), candidates, query);
+            }
+        });
+    }
+
+    template<typename T, typename Less> static void InsertionSort(std::vector<T>& items, Less less)
+    {
+        for (size_t i = 1, n = items.size(); i < n; ++i)
+        {
+            if (!less(items[i], items[i - 1]))
+                continue;
+            T item = items[i];
+            size_t j = i;
+            do
+            {
+                items[j] = items[j - 1];
+                --j;
+            } while (j > 0 && less(item, items[j - 1]));
+            items[j] = item;
+        }
+    }
+
+    Broadphase m_LastBroadphase = kBroadphaseBruteForce;
+    std::vector<AABB> m_AvoidBoxes; // per thing to avoid
+    std::vector<EntityID> m_NearObjects; // with a grid of objects: ones in boxes of things to avoid
+    // grid broadphase: cell of each thing to avoid, where each cell starts in the items, and
+    // the items (indices into avoidList) sorted by cell
+    std::vector<int> m_GridCells, m_GridStart, m_GridItems;
+    // BVH broadphase
+    BVH m_BVH;
+    size_t m_BVHItemCount = 0;
+    size_t m_BVHRebuildCount = 0;
+    CellIndex m_ObjectIndex;
+    // sweep broadphase: objects (with their positions) sorted by x, and things to avoid (indices
+    // into avoidList) sorted by left edge of their box
+    struct SweepObject
+    {
+        float x, y;
+        EntityID id;
+    };
+    std::vector<SweepObject> m_SweepObjects;
+    std::vector<int> m_SweepAvoiders;
+    std::vector<float> m_SweepAvoiderXMin;
+
+    // State of time budgeted avoidance.
+    struct BudgetState
+    {
+        // how much any object could have gotten closer to any thing to avoid, in total
+        double travel = 0.0;
+        float maxClosingSpeed = 0.0f;
+        // per object, indexed by entity ID: it can't collide while travel is less than safeUntil;
+        // and frame it was last checked on
+        std::vector<double> safeUntil;
+        std::vector<unsigned> checkedFrame;
+        // (safeUntil, ID) of each object, as a min-heap; entries are updated lazily when they
+        // come up, since rotation only ever increases safeUntil
+        std::vector<std::pair<double, EntityID>> heap;
+        std::vector<float> avoidRadius;
+        unsigned frame = 0;
+        size_t cursor = 0; // rotation position: index of an object within objectList
+        unsigned rotationStart = 0;
+        int rotationFrames = 0;
+        size_t memberCount = 0;
+    };
+    BudgetState m_Budget;
+
+    void UpdateSystemBudgeted(Entities& objects, float deltaTime)
+    {
+        using namespace std::chrono;
+        const double kSafetyMargin = 1.0e-3; // more than float precision of distances within the world
+        const size_t kTimeCheckInterval = 64;
+        double startTime = duration<double>(steady_clock::now().time_since_epoch()).count();
+        auto outOfTime = [&]() { return duration<double>(steady_clock::now().time_since_epoch()).count() - startTime > timeBudget; };
+        auto heapOrder = [](const std::pair<double, EntityID>& a, const std::pair<double, EntityID>& b) { return a > b; };
+        BudgetState& b = m_Budget;
+        AvoidanceBudgetStats& stats = budgetStats;
+        stats = AvoidanceBudgetStats();
+
+        // (re)start when objects were added: everything gets checked in the first frame. State is
+        // sized for IDs of objects only, so entities coming & going after them (e.g. particles in
+        // the pool) do not cause restarts.
+        bool restart = b.memberCount != objectList.size();
+        if (restart)
+        {
+            EntityID idEnd = 0;
+            objectList.ForEachRun([&](EntityID begin, EntityID end) { idEnd = end; });
+            b = BudgetState();
+            b.memberCount = objectList.size();
+            b.safeUntil.assign(idEnd, 0.0);
+            b.checkedFrame.assign(idEnd, 0);
+            for (float d : avoidDistanceList)
+                b.avoidRadius.push_back(sqrtf(d));
+            float maxObject = maxObjectSpeed, maxAvoid = 0.0f;
+            objectList.ForEach([&](EntityID id)
+            {
+                const MoveComponent& m = objects.m_Moves[id];
+                maxObject = std::max(maxObject, sqrtf(m.velx * m.velx + m.vely * m.vely));
+            });
+            for (EntityID id : avoidList)
+            {
+                const MoveComponent& m = objects.m_Moves[id];
+                maxAvoid = std::max(maxAvoid, sqrtf(m.velx * m.velx + m.vely * m.vely));
+            }
+            b.maxClosingSpeed = (maxObject + maxAvoid) * 1.001f;
+        }
+        b.frame++;
+        double previousTravel = b.travel;
+        b.travel += b.maxClosingSpeed * deltaTime + extraTravel * 1.001f;
+
+        // checks an object; returns false if it collided
+        auto check = [&](EntityID go)
+        {
+            float clearance = CheckObject(objects, go, deltaTime);
+            b.checkedFrame[go] = b.frame;
+            if (clearance < 0.0f)
+            {
+                b.safeUntil[go] = b.travel;
+                return false;
+            }
+            b.safeUntil[go] = std::max(b.safeUntil[go], b.travel + clearance - kSafetyMargin);
+            return true;
+        };
+
+        if (restart)
+        {
+            objectList.ForEach([&](EntityID go)
+            {
+                check(go);
+                b.heap.emplace_back(b.safeUntil[go], go);
+            });
+            std::make_heap(b.heap.begin(), b.heap.end(), heapOrder);
+            stats.dueCount = objectList.size();
+            stats.rotationFrames = 1;
+            return;
+        }
+
+        // objects that might collide by now, closest to colliding first
+        std::vector<EntityID> due;
+        while (!b.heap.empty() && b.heap.front().first <= b.travel)
+        {
+            if (due.size() % kTimeCheckInterval == kTimeCheckInterval - 1 && outOfTime())
+                break;
+            std::pair<double, EntityID> entry = b.heap.front();
+            std::pop_heap(b.heap.begin(), b.heap.end(), heapOrder);
+            b.heap.pop_back();
+            if (b.checkedFrame[entry.second] == b.frame)
+                continue; // duplicate entry of an object that was just checked
+            if (entry.first != b.safeUntil[entry.second])
+            {
+                // rotation found it to be further away since; put back with that
+                b.heap.emplace_back(b.safeUntil[entry.second], entry.second);
+                std::push_heap(b.heap.begin(), b.heap.end(), heapOrder);
+                continue;
+            }
+            if (entry.first <= previousTravel && b.checkedFrame[entry.second] != b.frame - 1)
+                stats.lateCount++;
+            check(entry.second);
+            due.push_back(entry.second);
+        }
+        // (these go back to the heap after all due ones were taken out; they might be due again already)
+        for (EntityID go : due)
+        {
+            b.heap.emplace_back(b.safeUntil[go], go);
+            std::push_heap(b.heap.begin(), b.heap.end(), heapOrder);
+        }
+        stats.dueCount = due.size();
+
+        // then continue rotation through all objects, until out of time
+        std::vector<std::pair<EntityID, EntityID>> runs;
+        objectList.ForEachRun([&](EntityID begin, EntityID end) { runs.emplace_back(begin, end); });
+        size_t index = 0, r = 0, slice = 0, staleSum = 0;
+        while (r < runs.size() && index + (runs[r].second - runs[r].first) <= b.cursor)
+        {
+            index += runs[r].second - runs[r].first;
+            ++r;
+        }
+        while (slice < b.memberCount && !(slice % kTimeCheckInterval == 0 && outOfTime()))
+        {
+            EntityID go = runs[r].first + (b.cursor - index);
+            if (b.checkedFrame[go] != b.frame)
+            {
+                int stale = (int)(b.frame - b.checkedFrame[go]);
+                stats.sliceMaxStale = std::max(stats.sliceMaxStale, stale);
+                staleSum += stale;
+                if (!check(go))
+                {
+                    // collided even though it should not have been able to (only possible with
+                    // float rounding); make sure it gets checked again next frame
+                    b.heap.emplace_back(b.safeUntil[go], go);
+                    std::push_heap(b.heap.begin(), b.heap.end(), heapOrder);
+                }
+            }
+            ++slice;
+            if (++b.cursor == index + (runs[r].second - runs[r].first))
+            {
+                index = b.cursor;
+                if (++r == runs.size())
+                {
+                    // full rotation done
+                    b.cursor = index = r = 0;
+                    b.rotationFrames = (int)(b.frame - b.rotationStart);
+                    b.rotationStart = b.frame;
+                }
+            }
+        }
+        stats.sliceCount = slice;
+        stats.sliceAvgStale = slice ? (float)staleSum / slice : 0.0f;
+        stats.rotationFrames = b.rotationFrames;
+    }
+};
+
+
+// "Separation system": objects closer to each other than the radius push each other apart, each
+// moving away from the other by a fraction of their overlap per frame.
+//
+// Neighbours are found with a cell index of all objects, rebuilt every frame. Pushes of all objects
+// are computed first (from positions at the start of the update, and summed in a fixed order),
+// and applied after that; so results do not depend on the number of threads.
+struct SeparationSystem
+{
+    EntityID boundsID; // ID of object with world bounds (cells of the index cover them)
+    EntitySet objectList; // IDs of objects that push each other apart
+    float radius = 0.2f;
+    float stiffness = 0.5f; // fraction of overlap resolved per frame
+
+    void AddObjectToSystem(EntityID id)
+    {
+        objectList.Add(id);
+    }
+
+    void SetBounds(EntityID id)
+    {
+        boundsID = id;
+    }
+
+    // how far any object got pushed in the last update
+    float MaxPush() const { return m_MaxPush; }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        m_MaxPush = 0.0f;
+        if (objectList.empty() || radius <= 0.0f)
+            return;
+        // cells are the size of the radius (so neighbours are in the 3x3 cells around), but no
+        // more than about 2048 of them along the longer world side
+        const WorldBoundsComponent& bounds = objects.m_WorldBounds[boundsID];
+        float cellSize = std::max(radius, std::max(bounds.xMax - bounds.xMin, bounds.yMax - bounds.yMin) / 2048.0f);
+        m_Index.Build(SpatialGrid::CellMap::Create(bounds, cellSize), objects.m_Positions, objectList, parallel);
+        m_Push.resize(m_Index.size());
+
+        // compute pushes, going through objects in cell order (so that neighbours of consecutive
+        // ones are mostly the same), with positions of the index that are in that order too
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        const float r = radius, radiusSq = radius * radius, factor = stiffness * 0.5f;
+        ParallelFor(m_Index.size(), settings, [&](size_t first, size_t last)
+        {
+            const PositionComponent* positions = m_Index.Positions();
+            for (size_t i = first; i != last; ++i)
+            {
+                const PositionComponent pos = positions[i];
+                float pushX = 0.0f, pushY = 0.0f;
+                m_Index.ForEachRangeInRect(pos.x - r, pos.y - r, pos.x + r, pos.y + r, [&](size_t begin, size_t end)
+                {
+                    for (size_t j = begin; j != end; ++j)
+                    {
+                        float dx = pos.x - positions[j].x;
+                        float dy = pos.y - positions[j].y;
+                        float distSq = dx * dx + dy * dy;
+                        // (also skips the object itself, and ones at exactly the same position)
+                        if (distSq < radiusSq && distSq > 0.0f)
+                        {
+                            float dist = sqrtf(distSq);
+                            float amount = (r - dist) / dist * factor;
+                            pushX += dx * amount;
+                            pushY += dy * amount;
+                        }
+                    }
+                });
+                m_Push[i].x = pushX;
+                m_Push[i].y = pushY;
+            }
+        });
+
+        // apply them
+        float maxPushSq = 0.0f;
+        std::mutex maxPushMutex;
+        ParallelFor(m_Index.size(), settings, [&](size_t first, size_t last)
+        {
+            PositionComponent* positions = objects.m_Positions.data();
+            const EntityID* ids = m_Index.IDs();
+            float localMaxSq = 0.0f;
+            for (size_t i = first; i != last; ++i)
+            {
+                positions[ids[i]].x += m_Push[i].x;
+                positions[ids[i]].y += m_Push[i].y;
+                localMaxSq = std::max(localMaxSq, m_Push[i].x * m_Push[i].x + m_Push[i].y * m_Push[i].y);
+            }
+            std::lock_guard<std::mutex> lock(maxPushMutex);
+            maxPushSq = std::max(maxPushSq, localMaxSq);
+        });
+        m_MaxPush = sqrtf(maxPushSq);
+    }
+
+private:
+    CellIndex m_Index;
+    std::vector<PositionComponent> m_Push; // in cell order, like objects in the index
+    float m_MaxPush = 0.0f;
+};
+
+
+// "Avoider repulsion system": things to avoid bounce off each other too. Two of them are in
+// contact when closer than the larger of their avoid distances; each then gets pushed away from the
+// other by half of the overlap. The part of its velocity towards the others it touches (along the
+// combined normal of the contacts) gets mirrored, so speeds of things to avoid do not change.
+//
+// With many things to avoid this is an N-body problem, so neighbours are found with a cell index
+// (cells as large as the largest distance); just a few are checked against each other directly.
+// Like in SeparationSystem, everything is computed from the state at the start of the update, so
+// results do not depend on the number of threads.
+struct AvoiderRepulsionSystem
+{
+    EntityID boundsID; // ID of object with world bounds (cells of the index cover them)
+    EntitySet objectList; // IDs of things to avoid
+    int bruteForceMaxCount = 256; // up to this many, all pairs are checked without an index
+
+    void AddObjectToSystem(EntityID id, float distance)
+    {
+        objectList.Add(id);
+        if (id >= m_Distance.size())
+            m_Distance.resize(id + 1, 0.0f);
+        m_Distance[id] = distance;
+        m_MaxDistance = std::max(m_MaxDistance, distance);
+    }
+
+    void SetBounds(EntityID id)
+    {
+        boundsID = id;
+    }
+
+    // number of pairs in contact in the last update
+    size_t ContactCount() const { return m_ContactCount; }
+    // how far any object got pushed in the last update
+    float MaxPush() const { return m_MaxPush; }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        m_ContactCount = 0;
+        m_MaxPush = 0.0f;
+        if (objectList.size() < 2)
+            return;
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        std::atomic<size_t> contacts(0);
+
+        // objects in the order they are processed in, and their positions
+        const EntityID* ids;
+        const PositionComponent* positions;
+        size_t count = objectList.size();
+        bool bruteForce = count <= (size_t)bruteForceMaxCount;
+        if (bruteForce)
+        {
+            m_IDs.clear();
+            m_Positions.clear();
+            objectList.ForEach([&](EntityID id)
+            {
+                m_IDs.push_back(id);
+                m_Positions.push_back(objects.m_Positions[id]);
+            });
+            ids = m_IDs.data();
+            positions = m_Positions.data();
+        }
+        else
+        {
+            const WorldBoundsComponent& bounds = objects.m_WorldBounds[boundsID];
+            float cellSize = std::max(m_MaxDistance, std::max(bounds.xMax - bounds.xMin, bounds.yMax - bounds.yMin) / 2048.0f);
+            m_Index.Build(SpatialGrid::CellMap::Create(bounds, cellSize), objects.m_Positions, objectList, parallel);
+            ids = m_Index.IDs();
+            positions = m_Index.Positions();
+        }
+        m_Push.resize(count);
+
+        // pushes & velocity changes of each object: against all others, or ones in nearby cells
+        const float r = m_MaxDistance;
+        ParallelFor(count, settings, [&](size_t first, size_t last)
+        {
+            size_t localContacts = 0;
+            for (size_t i = first; i != last; ++i)
+            {
+                Response response;
+                response.velocity = objects.m_Moves[ids[i]];
+                if (bruteForce)
+                    localContacts += Collide(ids[i], positions[i], 0, count, ids, positions, response);
+                else
+                {
+                    const PositionComponent pos = positions[i];
+                    m_Index.ForEachRangeInRect(pos.x - r, pos.y - r, pos.x + r, pos.y + r, [&](size_t begin, size_t end)
+                    {
+                        localContacts += Collide(ids[i], pos, begin, end, ids, positions, response);
+                    });
+                }
+                // reflect the velocity once, against the combined normal of all contacts (reflecting
+                // against each one and adding those up would make objects gain speed); only this
+                // object's own velocity is read & written, so it can be changed right away
+                float normalLength = sqrtf(response.normal.x * response.normal.x + response.normal.y * response.normal.y);
+                if (normalLength > 0.0f)
+                {
+                    float nx = response.normal.x / normalLength, ny = response.normal.y / normalLength;
+                    float towards = response.velocity.velx * nx + response.velocity.vely * ny;
+                    if (towards < 0.0f)
+                    {
+                        MoveComponent& move = objects.m_Moves[ids[i]];
+                        move.velx -= 2.0f * towards * nx;
+                        move.vely -= 2.0f * towards * ny;
+                    }
+                }
+                m_Push[i] = response.push;
+            }
+            contacts += localContacts;
+        });
+
+        // apply pushes
+        float maxPushSq = 0.0f;
+        std::mutex maxPushMutex;
+        ParallelFor(count, settings, [&](size_t first, size_t last)
+        {
+            PositionComponent* objectPositions = objects.m_Positions.data();
+            float localMaxSq = 0.0f;
+            for (size_t i = first; i != last; ++i)
+            {
+                objectPositions[ids[i]].x += m_Push[i].x;
+                objectPositions[ids[i]].y += m_Push[i].y;
+                localMaxSq = std::max(localMaxSq, m_Push[i].x * m_Push[i].x + m_Push[i].y * m_Push[i].y);
+            }
+            std::lock_guard<std::mutex> lock(maxPushMutex);
+            maxPushSq = std::max(maxPushSq, localMaxSq);
+        });
+        m_ContactCount = contacts / 2;
+        m_MaxPush = sqrtf(maxPushSq);
+    }
+
+private:
+    struct Response
+    {
+        MoveComponent velocity; // at the start of the update
+        PositionComponent normal = { 0.0f, 0.0f }; // sum of contact normals
+        PositionComponent push = { 0.0f, 0.0f };
+    };
+
+    // Checks object (at pos) against others [begin,end) of the ids & positions arrays, and adds
+    // its push & contact normals from the ones it is in contact with; returns how many those
+    // were. They are summed (instead of applied one after another), so that they do not depend
+    // on the order other objects are checked in.
+    size_t Collide(EntityID go, PositionComponent pos, size_t begin, size_t end,
+        const EntityID* ids, const PositionComponent* positions, Response& response) const
+    {
+        float myDistance = m_Distance[go];
+        size_t contacts = 0;
+        for (size_t j = begin; j != end; ++j)
+        {
+            float dx = pos.x - positions[j].x;
+            float dy = pos.y - positions[j].y;
+            float distSq = dx * dx + dy * dy;
+            float contact = std::max(myDistance, m_Distance[ids[j]]);
+            // (also skips the object itself, and ones at exactly the same position)
+            if (distSq < contact * contact && distSq > 0.0f)
+            {
+                float dist = sqrtf(distSq);
+                float nx = dx / dist, ny = dy / dist;
+                float overlap = (contact - dist) * 0.5f;
+                response.push.x += nx * overlap;
+                response.push.y += ny * overlap;
+                response.normal.x += nx;
+                response.normal.y += ny;
+                ++contacts;
+            }
+        }
+        return contacts;
+    }
+
+    std::vector<float> m_Distance; // indexed by entity ID
+    float m_MaxDistance = 0.0f;
+    size_t m_ContactCount = 0;
+    float m_MaxPush = 0.0f;
+    CellIndex m_Index;
+    // when checking all pairs: objects & their positions before the update
+    std::vector<EntityID> m_IDs;
+    std::vector<PositionComponent> m_Positions;
+    // pushes of objects, in the order they were processed in
+    std::vector<PositionComponent> m_Push;
+};
+
+
+// Advances sprite animation frames (see AnimationComponent). Frames only change every few updates,
+// so the sprite index is only written for objects whose frame is different from the one at the
+// previous update; the update reads nothing but the (16 byte) animation components otherwise.
+// Sprite data extraction picks the new index up as part of its usual pass.
+struct AnimationSystem
+{
+    EntitySet entities; // IDs of objects that are animated
+    bool vectorized = true; // process four objects at a time with SIMD, when available
+
+    void AddObjectToSystem(EntityID id)
+    {
+        entities.Add(id);
+    }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        // first update, or time went backwards (e.g. game state restored): write everything
+        const bool writeAll = m_LastTime < 0.0 || time < m_LastTime;
+        const float t = (float)time, prevT = writeAll ? t : (float)m_LastTime;
+        m_LastTime = time;
+        std::atomic<size_t> changedCount(0);
+        ParallelForEachRun(entities, parallel, [&](EntityID begin, EntityID end)
+        {
+            const AnimationComponent* anims = objects.m_Animations.data() + begin;
+            SpriteComponent* sprites = objects.m_Sprites.data() + begin;
+            size_t io = 0, no = end - begin, changed = 0;
+#if SYSTEMS_USE_SSE
+            if (vectorized)
+            {
+                const __m128 vt = _mm_set1_ps(t), vprevT = _mm_set1_ps(prevT);
+                const int writeAllMask = writeAll ? 0xF : 0;
+                for (; io + 4 <= no; io += 4)
+                {
+                    // four components are a 4x4 matrix; transpose into rate, phase, first & count of each
+                    __m128 rate = _mm_loadu_ps((const float*)(anims + io));
+                    __m128 phase = _mm_loadu_ps((const float*)(anims + io + 1));
+                    __m128 first = _mm_loadu_ps((const float*)(anims + io + 2));
+                    __m128 count = _mm_loadu_ps((const float*)(anims + io + 3));
+                    _MM_TRANSPOSE4_PS(rate, phase, first, count);
+                    count = _mm_cvtepi32_ps(_mm_castps_si128(count));
+                    __m128 frame = AnimationFrame(_mm_add_ps(_mm_mul_ps(vt, rate), phase), count);
+                    __m128 prevFrame = AnimationFrame(_mm_add_ps(_mm_mul_ps(vprevT, rate), phase), count);
+                    int mask = _mm_movemask_ps(_mm_cmpneq_ps(frame, prevFrame)) | writeAllMask;
+                    if (mask == 0)
+                        continue;
+                    __m128i index = _mm_add_epi32(_mm_castps_si128(first), _mm_cvttps_epi32(frame));
+                    alignas(16) int indices[4];
+                    _mm_store_si128((__m128i*)indices, index);
+                    for (int l = 0; l < 4; ++l)
+                    {
+                        if (mask & (1 << l))
+                        {
+                            sprites[io + l].spriteIndex = indices[l];
+                            ++changed;
+                        }
+                    }
+                }
+            }
+#endif
+            for (; io != no; ++io)
+            {
+                const AnimationComponent& anim = anims[io];
+                float count = (float)anim.frameCount;
+                float frame = AnimationFrame(t * anim.rate + anim.phase, count);
+                if (writeAll || frame != AnimationFrame(prevT * anim.rate + anim.phase, count))
+                {
+                    sprites[io].spriteIndex = anim.firstFrame + (int)frame;
+                    ++changed;
+                }
+            }
+            changedCount += changed;
+        });
+        m_ChangedCount = changedCount;
+    }
+
+    // objects whose sprite index was written by the last update
+    size_t ChangedCount() const { return m_ChangedCount; }
+
+private:
+    // Frame within the animation (as a float) for frames since time zero; "modulo" is done with
+    // floats so that SIMD and scalar code get exactly the same results.
+    static float AnimationFrame(float frames, float count)
+    {
+        float f = (float)(int)frames;
+        return f - (float)(int)(f / count) * count;
+    }
+#if SYSTEMS_USE_SSE
+    static __m128 AnimationFrame(__m128 frames, __m128 count)
+    {
+        __m128 f = _mm_cvtepi32_ps(_mm_cvttps_epi32(frames));
+        return _mm_sub_ps(f, _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(f, count))), count));
+    }
+#endif
+
+    double m_LastTime = -1.0;
+    size_t m_ChangedCount = 0;
+};
+
+
+// Fades sprite colors of objects back to their base color (the one they had when added to the
+// system), after something else tinted them, e.g. bumping into things to avoid. Only "active"
+// objects (tinted, and not faded back yet) are processed: the tinting system sets their bits in
+// tintedObjects, and they are dropped from the active list once they reach the base color. Colors
+// of active objects are kept in the system in struct-of-arrays form, so they can be faded four at
+// a time with SIMD; sprites only get written to. The active list is kept sorted by ID, so those
+// writes go through sprite memory in one direction. The first update also picks up objects that are
+// not at their base color already (e.g. when entity data got restored from a replay keyframe).
+struct ColorDecaySystem
+{
+    float halfLife = 0.5f; // seconds for the tint to fade halfway
+    bool vectorized = true; // process four objects at a time with SIMD, when available
+    EntityBits tintedObjects; // objects tinted since the last update
+
+    void AddObjectToSystem(const Entities& objects, EntityID id)
+    {
+        if (id >= m_Base.size())
+        {
+            m_Base.resize(id + 1);
+            tintedObjects.resize(id + 1);
+        }
+        const SpriteComponent& sprite = objects.m_Sprites[id];
+        m_Base[id] = Color{ { sprite.colorR, sprite.colorG, sprite.colorB } };
+        m_Objects.Add(id);
+    }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        SpriteComponent* sprites = objects.m_Sprites.data();
+        if (!m_Started)
+        {
+            m_Objects.ForEach([&](EntityID id)
+            {
+                const Color& base = m_Base[id];
+                if (sprites[id].colorR != base.c[0] || sprites[id].colorG != base.c[1] || sprites[id].colorB != base.c[2])
+                    tintedObjects.Set(id);
+            });
+            m_Started = true;
+        }
+        m_Tinted.clear();
+        tintedObjects.ConsumeAll([&](EntityID id)
+        {
+            if (id < m_Base.size())
+                m_Tinted.push_back(id);
+        });
+        if (!m_Tinted.empty())
+            MergeTinted(sprites);
+
+        // fade active ones, and note the ones that got back to base color
+        const float keep = exp2f(-deltaTime / halfLife);
+        m_Done.resize(m_Active.ids.size());
+        std::atomic<size_t> doneCount(0);
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        ParallelFor(m_Active.ids.size(), settings, [&](size_t begin, size_t end)
+        {
+            const EntityID* ids = m_Active.ids.data();
+            float* r = m_Active.color[0].data();
+            float* g = m_Active.color[1].data();
+            float* b = m_Active.color[2].data();
+            const float* br = m_Active.base[0].data();
+            const float* bg = m_Active.base[1].data();
+            const float* bb = m_Active.base[2].data();
+            size_t i = begin, done = 0;
+#if SYSTEMS_USE_SSE
+            if (vectorized)
+            {
+                const __m128 vkeep = _mm_set1_ps(keep), eps = _mm_set1_ps(kEpsilon), absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+                for (; i + 4 <= end; i += 4)
+                {
+                    __m128 baseR = _mm_loadu_ps(br + i), baseG = _mm_loadu_ps(bg + i), baseB = _mm_loadu_ps(bb + i);
+                    __m128 dr = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(r + i), baseR), vkeep);
+                    __m128 dg = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(g + i), baseG), vkeep);
+                    __m128 db = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + i), baseB), vkeep);
+                    __m128 far = _mm_cmpgt_ps(_mm_and_ps(dr, absMask), eps);
+                    far = _mm_or_ps(far, _mm_cmpgt_ps(_mm_and_ps(dg, absMask), eps));
+                    far = _mm_or_ps(far, _mm_cmpgt_ps(_mm_and_ps(db, absMask), eps));
+                    // snap to base color once close enough
+                    _mm_storeu_ps(r + i, _mm_add_ps(baseR, _mm_and_ps(dr, far)));
+                    _mm_storeu_ps(g + i, _mm_add_ps(baseG, _mm_and_ps(dg, far)));
+                    _mm_storeu_ps(b + i, _mm_add_ps(baseB, _mm_and_ps(db, far)));
+                    int farMask = _mm_movemask_ps(far);
+                    for (int l = 0; l < 4; ++l)
+                    {
+                        SpriteComponent& sprite = sprites[ids[i + l]];
+                        sprite.colorR = r[i + l];
+                        sprite.colorG = g[i + l];
+                        sprite.colorB = b[i + l];
+                        m_Done[i + l] = (farMask & (1 << l)) == 0;
+                        done += m_Done[i + l];
+                    }
+                }
+            }
+#endif
+            for (; i != end; ++i)
+            {
+                float dr = (r[i] - br[i]) * keep, dg = (g[i] - bg[i]) * keep, db = (b[i] - bb[i]) * keep;
+                bool far = fabsf(dr) > kEpsilon || fabsf(dg) > kEpsilon || fabsf(db) > kEpsilon;
+                r[i] = br[i] + (far ? dr : 0.0f);
+                g[i] = bg[i] + (far ? dg : 0.0f);
+                b[i] = bb[i] + (far ? db : 0.0f);
+                SpriteComponent& sprite = sprites[ids[i]];
+                sprite.colorR = r[i];
+                sprite.colorG = g[i];
+                sprite.colorB = b[i];
+                m_Done[i] = !far;
+                done += !far;
+            }
+            doneCount += done;
+        });
+
+        // drop finished ones
+        if (doneCount > 0)
+        {
+            size_t count = 0;
+            for (size_t i = 0; i < m_Active.ids.size(); ++i)
+            {
+                if (!m_Done[i])
+                    m_Active.CopyTo(m_Active, i, count++);
+            }
+            m_Active.resize(count);
+        }
+    }
+
+    // objects that are still fading
+    size_t ActiveCount() const { return m_Active.ids.size(); }
+
+private:
+    static constexpr float kEpsilon = 1.0f / 512.0f; // (less than half a step of 8 bit color)
+
+    struct Color
+    {
+        float c[3];
+    };
+    // active list: IDs, current & base color channels
+    struct ActiveList
+    {
+        std::vector<EntityID> ids;
+        std::vector<float> color[3];
+        std::vector<float> base[3];
+
+        void resize(size_t n)
+        {
+            ids.resize(n);
+            for (int c = 0; c < 3; ++c)
+            {
+                color[c].resize(n);
+                base[c].resize(n);
+            }
+        }
+        void CopyTo(ActiveList& dst, size_t from, size_t to) const
+        {
+            dst.ids[to] = ids[from];
+            for (int c = 0; c < 3; ++c)
+            {
+                dst.color[c][to] = color[c][from];
+                dst.base[c][to] = base[c][from];
+            }
+        }
+    };
+
+    // Merges newly tinted objects into the active list; ones that already are in it restart
+    // fading from their new color.
+    void MergeTinted(const SpriteComponent* sprites)
+    {
+        m_Merged.resize(m_Active.ids.size() + m_Tinted.size());
+        size_t i = 0, t = 0, count = 0;
+        while (i < m_Active.ids.size() || t < m_Tinted.size())
+        {
+            if (t == m_Tinted.size() || (i < m_Active.ids.size() && m_Active.ids[i] < m_Tinted[t]))
+            {
+                m_Active.CopyTo(m_Merged, i++, count++);
+                continue;
+            }
+            EntityID id = m_Tinted[t++];
+            if (i < m_Active.ids.size() && m_Active.ids[i] == id)
+                ++i;
+            m_Merged.ids[count] = id;
+            m_Merged.color[0][count] = sprites[id].colorR;
+            m_Merged.color[1][count] = sprites[id].colorG;
+            m_Merged.color[2][count] = sprites[id].colorB;
+            for (int c = 0; c < 3; ++c)
+                m_Merged.base[c][count] = m_Base[id].c[c];
+            ++count;
+        }
+        m_Merged.resize(count);
+        std::swap(m_Active, m_Merged);
+    }
+
+    std::vector<Color> m_Base; // by entity ID
+    EntitySet m_Objects;
+    bool m_Started = false;
+    ActiveList m_Active, m_Merged;
+    std::vector<EntityID> m_Tinted;
+    std::vector<uint8_t> m_Done;
+};
+
+
+// Spawns particles from objects with an emitter (see EmitterComponent), into the entity pool (see
+// Entities::ReservePool); when the pool is full, particles that do not fit are dropped. Particles
+// get a small sprite of the emitter's color, and a lifetime. Emitters go in ID order and random
+// directions come from each emitter's own generator (kept in its component, so that it is part of
+// the entity data, like in replay keyframes); spawned particles are the same every run.
+struct SpawnerSystem
+{
+    EntitySet entities; // IDs of objects that emit particles
+
+    void AddObjectToSystem(EntityID id)
+    {
+        entities.Add(id);
+    }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        // how many each emitter spawns, and then all of them in one batch
+        size_t total = 0;
+        entities.ForEach([&](EntityID id)
+        {
+            EmitterComponent& emitter = objects.m_Emitters[id];
+            emitter.accumulator += emitter.rate * deltaTime;
+            total += (size_t)emitter.accumulator;
+        });
+        EntityID first;
+        size_t spawned = objects.SpawnPooled(total, first);
+        m_SpawnCount = spawned;
+        m_DropCount = total - spawned;
+
+        EntityID go = first;
+        entities.ForEach([&](EntityID id)
+        {
+            EmitterComponent& emitter = objects.m_Emitters[id];
+            int count = (int)emitter.accumulator;
+            emitter.accumulator -= (float)count;
+            const SpriteComponent& sprite = objects.m_Sprites[id];
+            for (int i = 0; i < count && go != first + spawned; ++i, ++go)
+            {
+                float angle = NextRandom01(emitter.random) * 3.1415926f * 2;
+                objects.m_Positions[go] = objects.m_Positions[id];
+                objects.m_Moves[go] = MoveComponent{ cosf(angle) * emitter.speed, sinf(angle) * emitter.speed };
+                objects.m_Sprites[go] = SpriteComponent{ sprite.colorR, sprite.colorG, sprite.colorB, sprite.spriteIndex, sprite.scale * 0.25f };
+                objects.m_Lifetimes[go] = LifetimeComponent{ emitter.lifetime };
+                objects.m_Flags[go] = Entities::kFlagPosition | Entities::kFlagSprite | Entities::kFlagMove | Entities::kFlagLifetime;
+            }
+        });
+    }
+
+    // particles spawned by the last update, and ones that did not fit into the pool
+    size_t SpawnCount() const { return m_SpawnCount; }
+    size_t DropCount() const { return m_DropCount; }
+
+private:
+    static float NextRandom01(uint32_t& random)
+    {
+        // xorshift32
+        random ^= random << 13;
+        random ^= random >> 17;
+        random ^= random << 5;
+        return (float)(random >> 8) * (1.0f / 16777216.0f);
+    }
+
+    size_t m_SpawnCount = 0, m_DropCount = 0;
+};
+
+
+// Ages pooled entities that have a lifetime (particles), drifting them along with their velocity
+// (they are not in MoveSystem, since their IDs change), and despawns the ones whose time ran out.
+// Despawning is done as one batch: expired entities from the start of the pool get replaced by
+// live ones from its end, so only as many entities get moved as there are expired ones.
+struct LifetimeSystem
+{
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        const size_t poolBegin = objects.m_PoolBegin, poolEnd = objects.m_Flags.size();
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        ParallelFor(poolEnd - poolBegin, settings, [&](size_t begin, size_t end)
+        {
+            PositionComponent* positions = objects.m_Positions.data() + poolBegin;
+            const MoveComponent* moves = objects.m_Moves.data() + poolBegin;
+            LifetimeComponent* lifetimes = objects.m_Lifetimes.data() + poolBegin;
+            for (size_t i = begin; i != end; ++i)
+            {
+                positions[i].x += moves[i].velx * deltaTime;
+                positions[i].y += moves[i].vely * deltaTime;
+                lifetimes[i].remaining -= deltaTime;
+            }
+        });
+
+        auto alive = [&](size_t id) { return !(objects.m_Flags[id] & Entities::kFlagLifetime) || objects.m_Lifetimes[id].remaining > 0.0f; };
+        size_t lo = poolBegin, hi = poolEnd;
+        while (true)
+        {
+            while (lo < hi && alive(lo))
+                ++lo;
+            while (hi > lo && !alive(hi - 1))
+                --hi;
+            if (lo >= hi)
+                break;
+            objects.MoveEntity(--hi, lo++);
+        }
+        objects.resize(hi);
+        m_DespawnCount = poolEnd - hi;
+    }
+
+    // entities despawned by the last update
+    size_t DespawnCount() const { return m_DespawnCount; }
+
+private:
+    size_t m_DespawnCount = 0;
+};
+
+
+// Parent-child hierarchies: attached objects are placed at an offset from their parent's position
+// every frame (after everything else has moved). Links are stored by depth level; all parents of
+// one level are in the levels before it, so propagation is one linear pass per level, with the
+// objects within a level processed in parallel (no recursion, no walking up to find parents).
+struct HierarchySystem
+{
+    // Attaches child to parent, which has to be attached already (or be a root).
+    void AddObjectToSystem(EntityID child, EntityID parent, float offsetX, float offsetY)
+    {
+        size_t depth = DepthOf(parent) + 1;
+        if (child >= m_Depth.size())
+            m_Depth.resize(child + 1, 0);
+        m_Depth[child] = (int)depth;
+        if (m_Levels.size() < depth)
+            m_Levels.resize(depth);
+        std::vector<Link>& level = m_Levels[depth - 1];
+        m_Sorted &= level.empty() || level.back().child < child;
+        level.push_back(Link{ child, parent, offsetX, offsetY });
+    }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        // within a level, go in increasing child ID order, so that writes go one way through memory
+        if (!m_Sorted)
+        {
+            for (std::vector<Link>& level : m_Levels)
+                std::sort(level.begin(), level.end(), [](const Link& a, const Link& b) { return a.child < b.child; });
+            m_Sorted = true;
+        }
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        PositionComponent* positions = objects.m_Positions.data();
+        for (const std::vector<Link>& level : m_Levels)
+        {
+            ParallelFor(level.size(), settings, [&](size_t begin, size_t end)
+            {
+                for (size_t i = begin; i != end; ++i)
+                {
+                    const Link& link = level[i];
+                    const PositionComponent& parentPos = positions[link.parent];
+                    positions[link.child] = PositionComponent{ parentPos.x + link.offsetX, parentPos.y + link.offsetY };
+                }
+            });
+        }
+    }
+
+    size_t LevelCount() const { return m_Levels.size(); }
+    // depth of an object in the hierarchy; zero for objects that are not attached to anything
+    size_t DepthOf(EntityID id) const { return id < m_Depth.size() ? m_Depth[id] : 0; }
+
+private:
+    struct Link
+    {
+        EntityID child, parent;
+        float offsetX, offsetY;
+    };
+    std::vector<std::vector<Link>> m_Levels; // links of objects at depth 1, 2, ...
+    std::vector<int> m_Depth; // by entity ID
+    bool m_Sorted = true;
+};
+
+
+// Boids-style flocking: each object steers away from neighbours that are too close (separation),
+// towards their average velocity (alignment) and towards their average position (cohesion); the
+// new velocity is kept between a min & max speed. Only up to maxNeighbours ones within the radius
+// are taken into account: when there are more, a random sample of them (reservoir sampling, with a
+// random sequence seeded by the object's ID). Taking the first ones found would favour the directions
+// that cells get gone through in, and make whole flocks drift that way.
+//
+// Neighbours are found with a cell index rebuilt every frame, like in SeparationSystem, and
+// everything is computed from velocities at the start of the update, so results do not depend on the
+// number of threads. Found neighbours are gathered into a small batch, that steering sums go through
+// four at a time (in lanes, so that results of the SIMD and scalar paths are the same). SIMD is off by
+// default: time goes into picking out neighbours one at a time, and the extra work of the SIMD path
+// to get them out of vector registers makes it slower than the scalar one.
+struct FlockingSystem
+{
+    EntityID boundsID; // ID of object with world bounds (cells of the index cover them)
+    EntitySet objectList; // IDs of objects that flock together
+    float radius = 0.3f; // neighbours are objects closer than this
+    int maxNeighbours = 16; // at most this many per object (no more than kMaxNeighbours)
+    float separationWeight = 0.02f;
+    float alignmentWeight = 1.0f;
+    float cohesionWeight = 0.5f;
+    float minSpeed = 0.5f, maxSpeed = 1.0f;
+    bool vectorized = false; // distance tests & sums four at a time with SIMD, when available
+
+    static const int kMaxNeighbours = 64;
+
+    void AddObjectToSystem(EntityID id)
+    {
+        objectList.Add(id);
+    }
+
+    void SetBounds(EntityID id)
+    {
+        boundsID = id;
+    }
+
+    // average number of neighbours taken into account per object in the last update
+    float AverageNeighbourCount() const { return m_Index.size() ? (float)m_NeighbourCount / m_Index.size() : 0.0f; }
+
+    void UpdateSystem(Entities& objects, double time, float deltaTime, const ParallelSettings& parallel = ParallelSettings())
+    {
+        m_NeighbourCount = 0;
+        if (objectList.empty() || radius <= 0.0f)
+            return;
+        // cells are the size of the radius, but no more than about 2048 of them along the longer side
+        const WorldBoundsComponent& bounds = objects.m_WorldBounds[boundsID];
+        float cellSize = std::max(radius, std::max(bounds.xMax - bounds.xMin, bounds.yMax - bounds.yMin) / 2048.0f);
+        m_Index.Build(SpatialGrid::CellMap::Create(bounds, cellSize), objects.m_Positions, objectList, parallel);
+
+        // velocities at the start of the update, in cell order like positions of the index
+        ParallelSettings settings = parallel;
+        settings.numa = false;
+        m_Velocities.resize(m_Index.size());
+        ParallelFor(m_Index.size(), settings, [&](size_t first, size_t last)
+        {
+            const EntityID* ids = m_Index.IDs();
+            for (size_t i = first; i != last; ++i)
+                m_Velocities[i] = objects.m_Moves[ids[i]];
+        });
+
+        // steer each object, going through them in cell order (so that neighbours of consecutive
+        // ones are mostly the same); each one only writes its own velocity
+        const float r = radius, radiusSq = radius * radius;
+        const int cap = std::max(0, std::min(maxNeighbours, (int)kMaxNeighbours));
+        std::atomic<size_t> neighbourCount(0);
+        ParallelFor(m_Index.size(), settings, [&](size_t first, size_t last)
+        {
+            const PositionComponent* positions = m_Index.Positions();
+            const EntityID* ids = m_Index.IDs();
+            Batch batch;
+            size_t localCount = 0;
+            for (size_t i = first; i != last; ++i)
+            {
+                const PositionComponent pos = positions[i];
+                uint32_t random = ids[i] + 1;
+                int seen = 0;
+                m_Index.ForEachRangeInRect(pos.x - r, pos.y - r, pos.x + r, pos.y + r, [&](size_t begin, size_t end)
+                {
+                    seen = GatherNeighbours(pos, positions, begin, end, radiusSq, cap, seen, random, batch);
+                });
+                int count = std::min(seen, cap);
+                localCount += count;
+
+                MoveComponent vel = m_Velocities[i];
+                if (count > 0)
+                {
+                    float sums[kSumCount];
+                    SumBatch(batch, count, sums);
+                    float invCount = 1.0f / count;
+                    float steerX = -sums[kSumSeparationX] * separationWeight
+                        + (sums[kSumVelocityX] * invCount - vel.velx) * alignmentWeight
+                        + sums[kSumOffsetX] * invCount * cohesionWeight;
+                    float steerY = -sums[kSumSeparationY] * separationWeight
+                        + (sums[kSumVelocityY] * invCount - vel.vely) * alignmentWeight
+                        + sums[kSumOffsetY] * invCount * cohesionWeight;
+                    vel.velx += steerX * deltaTime;
+                    vel.vely += steerY * deltaTime;
+                }
+                float speedSq = vel.velx * vel.velx + vel.vely * vel.vely;
+                if (speedSq > maxSpeed * maxSpeed || (speedSq < minSpeed * minSpeed && speedSq > 0.0f))
+                {
+                    float scale = (speedSq > maxSpeed * maxSpeed ? maxSpeed : minSpeed) / sqrtf(speedSq);
+                    vel.velx *= scale;
+                    vel.vely *= scale;
+                }
+                objects.m_Moves[ids[i]] = vel;
+            }
+            neighbourCount += localCount;
+        });
+        m_NeighbourCount = neighbourCount;
+    }
+
+private:
+    enum { kSumSeparationX, kSumSeparationY, kSumVelocityX, kSumVelocityY, kSumOffsetX, kSumOffsetY, kSumCount };
+
+    // neighbours of one object: offsets from it, squared distances & velocities; padded with zeroes
+    // up to a multiple of four (with a distance of one, so that separation of padding is zero too)
+    struct Batch
+    {
+        alignas(16) float dx[kMaxNeighbours + 4];
+        alignas(16) float dy[kMaxNeighbours + 4];
+        alignas(16) float distSq[kMaxNeighbours + 4];
+        alignas(16) float vx[kMaxNeighbours + 4];
+        alignas(16) float vy[kMaxNeighbours + 4];
+    };
+
+    // Adds a neighbour as the seen-th one found: into the next slot while there are less than cap of
+    // them, after that into a random slot with a chance of cap/(seen+1).
+    void AddNeighbour(Batch& batch, int seen, int cap, uint32_t& random, float dx, float dy, float distSq, size_t j) const
+    {
+        int index = seen;
+        if (seen >= cap)
+        {
+            // xorshift32
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+            index = (int)(((uint64_t)random * (uint32_t)(seen + 1)) >> 32);
+            if (index >= cap)
+                return;
+        }
+        batch.dx[index] = dx;
+        batch.dy[index] = dy;
+        batch.distSq[index] = distSq;
+        batch.vx[index] = m_Velocities[j].velx;
+        batch.vy[index] = m_Velocities[j].vely;
+    }
+
+    // Adds objects in [begin, end) of the index that are within the radius to the batch (skipping
+    // the object itself & ones at exactly the same position); returns the new number of neighbours
+    // seen, which can be more than cap (the number that fit into the batch).
+    int GatherNeighbours(const PositionComponent& pos, const PositionComponent* positions, size_t begin, size_t end, float radiusSq, int cap, int seen, uint32_t& random, Batch& batch) const
+    {
+        size_t j = begin;
+#if SYSTEMS_USE_SSE
+        if (vectorized)
+        {
+            const __m128 px = _mm_set1_ps(pos.x), py = _mm_set1_ps(pos.y);
+            const __m128 rSq = _mm_set1_ps(radiusSq), zero = _mm_setzero_ps();
+            for (; j + 4 <= end; j += 4)
+            {
+                // four positions (x,y pairs) into x's and y's
+                __m128 p01 = _mm_loadu_ps(&positions[j].x), p23 = _mm_loadu_ps(&positions[j + 2].x);
+                __m128 dx = _mm_sub_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0)), px);
+                __m128 dy = _mm_sub_ps(_mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1)), py);
+                __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+                int mask = _mm_movemask_ps(_mm_and_ps(_mm_cmplt_ps(distSq, rSq), _mm_cmpgt_ps(distSq, zero)));
+                if (mask == 0)
+                    continue;
+                alignas(16) float ldx[4], ldy[4], ldistSq[4];
+                _mm_store_ps(ldx, dx);
+                _mm_store_ps(ldy, dy);
+                _mm_store_ps(ldistSq, distSq);
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if (mask & (1 << lane))
+                        AddNeighbour(batch, seen++, cap, random, ldx[lane], ldy[lane], ldistSq[lane], j + lane);
+                }
+            }
+        }
+#endif
+        for (; j < end; ++j)
+        {
+            float dx = positions[j].x - pos.x;
+            float dy = positions[j].y - pos.y;
+            float distSq = dx * dx + dy * dy;
+            if (distSq < radiusSq && distSq > 0.0f)
+                AddNeighbour(batch, seen++, cap, random, dx, dy, distSq, j);
+        }
+        return seen;
+    }
+
+    // Sums over the batch: separation (offsets divided by squared distance), velocities & offsets.
+    void SumBatch(Batch& batch, int count, float sums[kSumCount]) const
+    {
+        int padded = (count + 3) & ~3;
+        for (int k = count; k < padded; ++k)
+        {
+            batch.dx[k] = batch.dy[k] = batch.vx[k] = batch.vy[k] = 0.0f;
+            batch.distSq[k] = 1.0f;
+        }
+        alignas(16) float lanes[kSumCount][4];
+#if SYSTEMS_USE_SSE
+        if (vectorized)
+        {
+            __m128 sepX = _mm_setzero_ps(), sepY = sepX, velX = sepX, velY = sepX, offX = sepX, offY = sepX;
+            for (int k = 0; k < padded; k += 4)
+            {
+                __m128 dx = _mm_load_ps(batch.dx + k), dy = _mm_load_ps(batch.dy + k);
+                __m128 distSq = _mm_load_ps(batch.distSq + k);
+                sepX = _mm_add_ps(sepX, _mm_div_ps(dx, distSq));
+                sepY = _mm_add_ps(sepY, _mm_div_ps(dy, distSq));
+                velX = _mm_add_ps(velX, _mm_load_ps(batch.vx + k));
+                velY = _mm_add_ps(velY, _mm_load_ps(batch.vy + k));
+                offX = _mm_add_ps(offX, dx);
+                offY = _mm_add_ps(offY, dy);
+            }
+            _mm_store_ps(lanes[kSumSeparationX], sepX);
+            _mm_store_ps(lanes[kSumSeparationY], sepY);
+            _mm_store_ps(lanes[kSumVelocityX], velX);
+            _mm_store_ps(lanes[kSumVelocityY], velY);
+            _mm_store_ps(lanes[kSumOffsetX], offX);
+            _mm_store_ps(lanes[kSumOffsetY], offY);
+        }
+        else
+#endif
+        {
+            for (int s = 0; s < kSumCount; ++s)
+                lanes[s][0] = lanes[s][1] = lanes[s][2] = lanes[s][3] = 0.0f;
+            for (int k = 0; k < padded; k += 4)
+            {
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    lanes[kSumSeparationX][lane] += batch.dx[k + lane] / batch.distSq[k + lane];
+                    lanes[kSumSeparationY][lane] += batch.dy[k + lane] / batch.distSq[k + lane];
+                    lanes[kSumVelocityX][lane] += batch.vx[k + lane];
+                    lanes[kSumVelocityY][lane] += batch.vy[k + lane];
+                    lanes[kSumOffsetX][lane] += batch.dx[k + lane];
+                    lanes[kSumOffsetY][lane] += batch.dy[k + lane];
+                }
+            }
+        }
+        for (int s = 0; s < kSumCount; ++s)
+            sums[s] = (lanes[s][0] + lanes[s][2]) + (lanes[s][1] + lanes[s][3]);
+    }
+
+    CellIndex m_Index;
+    std::vector<MoveComponent> m_Velocities; // at the start of the update, in cell order
+    size_t m_NeighbourCount = 0;
+};
+
+
+// Writes out data of an object with a Position & Sprite into a buffer that will be rendered later on.
+// Using a smaller global scale "zooms out" the rendering, so to speak.
+static inline void WriteSpriteData(const PositionComponent& pos, const SpriteComponent& sprite, sprite_data_t& spr)
+{
+    const float globalScale = 0.05f;
+    spr.posX = pos.x * globalScale;
+    spr.posY = pos.y * globalScale;
+    spr.scale = sprite.scale * globalScale;
+    spr.colR = sprite.colorR;
+    spr.colG = sprite.colorG;
+    spr.colB = sprite.colorB;
+    spr.sprite = (float)sprite.spriteIndex;
+}
+
+// Writes out sprite data of all objects that have a Position & Sprite; returns amount of sprites.
+static inline int WriteAllSpriteData(const Entities& objects, sprite_data_t* data)
+{
+    int objectCount = 0;
+    for (size_t i = 0, n = objects.m_Flags.size(); i != n; ++i)
+    {
+        if ((objects.m_Flags[i] & Entities::kFlagPosition) && (objects.m_Flags[i] & Entities::kFlagSprite))
+            WriteSpriteData(objects.m_Positions[i], objects.m_Sprites[i], data[objectCount++]);
+    }
+    return objectCount;
+}
+
+
+// Systems of the game, and how they are run in parallel (live in game.cpp)
+MoveSystem& GetGameMoveSystem();
+AvoidanceSystem& GetGameAvoidanceSystem();
+SeparationSystem& GetGameSeparationSystem();
+AvoiderRepulsionSystem& GetGameAvoiderRepulsionSystem();
+AnimationSystem& GetGameAnimationSystem();
+ColorDecaySystem& GetGameColorDecaySystem();
+SpawnerSystem& GetGameSpawnerSystem();
+LifetimeSystem& GetGameLifetimeSystem();
+HierarchySystem& GetGameHierarchySystem();
+FlockingSystem& GetGameFlockingSystem();
+ParallelSettings& GetGameMoveParallel();
+ParallelSettings& GetGameAvoidanceParallel();
+ParallelSettings& GetGameNeighbourParallel();
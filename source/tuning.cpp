@@ -0,0 +1,166 @@
+#include "tuning.h"
+#include "systems.h"
+#include <vector>
+#include <chrono>
+#include <functional>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifdef _MSC_VER
+extern "C" __declspec(dllimport) void __stdcall OutputDebugStringA(const char* lpOutputString);
+#endif
+
+
+static const char* kTuningHeader = "dod-playground tuning 2";
+static const size_t kChunkSizes[] = { 256, 1024, 4096, 16384, 65536 };
+static const int kRuns = 3;
+
+
+static void TuningPrint(const char* text)
+{
+    #ifdef _MSC_VER
+    OutputDebugStringA(text);
+    #endif
+    fputs(text, stdout);
+    fflush(stdout);
+}
+
+static double TimeNow()
+{
+    using namespace std::chrono;
+    return duration<double>(high_resolution_clock::now().time_since_epoch()).count();
+}
+
+// Best time out of a few runs of the system with given settings (after a warm-up run).
+static double TimeSystem(const std::function<void(const ParallelSettings&)>& update, const ParallelSettings& settings)
+{
+    update(settings);
+    double best = 1.0e30;
+    for (int r = 0; r < kRuns; ++r)
+    {
+        double t0 = TimeNow();
+        update(settings);
+        best = std::min(best, TimeNow() - t0);
+    }
+    return best;
+}
+
+// Finds the fastest settings (calling place with each before timing it). More threads are only used when that is clearly (5%) faster, since
+// they are not free for the rest of the machine.
+static ParallelSettings Calibrate(const char* name, const std::function<void(const ParallelSettings&)>& place,
+    const std::function<void(const ParallelSettings&)>& update, bool verbose)
+{
+    // on NUMA machines, also try with work split by node (see ParallelSettings::numa)
+    std::vector<bool> numaModes(1, false);
+    if (NumaNodeCpus().size() > 1)
+        numaModes.push_back(true);
+
+    std::vector<int> threadCounts;
+    int maxThreads = ParallelMaxThreads();
+    for (int t = 1; t < maxThreads; t *= 2)
+        threadCounts.push_back(t);
+    threadCounts.push_back(maxThreads);
+
+    ParallelSettings best;
+    double bestTime = TimeSystem(update, best);
+    char buf[200];
+    if (verbose)
+    {
+        snprintf(buf, sizeof(buf), "  %s: 1 thread %.2fms\n", name, bestTime * 1000.0);
+        TuningPrint(buf);
+    }
+    for (int threads : threadCounts)
+    {
+        if (threads == 1)
+            continue;
+        for (bool numa : numaModes)
+        {
+            for (size_t chunkSize : kChunkSizes)
+            {
+                ParallelSettings settings;
+                settings.chunkSize = chunkSize;
+                settings.threadCount = threads;
+                settings.numa = numa;
+                place(settings);
+                double t = TimeSystem(update, settings);
+                if (verbose)
+                {
+                    snprintf(buf, sizeof(buf), "  %s: %i threads%s, chunk %i: %.2fms\n", name, threads, numa ? " (numa)" : "", (int)chunkSize, t * 1000.0);
+                    TuningPrint(buf);
+                }
+                if (t < bestTime * 0.95)
+                {
+                    best = settings;
+                    bestTime = t;
+                }
+            }
+        }
+    }
+    if (verbose)
+    {
+        snprintf(buf, sizeof(buf), "  %s: using %i thread(s)%s, chunk %i (%.2fms)\n", name, best.threadCount, best.numa ? " (numa)" : "", (int)best.chunkSize, bestTime * 1000.0);
+        TuningPrint(buf);
+    }
+    return best;
+}
+
+
+extern "C" int tuning_calibrate(const char* path, int verbose)
+{
+    const float kDeltaTime = 1.0f / 60.0f;
+    game_destroy();
+    game_initialize(NULL);
+    Entities& objects = GetGameEntities();
+    MoveSystem& move = GetGameMoveSystem();
+    AvoidanceSystem& avoidance = GetGameAvoidanceSystem();
+    if (verbose)
+    {
+        char buf[200];
+        snprintf(buf, sizeof(buf), "Calibrating parallel settings (%i hardware threads)\n", ParallelMaxThreads());
+        TuningPrint(buf);
+    }
+    // data gets placed onto NUMA nodes as the settings being timed need it
+    GetGameMoveParallel() = Calibrate("move",
+        [&](const ParallelSettings& s) { NumaPlaceComponents(objects, move.entities, s); },
+        [&](const ParallelSettings& s) { move.UpdateSystem(objects, 0.0, kDeltaTime, s); }, verbose != 0);
+    GetGameAvoidanceParallel() = Calibrate("avoidance",
+        [&](const ParallelSettings& s) { NumaPlaceComponents(objects, avoidance.objectList, s); },
+        [&](const ParallelSettings& s) { avoidance.UpdateSystem(objects, 0.0, kDeltaTime, s); }, verbose != 0);
+    game_destroy();
+
+    if (path == NULL)
+        return 1;
+    FILE* f = fopen(path, "w");
+    if (f == NULL)
+        return 0;
+    fprintf(f, "%s\nthreads %i\n", kTuningHeader, ParallelMaxThreads());
+    fprintf(f, "move %i %i %i\n", (int)GetGameMoveParallel().chunkSize, GetGameMoveParallel().threadCount, (int)GetGameMoveParallel().numa);
+    fprintf(f, "avoidance %i %i %i\n", (int)GetGameAvoidanceParallel().chunkSize, GetGameAvoidanceParallel().threadCount, (int)GetGameAvoidanceParallel().numa);
+    bool ok = ferror(f) == 0;
+    ok &= fclose(f) == 0;
+    return ok ? 1 : 0;
+}
+
+
+extern "C" int tuning_load(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (f == NULL)
+        return 0;
+    char header[100] = "";
+    int threads = 0, moveChunk = 0, moveThreads = 0, moveNuma = 0, avoidChunk = 0, avoidThreads = 0, avoidNuma = 0;
+    bool ok = fgets(header, sizeof(header), f) != NULL;
+    ok = ok && fscanf(f, " threads %i move %i %i %i avoidance %i %i %i", &threads, &moveChunk, &moveThreads, &moveNuma, &avoidChunk, &avoidThreads, &avoidNuma) == 7;
+    fclose(f);
+    header[strcspn(header, "\r\n")] = 0;
+    if (!ok || strcmp(header, kTuningHeader) != 0 || threads != ParallelMaxThreads() || moveChunk < 1 || moveThreads < 1 || avoidChunk < 1 || avoidThreads < 1)
+        return 0;
+    GetGameMoveParallel().chunkSize = moveChunk;
+    GetGameMoveParallel().threadCount = moveThreads;
+    GetGameMoveParallel().numa = moveNuma != 0;
+    GetGameAvoidanceParallel().chunkSize = avoidChunk;
+    GetGameAvoidanceParallel().threadCount = avoidThreads;
+    GetGameAvoidanceParallel().numa = avoidNuma != 0;
+    return 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+// Calibration of how the game systems run in parallel (chunk size & thread count). Best settings
+// depend on the machine, and differ a lot between systems that are cheap per object (moving)
+// and expensive ones (avoidance), so they are measured instead of hand-tuned.
+
+// Times each game system at several chunk sizes & thread counts on a game initialized with the
+// default config, applies the fastest settings, and saves them into path (if not null). This
+// re-initializes the game, so call it before game_initialize. Prints results if verbose is set.
+// Returns zero if saving failed.
+int tuning_calibrate(const char* path, int verbose);
+
+// Loads & applies settings saved by tuning_calibrate. Returns zero if the file does not exist, or
+// was made on a machine with a different number of hardware threads.
+int tuning_load(const char* path);
+
+
+#ifdef __cplusplus
+}
+#endif